@@ -12,12 +12,22 @@
 	uint32_t sz
 
 	return 
-		string request
+		table request { string header, lightuserdata msg, sz } , or string request for multi part
 		uint32_t next_session
+		table padding (multi part) { { lightuserdata parts, sz } } , all the parts in one buffer
  */
 
 #define TEMP_LENGTH 0x8200
 #define MULTI_PART 0x8000
+// the request type with this bit is compressed
+#define COMPRESSED 0x40
+// the request type with this bit is a push (cluster.send), the peer never responds
+#define PUSH 0x20
+
+// defined in lzblock.c
+int lz_bound(int sz);
+int lz_compress(const uint8_t *src, int sz, uint8_t *dst, int cap);
+int lz_decompress(const uint8_t *src, int sz, uint8_t *dst, int dsz);
 
 static void
 fill_uint32(uint8_t * buf, uint32_t n) {
@@ -34,11 +44,46 @@ fill_header(lua_State *L, uint8_t *buf, int sz) {
 	buf[1] = sz & 0xff;
 }
 
+/*
+	compressed message :
+		DWORD original size
+		PADDING lz block (see lzblock.c)
+	return the compressed message, or NULL if sz < threshold or it saves less than 1/16
+ */
+static void *
+compress_message(const void *msg, uint32_t sz, int threshold, uint32_t *csz) {
+	if (threshold <= 0 || sz < (uint32_t)threshold || sz > 0x7fffffff) {
+		return NULL;
+	}
+	int cap = sz - sz / 16;
+	uint8_t * buf = skynet_malloc(cap + 4);
+	fill_uint32(buf, sz);
+	int n = lz_compress(msg, sz, buf+4, cap);
+	if (n == 0) {
+		skynet_free(buf);
+		return NULL;
+	}
+	*csz = n + 4;
+	return buf;
+}
+
+// the header and msg are sent by one socketdriver.send (writev), msg is not copied
+static void
+push_request(lua_State *L, const uint8_t *header, int hsz, void *msg, uint32_t sz) {
+	lua_createtable(L, 3, 0);
+	lua_pushlstring(L, (const char *)header, hsz);
+	lua_rawseti(L, -2, 1);
+	lua_pushlightuserdata(L, msg);
+	lua_rawseti(L, -2, 2);
+	lua_pushinteger(L, sz);
+	lua_rawseti(L, -2, 3);
+}
+
 /*
 	The request package :
 	size <= 0x8000 (32K) and address is id
 		WORD sz+9
-		BYTE 0
+		BYTE 0	; 0x40 if msg is compressed (the type | 0x40 for all the four types below)
 		DWORD addr
 		DWORD session
 		PADDING msg(sz)
@@ -69,24 +114,29 @@ fill_header(lua_State *L, uint8_t *buf, int sz) {
 		BYTE 2/3 ; 2:multipart, 3:multipart end
 		DWORD SESSION
 		PADDING msgpart(sz)
+
+	The msg is compressed when the threshold is given (negotiated per link, see clusterd.lua)
+	and sz >= threshold. The size in package is the compressed size.
+
+	The type of push (cluster.send) is the type above | 0x20. The session of one package push is 0,
+	the multi part push has a session only to join the parts. The peer doesn't respond to it.
  */
 static int
-packreq_number(lua_State *L, int session, void * msg, uint32_t sz) {
+packreq_number(lua_State *L, int session, void * msg, uint32_t sz, int flags) {
 	uint32_t addr = (uint32_t)lua_tointeger(L,1);
 	uint8_t buf[TEMP_LENGTH];
 	if (sz < MULTI_PART) {
 		fill_header(L, buf, sz+9);
-		buf[2] = 0;
+		buf[2] = flags;
 		fill_uint32(buf+3, addr);
-		fill_uint32(buf+7, (uint32_t)session);
-		memcpy(buf+11,msg,sz);
+		fill_uint32(buf+7, (flags & PUSH) ? 0 : (uint32_t)session);
 
-		lua_pushlstring(L, (const char *)buf, sz+11);
+		push_request(L, buf, 11, msg, sz);
 		return 0;
 	} else {
 		int part = (sz - 1) / MULTI_PART + 1;
 		fill_header(L, buf, 13);
-		buf[2] = 1;
+		buf[2] = 1 | flags;
 		fill_uint32(buf+3, addr);
 		fill_uint32(buf+7, (uint32_t)session);
 		fill_uint32(buf+11, sz);
@@ -96,7 +146,7 @@ packreq_number(lua_State *L, int session, void * msg, uint32_t sz) {
 }
 
 static int
-packreq_string(lua_State *L, int session, void * msg, uint32_t sz) {
+packreq_string(lua_State *L, int session, void * msg, uint32_t sz, int flags) {
 	size_t namelen = 0;
 	const char *name = lua_tolstring(L, 1, &namelen);
 	if (name == NULL || namelen < 1 || namelen > 255) {
@@ -107,18 +157,17 @@ packreq_string(lua_State *L, int session, void * msg, uint32_t sz) {
 	uint8_t buf[TEMP_LENGTH];
 	if (sz < MULTI_PART) {
 		fill_header(L, buf, sz+6+namelen);
-		buf[2] = 0x80;
+		buf[2] = 0x80 | flags;
 		buf[3] = (uint8_t)namelen;
 		memcpy(buf+4, name, namelen);
-		fill_uint32(buf+4+namelen, (uint32_t)session);
-		memcpy(buf+8+namelen,msg,sz);
+		fill_uint32(buf+4+namelen, (flags & PUSH) ? 0 : (uint32_t)session);
 
-		lua_pushlstring(L, (const char *)buf, sz+8+namelen);
+		push_request(L, buf, 8+namelen, msg, sz);
 		return 0;
 	} else {
 		int part = (sz - 1) / MULTI_PART + 1;
 		fill_header(L, buf, 10+namelen);
-		buf[2] = 0x81;
+		buf[2] = 0x81 | flags;
 		buf[3] = (uint8_t)namelen;
 		memcpy(buf+4, name, namelen);
 		fill_uint32(buf+4+namelen, (uint32_t)session);
@@ -129,33 +178,47 @@ packreq_string(lua_State *L, int session, void * msg, uint32_t sz) {
 	}
 }
 
-static void
-packreq_multi(lua_State *L, int session, void * msg, uint32_t sz) {
-	uint8_t buf[TEMP_LENGTH];
-	int part = (sz - 1) / MULTI_PART + 1;
-	int i;
-	char *ptr = msg;
-	for (i=0;i<part;i++) {
-		uint32_t s;
-		if (sz > MULTI_PART) {
-			s = MULTI_PART;
-			buf[2] = 2;
-		} else {
-			s = sz;
-			buf[2] = 3;	// the last multi part
-		}
-		fill_header(L, buf, s+5);
-		fill_uint32(buf+3, (uint32_t)session);
-		memcpy(buf+7, ptr, s);
-		lua_pushlstring(L, (const char *)buf, s+7);
-		lua_rawseti(L, -2, i+1);
+// the size of the multi parts of msg (sz bytes)
+static inline size_t
+parts_size(uint32_t sz) {
+	size_t part = (sz - 1) / MULTI_PART + 1;
+	return part * 7 + sz;
+}
+
+// fill the multi parts of msg into ptr, return the end of parts
+static uint8_t *
+fill_parts(lua_State *L, uint8_t * ptr, uint32_t session, const char * msg, uint32_t sz) {
+	while (sz > 0) {
+		uint32_t s = sz > MULTI_PART ? MULTI_PART : sz;
+		fill_header(L, ptr, s+5);
+		ptr[2] = sz > MULTI_PART ? 2 : 3;	// 3 : the last multi part
+		fill_uint32(ptr+3, session);
+		memcpy(ptr+7, msg, s);
+		ptr += s + 7;
+		msg += s;
 		sz -= s;
-		ptr += s;
 	}
+	return ptr;
+}
+
+// the parts are copied into one buffer, the padding table is { { buffer, size } },
+// so socketchannel sends it by one socket write without copy (see lua-socket.c get_buffer)
+static void
+packreq_multi(lua_State *L, int session, void * msg, uint32_t sz) {
+	size_t total = parts_size(sz);
+	uint8_t * buf = skynet_malloc(total);
+	uint8_t * ptr = fill_parts(L, buf, (uint32_t)session, msg, sz);
+	assert(ptr - buf == total);
+	lua_createtable(L, 2, 0);
+	lua_pushlightuserdata(L, buf);
+	lua_rawseti(L, -2, 1);
+	lua_pushinteger(L, total);
+	lua_rawseti(L, -2, 2);
+	lua_rawseti(L, -2, 1);
 }
 
 static int
-lpackrequest(lua_State *L) {
+packrequest(lua_State *L, int push) {
 	void *msg = lua_touserdata(L,3);
 	if (msg == NULL) {
 		return luaL_error(L, "Invalid request message");
@@ -166,36 +229,141 @@ lpackrequest(lua_State *L) {
 		skynet_free(msg);
 		return luaL_error(L, "Invalid request session %d", session);
 	}
+	int compressed = 0;
+	uint32_t csz;
+	void * cmsg = compress_message(msg, sz, (int)luaL_optinteger(L, 5, 0), &csz);
+	if (cmsg) {
+		skynet_free(msg);
+		msg = cmsg;
+		sz = csz;
+		compressed = COMPRESSED;
+	}
 	int addr_type = lua_type(L,1);
 	int multipak;
 	if (addr_type == LUA_TNUMBER) {
-		multipak = packreq_number(L, session, msg, sz);
+		multipak = packreq_number(L, session, msg, sz, compressed | push);
 	} else {
-		multipak = packreq_string(L, session, msg, sz);
+		multipak = packreq_string(L, session, msg, sz, compressed | push);
 	}
 	int current_session = session;
-	if (++session < 0) {
-		session = 1;
+	// one package push doesn't use the session
+	if (multipak || !push) {
+		if (++session < 0) {
+			session = 1;
+		}
 	}
 	lua_pushinteger(L, session);
 	if (multipak) {
-		lua_createtable(L, multipak, 0);
+		lua_createtable(L, 1, 0);
 		packreq_multi(L, current_session, msg, sz);
 		skynet_free(msg);
 		return 3;
 	} else {
-		skynet_free(msg);
+		// msg is in the request table
 		return 2;
 	}
 }
 
+static int
+lpackrequest(lua_State *L) {
+	return packrequest(L, 0);
+}
+
+// the same as packrequest, but the peer doesn't respond (see cluster.send)
+static int
+lpackpush(lua_State *L) {
+	return packrequest(L, PUSH);
+}
+
+/*
+	uint32_t/string addr
+	uint32_t node
+	lightuserdata msg
+	uint32_t sz
+	boolean push (optional)
+
+	return lightuserdata buffer, uint32_t size
+		The request packages (as packrequest or packpush, the multi parts follow the header) with session 0,
+		and DWORD node at last. It's sent to the native cluster service (service_cluster.c),
+		which fills the sessions of the link. msg is freed.
+ */
+static int
+lpacknative(lua_State *L) {
+	void *msg = lua_touserdata(L,3);
+	if (msg == NULL) {
+		return luaL_error(L, "Invalid request message");
+	}
+	uint32_t sz = (uint32_t)luaL_checkinteger(L,4);
+	uint32_t node = (uint32_t)luaL_checkinteger(L,2);
+	int push = lua_toboolean(L,5) ? PUSH : 0;
+	size_t namelen = 0;
+	const char *name = NULL;
+	int hsz;	// the size of header package (or the package without msg)
+	if (lua_type(L,1) == LUA_TNUMBER) {
+		hsz = 11;
+	} else {
+		name = lua_tolstring(L, 1, &namelen);
+		if (name == NULL || namelen < 1 || namelen > 255) {
+			skynet_free(msg);
+			return luaL_error(L, "name is too long %s", name);
+		}
+		hsz = 8 + namelen;
+	}
+	int part = 0;
+	size_t total;
+	if (sz < MULTI_PART) {
+		total = hsz + sz + 4;
+	} else {
+		part = 1;
+		total = hsz + 4 + parts_size(sz) + 4;
+	}
+	uint8_t * buf = skynet_malloc(total);
+	uint8_t * ptr = buf;
+	if (part == 0) {
+		fill_header(L, ptr, hsz - 2 + sz);
+	} else {
+		fill_header(L, ptr, hsz - 2 + 4);
+	}
+	if (name == NULL) {
+		ptr[2] = (part ? 1 : 0) | push;
+		fill_uint32(ptr+3, (uint32_t)lua_tointeger(L,1));
+		fill_uint32(ptr+7, 0);
+	} else {
+		ptr[2] = (part ? 0x81 : 0x80) | push;
+		ptr[3] = (uint8_t)namelen;
+		memcpy(ptr+4, name, namelen);
+		fill_uint32(ptr+4+namelen, 0);
+	}
+	ptr += hsz;
+	if (part == 0) {
+		memcpy(ptr, msg, sz);
+		ptr += sz;
+	} else {
+		fill_uint32(ptr, sz);
+		ptr = fill_parts(L, ptr + 4, 0, msg, sz);
+	}
+	fill_uint32(ptr, node);
+	assert(ptr + 4 - buf == total);
+	skynet_free(msg);
+	lua_pushlightuserdata(L, buf);
+	lua_pushinteger(L, total);
+	return 2;
+}
+
 /*
 	string packed message
+	table large (optional)	; session -> the buffer of multi part request receiving
 	return 	
 		uint32_t or string addr
 		int session
-		string msg
+		string msg	; or the size of multi part, negative if it's compressed (see lconcat)
 		boolean padding
+		boolean push	; the parts of multi part push don't have the flag
+
+	If large is given, the multi part request is reassembled in C (see unpack_large) :
+	msg is nil and padding is true until the last part, which returns
+		addr, session, lightuserdata msg, false, boolean push, sz
+	msg is nil for the invalid multi part request.
  */
 
 static inline uint32_t
@@ -203,8 +371,52 @@ unpack_uint32(const uint8_t * buf) {
 	return buf[0] | buf[1]<<8 | buf[2]<<16 | buf[3]<<24;
 }
 
+// return the original message of compressed one, NULL if it's invalid
+static void *
+decompress_message(const uint8_t * buf, uint32_t sz, uint32_t *dsz) {
+	if (sz < 4) {
+		return NULL;
+	}
+	uint32_t n = unpack_uint32(buf);
+	// lz block can't be larger than 255 times
+	if (n > 0x7fffffff || n > (uint64_t)(sz - 4) * 255 + 16) {
+		return NULL;
+	}
+	void * msg = skynet_malloc(n);
+	if (lz_decompress(buf+4, sz-4, msg, n) < 0) {
+		skynet_free(msg);
+		return NULL;
+	}
+	*dsz = n;
+	return msg;
+}
+
+static void
+push_message(lua_State *L, const uint8_t * buf, int sz, int compressed) {
+	if (!compressed) {
+		lua_pushlstring(L, (const char *)buf, sz);
+		return;
+	}
+	uint32_t dsz;
+	void * msg = decompress_message(buf, sz, &dsz);
+	if (msg == NULL) {
+		luaL_error(L, "Invalid compressed cluster message (size=%d)", sz);
+	}
+	lua_pushlstring(L, msg, dsz);
+	skynet_free(msg);
+}
+
+static inline void
+push_size(lua_State *L, uint32_t size, int compressed) {
+	if (compressed) {
+		lua_pushinteger(L, -(lua_Integer)size);
+	} else {
+		lua_pushinteger(L, size);
+	}
+}
+
 static int
-unpackreq_number(lua_State *L, const uint8_t * buf, int sz) {
+unpackreq_number(lua_State *L, const uint8_t * buf, int sz, int compressed) {
 	if (sz < 9) {
 		return luaL_error(L, "Invalid cluster message (size=%d)", sz);
 	}
@@ -212,13 +424,13 @@ unpackreq_number(lua_State *L, const uint8_t * buf, int sz) {
 	uint32_t session = unpack_uint32(buf+5);
 	lua_pushinteger(L, address);
 	lua_pushinteger(L, session);
-	lua_pushlstring(L, (const char *)buf+9, sz-9);
+	push_message(L, buf+9, sz-9, compressed);
 
 	return 3;
 }
 
 static int
-unpackmreq_number(lua_State *L, const uint8_t * buf, int sz) {
+unpackmreq_number(lua_State *L, const uint8_t * buf, int sz, int compressed) {
 	if (sz != 13) {
 		return luaL_error(L, "Invalid cluster message size %d (multi req must be 13)", sz);
 	}
@@ -227,7 +439,7 @@ unpackmreq_number(lua_State *L, const uint8_t * buf, int sz) {
 	uint32_t size = unpack_uint32(buf+9);
 	lua_pushinteger(L, address);
 	lua_pushinteger(L, session);
-	lua_pushinteger(L, size);
+	push_size(L, size, compressed);
 	lua_pushboolean(L, 1);	// padding multi part
 
 	return 4;
@@ -249,7 +461,7 @@ unpackmreq_part(lua_State *L, const uint8_t * buf, int sz) {
 }
 
 static int
-unpackreq_string(lua_State *L, const uint8_t * buf, int sz) {
+unpackreq_string(lua_State *L, const uint8_t * buf, int sz, int compressed) {
 	if (sz < 2) {
 		return luaL_error(L, "Invalid cluster message (size=%d)", sz);
 	}
@@ -260,13 +472,13 @@ unpackreq_string(lua_State *L, const uint8_t * buf, int sz) {
 	lua_pushlstring(L, (const char *)buf+2, namesz);
 	uint32_t session = unpack_uint32(buf + namesz + 2);
 	lua_pushinteger(L, (uint32_t)session);
-	lua_pushlstring(L, (const char *)buf+2+namesz+4, sz - namesz - 6);
+	push_message(L, buf+2+namesz+4, sz - namesz - 6, compressed);
 
 	return 3;
 }
 
 static int
-unpackmreq_string(lua_State *L, const uint8_t * buf, int sz) {
+unpackmreq_string(lua_State *L, const uint8_t * buf, int sz, int compressed) {
 	if (sz < 2) {
 		return luaL_error(L, "Invalid cluster message (size=%d)", sz);
 	}
@@ -278,32 +490,180 @@ unpackmreq_string(lua_State *L, const uint8_t * buf, int sz) {
 	uint32_t session = unpack_uint32(buf + namesz + 2);
 	uint32_t size = unpack_uint32(buf + namesz + 6);
 	lua_pushinteger(L, session);
-	lua_pushinteger(L, size);
+	push_size(L, size, compressed);
 	lua_pushboolean(L, 1);	// padding multipart
 
 	return 4;
 }
 
+// the multi part request receiving, the buffer is sized by the header, and the parts are copied into it
+struct large_request {
+	char * buffer;
+	uint32_t size;
+	uint32_t offset;
+	int compressed;
+	int push;
+};
+
+static int
+lfree_large(lua_State *L) {
+	struct large_request * req = lua_touserdata(L, 1);
+	skynet_free(req->buffer);
+	req->buffer = NULL;
+	return 0;
+}
+
+/*
+	The stack is msg, large, addr, session, size, true (padding) [, push] ,
+	put the buffer into large[session], and replace the size by nil.
+ */
+static void
+begin_large(lua_State *L, uint8_t type) {
+	uint32_t session = (uint32_t)lua_tointeger(L, 4);
+	lua_Integer size = lua_tointeger(L, 5);
+	int compressed = 0;
+	if (size < 0) {
+		compressed = 1;
+		size = -size;
+	}
+	if (size == 0 || size > 0x7fffffff) {
+		luaL_error(L, "Invalid cluster multi req size %d", (int)size);
+	}
+	struct large_request * req = lua_newuserdata(L, sizeof(*req));
+	req->buffer = NULL;
+	if (luaL_newmetatable(L, "cluster.large")) {
+		lua_pushcfunction(L, lfree_large);
+		lua_setfield(L, -2, "__gc");
+	}
+	lua_setmetatable(L, -2);
+	req->buffer = skynet_malloc(size);
+	req->size = (uint32_t)size;
+	req->offset = 0;
+	req->compressed = compressed;
+	req->push = type & PUSH;
+	lua_pushvalue(L, 3);
+	lua_setuservalue(L, -2);	// addr
+	lua_rawseti(L, 2, session);
+	lua_pushnil(L);
+	lua_replace(L, 5);
+}
+
+// a part of the multi part request in large
+static int
+unpack_large(lua_State *L, const uint8_t * buf, int sz) {
+	if (sz < 5) {
+		return luaL_error(L, "Invalid cluster multi part message");
+	}
+	uint32_t session = unpack_uint32(buf+1);
+	lua_rawgeti(L, 2, session);
+	struct large_request * req = luaL_testudata(L, -1, "cluster.large");
+	if (req == NULL) {
+		// unknown session
+		lua_pushnil(L);
+		lua_pushinteger(L, session);
+		lua_pushnil(L);
+		lua_pushboolean(L, buf[0] == 2);
+		return 4;
+	}
+	if (req->buffer) {
+		if (sz - 5 <= req->size - req->offset) {
+			memcpy(req->buffer + req->offset, buf+5, sz-5);
+			req->offset += sz-5;
+		} else {
+			// invalid, drop the parts until the last one
+			skynet_free(req->buffer);
+			req->buffer = NULL;
+		}
+	}
+	if (buf[0] == 2) {
+		lua_pushboolean(L, 0);
+		lua_pushinteger(L, session);
+		lua_pushnil(L);
+		lua_pushboolean(L, 1);	// padding
+		return 4;
+	}
+	// the last part
+	lua_pushnil(L);
+	lua_rawseti(L, 2, session);
+	lua_getuservalue(L, -1);	// addr
+	lua_pushinteger(L, session);
+	void * msg = NULL;
+	uint32_t msz = 0;
+	if (req->buffer && req->offset == req->size) {
+		if (req->compressed) {
+			msg = decompress_message((const uint8_t *)req->buffer, req->size, &msz);
+		} else {
+			msg = req->buffer;
+			msz = req->size;
+			req->buffer = NULL;
+		}
+	}
+	skynet_free(req->buffer);
+	req->buffer = NULL;
+	if (msg == NULL) {
+		lua_pushnil(L);
+		lua_pushboolean(L, 0);
+		lua_pushboolean(L, req->push);
+		return 5;
+	}
+	// msg will send to other service, See clusterd.lua
+	lua_pushlightuserdata(L, msg);
+	lua_pushboolean(L, 0);
+	lua_pushboolean(L, req->push);
+	lua_pushinteger(L, msz);
+	return 6;
+}
+
 static int
 lunpackrequest(lua_State *L) {
 	size_t ssz;
 	const char *msg = luaL_checklstring(L,1,&ssz);
 	int sz = (int)ssz;
-	switch (msg[0]) {
+	uint8_t type = (uint8_t)msg[0];
+	int compressed = type & COMPRESSED;
+	int large = lua_istable(L, 2);
+	int n;
+	if (large) {
+		lua_settop(L, 2);
+	}
+	switch (type & ~(COMPRESSED | PUSH)) {
 	case 0:
-		return unpackreq_number(L, (const uint8_t *)msg, sz);
+		n = unpackreq_number(L, (const uint8_t *)msg, sz, compressed);
+		break;
 	case 1:
-		return unpackmreq_number(L, (const uint8_t *)msg, sz);
+		n = unpackmreq_number(L, (const uint8_t *)msg, sz, compressed);
+		break;
 	case 2:
 	case 3:
+		if (type != 2 && type != 3) {
+			return luaL_error(L, "Invalid req package type %d", type);
+		}
+		if (large) {
+			return unpack_large(L, (const uint8_t *)msg, sz);
+		}
 		return unpackmreq_part(L, (const uint8_t *)msg, sz);
-	case '\x80':
-		return unpackreq_string(L, (const uint8_t *)msg, sz);
-	case '\x81':
-		return unpackmreq_string(L, (const uint8_t *)msg, sz);
+	case 0x80:
+		n = unpackreq_string(L, (const uint8_t *)msg, sz, compressed);
+		break;
+	case 0x81:
+		n = unpackmreq_string(L, (const uint8_t *)msg, sz, compressed);
+		break;
 	default:
-		return luaL_error(L, "Invalid req package type %d", msg[0]);
+		return luaL_error(L, "Invalid req package type %d", type);
+	}
+	if (large && n == 4) {
+		// the header of multi part request
+		begin_large(L, type);
+	}
+	if (type & PUSH) {
+		if (n == 3) {
+			lua_pushboolean(L, 0);	// no padding
+			++n;
+		}
+		lua_pushboolean(L, 1);
+		++n;
 	}
+	return n;
 }
 
 /*
@@ -314,17 +674,21 @@ lunpackrequest(lua_State *L) {
 		2: multi begin
 		3: multi part
 		4: multi end
+		5: ok (compressed msg)
+		6: multi begin (compressed msg)
 	PADDING msg
 		type = 0, error msg
 		type = 1, msg
-		type = 2, DWORD size
+		type = 2/6, DWORD size
 		type = 3/4, msg
+		type = 5, compressed msg
  */
 /*
 	int session
 	boolean ok
 	lightuserdata msg
 	int sz
+	integer threshold (optional) ; compress the msg if sz >= threshold
 	return string response
  */
 static int
@@ -343,12 +707,19 @@ lpackresponse(lua_State *L) {
 		sz = (size_t)luaL_checkinteger(L, 4);
 	}
 
+	void * cmsg = NULL;
 	if (!ok) {
 		if (sz > MULTI_PART) {
 			// truncate the error msg if too long
 			sz = MULTI_PART;
 		}
 	} else {
+		uint32_t csz;
+		cmsg = compress_message(msg, (uint32_t)sz, (int)luaL_optinteger(L, 5, 0), &csz);
+		if (cmsg) {
+			msg = cmsg;
+			sz = csz;
+		}
 		if (sz > MULTI_PART) {
 			// return 
 			int part = (sz - 1) / MULTI_PART + 1;
@@ -358,7 +729,7 @@ lpackresponse(lua_State *L) {
 			// multi part begin
 			fill_header(L, buf, 9);
 			fill_uint32(buf+2, session);
-			buf[6] = 2;
+			buf[6] = cmsg ? 6 : 2;
 			fill_uint32(buf+7, (uint32_t)sz);
 			lua_pushlstring(L, (const char *)buf, 11);
 			lua_rawseti(L, -2, 1);
@@ -382,6 +753,7 @@ lpackresponse(lua_State *L) {
 				sz -= s;
 				ptr += s;
 			}
+			skynet_free(cmsg);
 			return 1;
 		}
 	}
@@ -389,8 +761,9 @@ lpackresponse(lua_State *L) {
 	uint8_t buf[TEMP_LENGTH];
 	fill_header(L, buf, sz+5);
 	fill_uint32(buf+2, session);
-	buf[6] = ok;
+	buf[6] = cmsg ? 5 : ok;
 	memcpy(buf+7,msg,sz);
+	skynet_free(cmsg);
 
 	lua_pushlstring(L, (const char *)buf, sz+7);
 
@@ -401,7 +774,7 @@ lpackresponse(lua_State *L) {
 	string packed response
 	return integer session
 		boolean ok
-		string msg
+		string msg	; or the size of multi part, negative if it's compressed (see lconcat)
 		boolean padding
  */
 static int
@@ -423,13 +796,17 @@ lunpackresponse(lua_State *L) {
 		lua_pushboolean(L, 1);
 		lua_pushlstring(L, buf+5, sz-5);
 		return 3;
+	case 5:	// ok (compressed)
+		lua_pushboolean(L, 1);
+		push_message(L, (const uint8_t *)buf+5, sz-5, 1);
+		return 3;
 	case 2:	// multi begin
+	case 6:	// multi begin (compressed)
 		if (sz != 9) {
 			return 0;
 		}
-		sz = unpack_uint32((const uint8_t *)buf+5);
 		lua_pushboolean(L, 1);
-		lua_pushinteger(L, sz);
+		push_size(L, unpack_uint32((const uint8_t *)buf+5), buf[4] == 6);
 		lua_pushboolean(L, 1);
 		return 4;
 	case 3:	// multi part
@@ -442,6 +819,10 @@ lunpackresponse(lua_State *L) {
 	}
 }
 
+/*
+	table { size, part1, part2, ... } ; the size is negative if the parts are compressed
+	return lightuserdata msg, integer sz ; or nothing if the table is invalid
+ */
 static int
 lconcat(lua_State *L) {
 	if (!lua_istable(L,1))
@@ -450,6 +831,11 @@ lconcat(lua_State *L) {
 		return 0;
 	int sz = lua_tointeger(L,-1);
 	lua_pop(L,1);
+	int compressed = 0;
+	if (sz < 0) {
+		compressed = 1;
+		sz = -sz;
+	}
 	char * buff = skynet_malloc(sz);
 	int idx = 2;
 	int offset = 0;
@@ -469,6 +855,16 @@ lconcat(lua_State *L) {
 		skynet_free(buff);
 		return 0;
 	}
+	if (compressed) {
+		uint32_t dsz;
+		void * msg = decompress_message((const uint8_t *)buff, sz, &dsz);
+		skynet_free(buff);
+		if (msg == NULL) {
+			return 0;
+		}
+		buff = msg;
+		sz = (int)dsz;
+	}
 	// buff/sz will send to other service, See clusterd.lua
 	lua_pushlightuserdata(L, buff);
 	lua_pushinteger(L, sz);
@@ -479,10 +875,12 @@ int
 luaopen_cluster_core(lua_State *L) {
 	luaL_Reg l[] = {
 		{ "packrequest", lpackrequest },
+		{ "packpush", lpackpush },
 		{ "unpackrequest", lunpackrequest },
 		{ "packresponse", lpackresponse },
 		{ "unpackresponse", lunpackresponse },
 		{ "concat", lconcat },
+		{ "packnative", lpacknative },
 		{ NULL, NULL },
 	};
 	luaL_checkversion(L);
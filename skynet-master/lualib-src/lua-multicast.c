@@ -134,6 +134,169 @@ mc_remote(lua_State *L) {
 	return 2;
 }
 
+// a subscriber receives the message with its session (the channel id, or the id of a topic subscription)
+struct mc_member {
+	uint32_t handle;
+	int session;
+};
+
+// the local subscribers of a channel (or a topic pattern), see multicastd.lua
+struct mc_group {
+	int n;
+	int cap;
+	struct mc_member * m;
+};
+
+static int
+mc_gcgroup(lua_State *L) {
+	struct mc_group * g = lua_touserdata(L, 1);
+	skynet_free(g->m);
+	g->m = NULL;
+	g->n = 0;
+	return 0;
+}
+
+/*
+	return userdata group
+ */
+static int
+mc_newgroup(lua_State *L) {
+	struct mc_group * g = lua_newuserdata(L, sizeof(*g));
+	g->n = 0;
+	g->cap = 0;
+	g->m = NULL;
+	if (luaL_newmetatable(L, "multicast.group")) {
+		lua_pushcfunction(L, mc_gcgroup);
+		lua_setfield(L, -2, "__gc");
+	}
+	lua_setmetatable(L, -2);
+	return 1;
+}
+
+static void
+reserve_group(struct mc_group *g, int n) {
+	if (n > g->cap) {
+		int cap = g->cap ? g->cap : 16;
+		while (cap < n) {
+			cap *= 2;
+		}
+		g->m = skynet_realloc(g->m, cap * sizeof(struct mc_member));
+		g->cap = cap;
+	}
+}
+
+/*
+	userdata group
+	integer handle
+	integer session
+
+	Append a member, the caller keeps the index of each member (it doesn't join twice), see multicastd.lua
+	return the index of the member
+ */
+static int
+mc_join(lua_State *L) {
+	struct mc_group * g = luaL_checkudata(L, 1, "multicast.group");
+	uint32_t handle = (uint32_t)luaL_checkinteger(L, 2);
+	int session = (int)luaL_checkinteger(L, 3);
+	reserve_group(g, g->n + 1);
+	g->m[g->n].handle = handle;
+	g->m[g->n].session = session;
+	++g->n;
+	lua_pushinteger(L, g->n);
+	return 1;
+}
+
+/*
+	userdata group
+	integer index
+
+	Remove the member at index, the last member is moved to index.
+	return the handle and session of the member moved, nothing if the last one is removed
+ */
+static int
+mc_leave(lua_State *L) {
+	struct mc_group * g = luaL_checkudata(L, 1, "multicast.group");
+	lua_Integer index = luaL_checkinteger(L, 2);
+	if (index < 1 || index > g->n) {
+		return luaL_error(L, "Invalid member index %d", (int)index);
+	}
+	int i = (int)index - 1;
+	if (i == --g->n) {
+		return 0;
+	}
+	g->m[i] = g->m[g->n];
+	lua_pushinteger(L, g->m[i].handle);
+	lua_pushinteger(L, (uint32_t)g->m[i].session);
+	return 2;
+}
+
+/*
+	userdata group (dest)
+	userdata group ... (src)
+
+	Append all the members of the source groups to the dest group (the members of a topic, see multicastd.lua)
+	return the number of members in dest group
+ */
+static int
+mc_merge(lua_State *L) {
+	struct mc_group * g = luaL_checkudata(L, 1, "multicast.group");
+	int top = lua_gettop(L);
+	int i;
+	for (i=2;i<=top;i++) {
+		struct mc_group * src = luaL_checkudata(L, i, "multicast.group");
+		if (src == g)
+			return luaL_error(L, "Can't merge group into itself");
+		reserve_group(g, g->n + src->n);
+		memcpy(g->m + g->n, src->m, src->n * sizeof(struct mc_member));
+		g->n += src->n;
+	}
+	lua_pushinteger(L, g->n);
+	return 1;
+}
+
+/*
+	userdata group
+	lightuserdata struct mc_package **
+	integer source
+
+	Bind the reference (the number of members), and send the package to all the members
+	in the group, as skynet.redirect(subscriber, source, "multicast", session, msg).
+	The package is freed if the group is empty. (struct mc_package ** is freed)
+	return the number of members
+ */
+static int
+mc_publish(lua_State *L) {
+	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
+	struct mc_group * g = luaL_checkudata(L, 1, "multicast.group");
+	struct mc_package ** ptr = lua_touserdata(L, 2);
+	uint32_t source = (uint32_t)luaL_checkinteger(L, 3);
+	struct mc_package * pack = *ptr;
+	skynet_free(ptr);
+	int n = g->n;
+	if (n == 0) {
+		skynet_free(pack->data);
+		skynet_free(pack);
+		lua_pushinteger(L, 0);
+		return 1;
+	}
+	// set the reference before sending, the subscribers may close it at once
+	pack->reference = n;
+	int i;
+	for (i=0;i<n;i++) {
+		struct mc_package ** msg = skynet_malloc(sizeof(*msg));
+		*msg = pack;
+		if (skynet_send(ctx, source, g->m[i].handle, PTYPE_MULTICAST | PTYPE_TAG_DONTCOPY, g->m[i].session, msg, sizeof(*msg)) < 0) {
+			// the subscriber is dead, msg is freed by skynet_send
+			if (ATOM_DEC(&pack->reference) == 0) {
+				skynet_free(pack->data);
+				skynet_free(pack);
+			}
+		}
+	}
+	lua_pushinteger(L, n);
+	return 1;
+}
+
 static int
 mc_nextid(lua_State *L) {
 	uint32_t id = (uint32_t)luaL_checkinteger(L, 1);
@@ -153,9 +316,22 @@ luaopen_multicast_core(lua_State *L) {
 		{ "remote", mc_remote },
 		{ "packremote", mc_packremote },
 		{ "nextid", mc_nextid },
+		{ "group", mc_newgroup },
+		{ "join", mc_join },
+		{ "leave", mc_leave },
+		{ "merge", mc_merge },
+		{ "publish", mc_publish },
 		{ NULL, NULL },
 	};
 	luaL_checkversion(L);
-	luaL_newlib(L,l);
+	luaL_newlibtable(L,l);
+
+	lua_getfield(L, LUA_REGISTRYINDEX, "skynet_context");
+	struct skynet_context *ctx = lua_touserdata(L,-1);
+	if (ctx == NULL) {
+		return luaL_error(L, "Init skynet context first");
+	}
+
+	luaL_setfuncs(L,l,1);
 	return 1;
 }
@@ -20,11 +20,18 @@
 #define TYPE_OPEN 4
 #define TYPE_CLOSE 5
 #define TYPE_WARNING 6
+#define TYPE_DRAIN 7
 
 /*
 	Each package is uint16 + data , uint16 (serialized in big-endian) is the number of bytes comprising the data .
+	The size header can be uint32 for the packages larger than 64K, see lfilter and lpack .
  */
 
+struct header {
+	int size;	// 2 or 4 bytes
+	int max;	// max size of one package
+};
+
 struct netpack {
 	int id;
 	int size;
@@ -178,38 +185,68 @@ save_uncomplete(lua_State *L, int fd) {
 }
 
 static inline int
-read_size(uint8_t * buffer) {
-	int r = (int)buffer[0] << 8 | (int)buffer[1];
-	return r;
+read_size(uint8_t * buffer, int header) {
+	uint32_t r = (uint32_t)buffer[0] << 8 | (uint32_t)buffer[1];
+	if (header == 4) {
+		r = r << 16 | (uint32_t)buffer[2] << 8 | (uint32_t)buffer[3];
+	}
+	// negative (invalid) if it's larger than INT_MAX
+	return (int)r;
+}
+
+static inline int
+valid_size(int pack_size, const struct header *hdr) {
+	return pack_size >= 0 && pack_size <= hdr->max;
+}
+
+static int
+package_error(lua_State *L, int fd) {
+	lua_pushvalue(L, lua_upvalueindex(TYPE_ERROR));
+	lua_pushinteger(L, fd);
+	lua_pushliteral(L, "Invalid package size");
+	return 4;
 }
 
+// read a part of size header, uc->read is -(the bytes of header read)
 static void
-push_more(lua_State *L, int fd, uint8_t *buffer, int size) {
-	if (size == 1) {
-		struct uncomplete * uc = save_uncomplete(L, fd);
-		uc->read = -1;
-		uc->header = *buffer;
-		return;
-	}
-	int pack_size = read_size(buffer);
-	buffer += 2;
-	size -= 2;
-
-	if (size < pack_size) {
-		struct uncomplete * uc = save_uncomplete(L, fd);
-		uc->read = size;
-		uc->pack.size = pack_size;
-		uc->pack.buffer = skynet_malloc(pack_size);
-		memcpy(uc->pack.buffer, buffer, size);
-		return;
+read_header(struct uncomplete *uc, uint8_t *buffer, int size) {
+	int i;
+	for (i=0;i<size;i++) {
+		uc->header = (int)((uint32_t)uc->header << 8 | buffer[i]);
 	}
-	push_data(L, fd, buffer, pack_size, 1);
+	uc->read -= size;
+}
+
+// return -1 if there is a package with invalid size
+static int
+push_more(lua_State *L, int fd, uint8_t *buffer, int size, const struct header *hdr) {
+	while (size > 0) {
+		if (size < hdr->size) {
+			struct uncomplete * uc = save_uncomplete(L, fd);
+			read_header(uc, buffer, size);
+			return 0;
+		}
+		int pack_size = read_size(buffer, hdr->size);
+		if (!valid_size(pack_size, hdr)) {
+			return -1;
+		}
+		buffer += hdr->size;
+		size -= hdr->size;
 
-	buffer += pack_size;
-	size -= pack_size;
-	if (size > 0) {
-		push_more(L, fd, buffer, size);
+		if (size < pack_size) {
+			struct uncomplete * uc = save_uncomplete(L, fd);
+			uc->read = size;
+			uc->pack.size = pack_size;
+			uc->pack.buffer = skynet_malloc(pack_size);
+			memcpy(uc->pack.buffer, buffer, size);
+			return 0;
+		}
+		push_data(L, fd, buffer, pack_size, 1);
+
+		buffer += pack_size;
+		size -= pack_size;
 	}
+	return 0;
 }
 
 static void
@@ -223,18 +260,30 @@ close_uncomplete(lua_State *L, int fd) {
 }
 
 static int
-filter_data_(lua_State *L, int fd, uint8_t * buffer, int size) {
+filter_data_(lua_State *L, int fd, uint8_t * buffer, int size, const struct header *hdr) {
 	struct queue *q = lua_touserdata(L,1);
 	struct uncomplete * uc = find_uncomplete(q, fd);
 	if (uc) {
 		// fill uncomplete
+		int h = hash_fd(fd);
 		if (uc->read < 0) {
 			// read size
-			assert(uc->read == -1);
-			int pack_size = *buffer;
-			pack_size |= uc->header << 8 ;
-			++buffer;
-			--size;
+			int need = hdr->size + uc->read;
+			if (size < need) {
+				read_header(uc, buffer, size);
+				uc->next = q->hash[h];
+				q->hash[h] = uc;
+				return 1;
+			}
+			read_header(uc, buffer, need);
+			buffer += need;
+			size -= need;
+			int pack_size = uc->header;
+			if (!valid_size(pack_size, hdr)) {
+				skynet_free(uc);
+				return package_error(L, fd);
+			}
+			// the buffer is allocated once for the whole package, no realloc for the fragments
 			uc->pack.size = pack_size;
 			uc->pack.buffer = skynet_malloc(pack_size);
 			uc->read = 0;
@@ -243,7 +292,6 @@ filter_data_(lua_State *L, int fd, uint8_t * buffer, int size) {
 		if (size < need) {
 			memcpy(uc->pack.buffer + uc->read, buffer, size);
 			uc->read += size;
-			int h = hash_fd(fd);
 			uc->next = q->hash[h];
 			q->hash[h] = uc;
 			return 1;
@@ -262,19 +310,23 @@ filter_data_(lua_State *L, int fd, uint8_t * buffer, int size) {
 		// more data
 		push_data(L, fd, uc->pack.buffer, uc->pack.size, 0);
 		skynet_free(uc);
-		push_more(L, fd, buffer, size);
+		if (push_more(L, fd, buffer, size, hdr)) {
+			return package_error(L, fd);
+		}
 		lua_pushvalue(L, lua_upvalueindex(TYPE_MORE));
 		return 2;
 	} else {
-		if (size == 1) {
+		if (size < hdr->size) {
 			struct uncomplete * uc = save_uncomplete(L, fd);
-			uc->read = -1;
-			uc->header = *buffer;
+			read_header(uc, buffer, size);
 			return 1;
 		}
-		int pack_size = read_size(buffer);
-		buffer+=2;
-		size-=2;
+		int pack_size = read_size(buffer, hdr->size);
+		if (!valid_size(pack_size, hdr)) {
+			return package_error(L, fd);
+		}
+		buffer += hdr->size;
+		size -= hdr->size;
 
 		if (size < pack_size) {
 			struct uncomplete * uc = save_uncomplete(L, fd);
@@ -298,21 +350,61 @@ filter_data_(lua_State *L, int fd, uint8_t * buffer, int size) {
 		push_data(L, fd, buffer, pack_size, 1);
 		buffer += pack_size;
 		size -= pack_size;
-		push_more(L, fd, buffer, size);
+		if (push_more(L, fd, buffer, size, hdr)) {
+			return package_error(L, fd);
+		}
 		lua_pushvalue(L, lua_upvalueindex(TYPE_MORE));
 		return 2;
 	}
 }
 
 static inline int
-filter_data(lua_State *L, int fd, uint8_t * buffer, int size) {
-	int ret = filter_data_(L, fd, buffer, size);
+filter_data(lua_State *L, int fd, uint8_t * buffer, int size, const struct header *hdr) {
+	int ret = filter_data_(L, fd, buffer, size, hdr);
 	// buffer is the data of socket message, it malloc at socket_server.c : function forward_message .
 	// it should be free before return,
 	skynet_free(buffer);
 	return ret;
 }
 
+// The socket is framed by socket_server (see socket_server_frame), all the packages in buffer are complete.
+static int
+filter_frame(lua_State *L, int fd, uint8_t * buffer, int size, const struct header *hdr) {
+	int pack_size = read_size(buffer, hdr->size);
+	if (pack_size + hdr->size == size) {
+		// just one package, reuse the buffer
+		memmove(buffer, buffer + hdr->size, pack_size);
+		lua_pushvalue(L, lua_upvalueindex(TYPE_DATA));
+		lua_pushinteger(L, fd);
+		lua_pushlightuserdata(L, buffer);
+		lua_pushinteger(L, pack_size);
+		return 5;
+	}
+	uint8_t * ptr = buffer;
+	while (size > 0) {
+		pack_size = read_size(ptr, hdr->size);
+		if (pack_size < 0 || pack_size > size - hdr->size) {
+			// never happens if socket_server frames the packages, drop the rest.
+			// the packages pushed are dispatched before the error (see gateserver)
+			skynet_free(buffer);
+			return package_error(L, fd);
+		}
+		size -= hdr->size + pack_size;
+		if (size == 0) {
+			// the last package reuses the buffer
+			memmove(buffer, ptr + hdr->size, pack_size);
+			push_data(L, fd, buffer, pack_size, 0);
+			lua_pushvalue(L, lua_upvalueindex(TYPE_MORE));
+			return 2;
+		}
+		push_data(L, fd, ptr + hdr->size, pack_size, 1);
+		ptr += hdr->size + pack_size;
+	}
+	skynet_free(buffer);
+	lua_pushvalue(L, lua_upvalueindex(TYPE_MORE));
+	return 2;
+}
+
 static void
 pushstring(lua_State *L, const char * msg, int size) {
 	if (msg) {
@@ -326,6 +418,8 @@ pushstring(lua_State *L, const char * msg, int size) {
 	userdata queue
 	lightuserdata msg
 	integer size
+	integer header (optional) : size of package header, 2 (default) or 4
+	integer max (optional) : max size of package, 0xffff for header 2 and 0xffffff for header 4 by default
 	return
 		userdata queue
 		integer type
@@ -343,6 +437,15 @@ lfilter(lua_State *L) {
 	} else {
 		size = -1;
 	}
+	struct header hdr;
+	hdr.size = luaL_optinteger(L, 4, 2);
+	if (hdr.size == 2) {
+		hdr.max = luaL_optinteger(L, 5, 0xffff);
+	} else if (hdr.size == 4) {
+		hdr.max = luaL_optinteger(L, 5, 0xffffff);
+	} else {
+		return luaL_error(L, "Invalid package header size %d", hdr.size);
+	}
 
 	lua_settop(L, 1);
 
@@ -350,7 +453,10 @@ lfilter(lua_State *L) {
 	case SKYNET_SOCKET_TYPE_DATA:
 		// ignore listen id (message->id)
 		assert(size == -1);	// never padding string
-		return filter_data(L, message->id, (uint8_t *)buffer, message->ud);
+		return filter_data(L, message->id, (uint8_t *)buffer, message->ud, &hdr);
+	case SKYNET_SOCKET_TYPE_FRAME:
+		assert(size == -1);
+		return filter_frame(L, message->id, (uint8_t *)buffer, message->ud, &hdr);
 	case SKYNET_SOCKET_TYPE_CONNECT:
 		// ignore listen fd connect
 		return 1;
@@ -378,6 +484,11 @@ lfilter(lua_State *L) {
 		lua_pushinteger(L, message->id);
 		lua_pushinteger(L, message->ud);
 		return 4;
+	case SKYNET_SOCKET_TYPE_DRAIN:
+		lua_pushvalue(L, lua_upvalueindex(TYPE_DRAIN));
+		lua_pushinteger(L, message->id);
+		lua_pushinteger(L, message->ud);
+		return 4;
 	default:
 		// never get here
 		return 1;
@@ -407,6 +518,38 @@ lpop(lua_State *L) {
 	return 3;
 }
 
+/*
+	userdata queue
+	table batch
+	return
+		integer n
+
+	Pop all the packages in queue by one call, fill batch with fd, msg, size of each
+	package : batch[3*i-2], batch[3*i-1], batch[3*i] (i = 1, n).
+ */
+static int
+lpopall(lua_State *L) {
+	struct queue * q = lua_touserdata(L, 1);
+	luaL_checktype(L, 2, LUA_TTABLE);
+	int n = 0;
+	if (q) {
+		while (q->head != q->tail) {
+			struct netpack *np = &q->queue[q->head];
+			if (++q->head >= q->cap) {
+				q->head = 0;
+			}
+			lua_pushinteger(L, np->id);
+			lua_rawseti(L, 2, ++n);
+			lua_pushlightuserdata(L, np->buffer);
+			lua_rawseti(L, 2, ++n);
+			lua_pushinteger(L, np->size);
+			lua_rawseti(L, 2, ++n);
+		}
+	}
+	lua_pushinteger(L, n / 3);
+	return 1;
+}
+
 /*
 	string msg | lightuserdata/integer
 
@@ -426,25 +569,45 @@ tolstring(lua_State *L, size_t *sz, int index) {
 }
 
 static inline void
-write_size(uint8_t * buffer, int len) {
+write_size(uint8_t * buffer, int len, int header) {
+	if (header == 4) {
+		buffer[0] = (len >> 24) & 0xff;
+		buffer[1] = (len >> 16) & 0xff;
+		buffer += 2;
+	}
 	buffer[0] = (len >> 8) & 0xff;
 	buffer[1] = len & 0xff;
 }
 
+/*
+	string msg | lightuserdata/integer
+	integer header (optional) : 2 (default) or 4
+
+	lightuserdata/integer
+ */
 static int
 lpack(lua_State *L) {
 	size_t len;
 	const char * ptr = tolstring(L, &len, 1);
-	if (len >= 0x10000) {
-		return luaL_error(L, "Invalid size (too long) of data : %d", (int)len);
+	int header = luaL_optinteger(L, lua_isuserdata(L, 1) ? 3 : 2, 2);
+	if (header == 2) {
+		if (len >= 0x10000) {
+			return luaL_error(L, "Invalid size (too long) of data : %d", (int)len);
+		}
+	} else if (header == 4) {
+		if (len > 0x7fffffff - 4) {
+			return luaL_error(L, "Invalid size (too long) of data : %f", (double)len);
+		}
+	} else {
+		return luaL_error(L, "Invalid package header size %d", header);
 	}
 
-	uint8_t * buffer = skynet_malloc(len + 2);
-	write_size(buffer, len);
-	memcpy(buffer+2, ptr, len);
+	uint8_t * buffer = skynet_malloc(len + header);
+	write_size(buffer, len, header);
+	memcpy(buffer+header, ptr, len);
 
 	lua_pushlightuserdata(L, buffer);
-	lua_pushinteger(L, len + 2);
+	lua_pushinteger(L, len + header);
 
 	return 2;
 }
@@ -467,6 +630,7 @@ luaopen_netpack(lua_State *L) {
 	luaL_checkversion(L);
 	luaL_Reg l[] = {
 		{ "pop", lpop },
+		{ "popall", lpopall },
 		{ "pack", lpack },
 		{ "clear", lclear },
 		{ "tostring", ltostring },
@@ -481,8 +645,9 @@ luaopen_netpack(lua_State *L) {
 	lua_pushliteral(L, "open");
 	lua_pushliteral(L, "close");
 	lua_pushliteral(L, "warning");
+	lua_pushliteral(L, "drain");
 
-	lua_pushcclosure(L, lfilter, 6);
+	lua_pushcclosure(L, lfilter, 7);
 	lua_setfield(L, -2, "filter");
 
 	return 1;
@@ -10,88 +10,93 @@
 #include <lauxlib.h>
 
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
 
 #include "skynet_socket.h"
 
 #define BACKLOG 32
-// 2 ** 12 == 4096
-#define LARGE_PAGE_NODE 12
-#define BUFFER_LIMIT (256 * 1024)
-
-struct buffer_node {
-	char * msg;
-	int sz;
-	struct buffer_node *next;
-};
+#define MIN_BUFFER 4096
+// an empty buffer larger than BUFFER_SHRINK is released
+#define BUFFER_SHRINK (64 * 1024)
+// readline remembers the scan position of the sep not longer than MAX_SEP
+#define MAX_SEP 16
+
+/*
+	The read buffer of a socket is one contiguous block, [offset, offset+size) are the unread bytes.
+	lpushbuffer appends the data after them. When the block is full, the unread bytes move to the
+	head of the block (only when they are not more than the read bytes, so the copy is amortized),
+	or to a block twice larger. So a read never joins pieces, and readline searches one block by memchr.
 
+	scan : the first scan bytes from offset are searched for sep already, readline of the same sep
+	starts from there. It is kept by lpushbuffer, so checking readline for each push doesn't rescan.
+ */
 struct socket_buffer {
-	int size;
+	char * data;
+	int cap;
 	int offset;
-	struct buffer_node *head;
-	struct buffer_node *tail;
+	int size;
+	int scan;
+	int seplen;
+	char sep[MAX_SEP];
 };
 
+static void
+buffer_free(struct socket_buffer *sb) {
+	skynet_free(sb->data);
+	sb->data = NULL;
+	sb->cap = 0;
+	sb->offset = 0;
+	sb->size = 0;
+	sb->scan = 0;
+}
+
 static int
-lfreepool(lua_State *L) {
-	struct buffer_node * pool = lua_touserdata(L, 1);
-	int sz = lua_rawlen(L,1) / sizeof(*pool);
-	int i;
-	for (i=0;i<sz;i++) {
-		struct buffer_node *node = &pool[i];
-		if (node->msg) {
-			skynet_free(node->msg);
-			node->msg = NULL;
-		}
-	}
+lfreebuffer(lua_State *L) {
+	struct socket_buffer * sb = lua_touserdata(L, 1);
+	buffer_free(sb);
 	return 0;
 }
 
 static int
-lnewpool(lua_State *L, int sz) {
-	struct buffer_node * pool = lua_newuserdata(L, sizeof(struct buffer_node) * sz);
-	int i;
-	for (i=0;i<sz;i++) {
-		pool[i].msg = NULL;
-		pool[i].sz = 0;
-		pool[i].next = &pool[i+1];
-	}
-	pool[sz-1].next = NULL;
-	if (luaL_newmetatable(L, "buffer_pool")) {
-		lua_pushcfunction(L, lfreepool);
+lnewbuffer(lua_State *L) {
+	struct socket_buffer * sb = lua_newuserdata(L, sizeof(*sb));	
+	memset(sb, 0, sizeof(*sb));
+	if (luaL_newmetatable(L, "socket_buffer")) {
+		lua_pushcfunction(L, lfreebuffer);
 		lua_setfield(L, -2, "__gc");
 	}
 	lua_setmetatable(L, -2);
 	return 1;
 }
 
-static int
-lnewbuffer(lua_State *L) {
-	struct socket_buffer * sb = lua_newuserdata(L, sizeof(*sb));	
-	sb->size = 0;
-	sb->offset = 0;
-	sb->head = NULL;
-	sb->tail = NULL;
-	
-	return 1;
+// sz bytes at the head are read
+static void
+buffer_skip(struct socket_buffer *sb, int sz) {
+	sb->offset += sz;
+	sb->size -= sz;
+	sb->scan = sb->scan > sz ? sb->scan - sz : 0;
+	if (sb->size == 0) {
+		if (sb->cap > BUFFER_SHRINK) {
+			buffer_free(sb);
+		} else {
+			sb->offset = 0;
+		}
+	}
 }
 
 /*
-	userdata send_buffer
-	table pool
+	userdata socket_buffer
 	lightuserdata msg
 	int size
 
 	return size
 
-	Comment: The table pool record all the buffers chunk, 
-	and the first index [1] is a lightuserdata : free_node. We can always use this pointer for struct buffer_node .
-	The following ([2] ...)  userdatas in table pool is the buffer chunk (for struct buffer_node), 
-	we never free them until the VM closed. The size of first chunk ([2]) is 16 struct buffer_node,
-	and the second size is 32 ... The largest size of chunk is LARGE_PAGE_NODE (4096)
-
-	lpushbbuffer will get a free struct buffer_node from table pool, and then put the msg/size in it.
-	lpopbuffer return the struct buffer_node back to table pool (By calling return_free_node).
+	msg is freed, or it becomes the buffer block when the buffer is empty.
  */
 static int
 lpushbuffer(lua_State *L) {
@@ -99,42 +104,37 @@ lpushbuffer(lua_State *L) {
 	if (sb == NULL) {
 		return luaL_error(L, "need buffer object at param 1");
 	}
-	char * msg = lua_touserdata(L,3);
+	char * msg = lua_touserdata(L,2);
 	if (msg == NULL) {
-		return luaL_error(L, "need message block at param 3");
+		return luaL_error(L, "need message block at param 2");
 	}
-	int pool_index = 2;
-	luaL_checktype(L,pool_index,LUA_TTABLE);
-	int sz = luaL_checkinteger(L,4);
-	lua_rawgeti(L,pool_index,1);
-	struct buffer_node * free_node = lua_touserdata(L,-1);	// sb poolt msg size free_node
-	lua_pop(L,1);
-	if (free_node == NULL) {
-		int tsz = lua_rawlen(L,pool_index);
-		if (tsz == 0)
-			tsz++;
-		int size = 8;
-		if (tsz <= LARGE_PAGE_NODE-3) {
-			size <<= tsz;
-		} else {
-			size <<= LARGE_PAGE_NODE-3;
-		}
-		lnewpool(L, size);	
-		free_node = lua_touserdata(L,-1);
-		lua_rawseti(L, pool_index, tsz+1);
-	}
-	lua_pushlightuserdata(L, free_node->next);	
-	lua_rawseti(L, pool_index, 1);	// sb poolt msg size
-	free_node->msg = msg;
-	free_node->sz = sz;
-	free_node->next = NULL;
-
-	if (sb->head == NULL) {
-		assert(sb->tail == NULL);
-		sb->head = sb->tail = free_node;
+	int sz = luaL_checkinteger(L,3);
+	if (sb->size == 0 && sz >= sb->cap) {
+		skynet_free(sb->data);
+		sb->data = msg;
+		sb->cap = sz;
+		sb->offset = 0;
 	} else {
-		sb->tail->next = free_node;
-		sb->tail = free_node;
+		if (sb->offset + sb->size + sz > sb->cap) {
+			int need = sb->size + sz;
+			if (need <= sb->cap && sb->size <= sb->offset) {
+				memmove(sb->data, sb->data + sb->offset, sb->size);
+			} else {
+				int cap = sb->cap * 2;
+				if (cap < need)
+					cap = need;
+				if (cap < MIN_BUFFER)
+					cap = MIN_BUFFER;
+				char * data = skynet_malloc(cap);
+				memcpy(data, sb->data + sb->offset, sb->size);
+				skynet_free(sb->data);
+				sb->data = data;
+				sb->cap = cap;
+			}
+			sb->offset = 0;
+		}
+		memcpy(sb->data + sb->offset + sb->size, msg, sz);
+		skynet_free(msg);
 	}
 	sb->size += sz;
 
@@ -143,67 +143,6 @@ lpushbuffer(lua_State *L) {
 	return 1;
 }
 
-static void
-return_free_node(lua_State *L, int pool, struct socket_buffer *sb) {
-	struct buffer_node *free_node = sb->head;
-	sb->offset = 0;
-	sb->head = free_node->next;
-	if (sb->head == NULL) {
-		sb->tail = NULL;
-	}
-	lua_rawgeti(L,pool,1);
-	free_node->next = lua_touserdata(L,-1);
-	lua_pop(L,1);
-	skynet_free(free_node->msg);
-	free_node->msg = NULL;
-
-	free_node->sz = 0;
-	lua_pushlightuserdata(L, free_node);
-	lua_rawseti(L, pool, 1);
-}
-
-static void
-pop_lstring(lua_State *L, struct socket_buffer *sb, int sz, int skip) {
-	struct buffer_node * current = sb->head;
-	if (sz < current->sz - sb->offset) {
-		lua_pushlstring(L, current->msg + sb->offset, sz-skip);
-		sb->offset+=sz;
-		return;
-	}
-	if (sz == current->sz - sb->offset) {
-		lua_pushlstring(L, current->msg + sb->offset, sz-skip);
-		return_free_node(L,2,sb);
-		return;
-	}
-
-	luaL_Buffer b;
-	luaL_buffinit(L, &b);
-	for (;;) {
-		int bytes = current->sz - sb->offset;
-		if (bytes >= sz) {
-			if (sz > skip) {
-				luaL_addlstring(&b, current->msg + sb->offset, sz - skip);
-			} 
-			sb->offset += sz;
-			if (bytes == sz) {
-				return_free_node(L,2,sb);
-			}
-			break;
-		}
-		int real_sz = sz - skip;
-		if (real_sz > 0) {
-			luaL_addlstring(&b, current->msg + sb->offset, (real_sz < bytes) ? real_sz : bytes);
-		}
-		return_free_node(L,2,sb);
-		sz-=bytes;
-		if (sz==0)
-			break;
-		current = sb->head;
-		assert(current);
-	}
-	luaL_pushresult(&b);
-}
-
 static int
 lheader(lua_State *L) {
 	size_t len;
@@ -224,8 +163,7 @@ lheader(lua_State *L) {
 }
 
 /*
-	userdata send_buffer
-	table pool
+	userdata socket_buffer
 	integer sz 
  */
 static int
@@ -234,13 +172,12 @@ lpopbuffer(lua_State *L) {
 	if (sb == NULL) {
 		return luaL_error(L, "Need buffer object at param 1");
 	}
-	luaL_checktype(L,2,LUA_TTABLE);
-	int sz = luaL_checkinteger(L,3);
+	int sz = luaL_checkinteger(L,2);
 	if (sb->size < sz || sz == 0) {
 		lua_pushnil(L);
 	} else {
-		pop_lstring(L,sb,sz,0);
-		sb->size -= sz;
+		lua_pushlstring(L, sb->data + sb->offset, sz);
+		buffer_skip(sb, sz);
 	}
 	lua_pushinteger(L, sb->size);
 
@@ -248,8 +185,7 @@ lpopbuffer(lua_State *L) {
 }
 
 /*
-	userdata send_buffer
-	table pool
+	userdata socket_buffer
  */
 static int
 lclearbuffer(lua_State *L) {
@@ -257,11 +193,7 @@ lclearbuffer(lua_State *L) {
 	if (sb == NULL) {
 		return luaL_error(L, "Need buffer object at param 1");
 	}
-	luaL_checktype(L,2,LUA_TTABLE);
-	while(sb->head) {
-		return_free_node(L,2,sb);
-	}
-	sb->size = 0;
+	buffer_free(sb);
 	return 0;
 }
 
@@ -271,16 +203,12 @@ lreadall(lua_State *L) {
 	if (sb == NULL) {
 		return luaL_error(L, "Need buffer object at param 1");
 	}
-	luaL_checktype(L,2,LUA_TTABLE);
-	luaL_Buffer b;
-	luaL_buffinit(L, &b);
-	while(sb->head) {
-		struct buffer_node *current = sb->head;
-		luaL_addlstring(&b, current->msg + sb->offset, current->sz - sb->offset);
-		return_free_node(L,2,sb);
+	if (sb->size == 0) {
+		lua_pushliteral(L, "");
+		return 1;
 	}
-	luaL_pushresult(&b);
-	sb->size = 0;
+	lua_pushlstring(L, sb->data + sb->offset, sb->size);
+	buffer_skip(sb, sb->size);
 	return 1;
 }
 
@@ -292,29 +220,26 @@ ldrop(lua_State *L) {
 	return 0;
 }
 
-static bool
-check_sep(struct buffer_node * node, int from, const char *sep, int seplen) {
-	for (;;) {
-		int sz = node->sz - from;
-		if (sz >= seplen) {
-			return memcmp(node->msg+from,sep,seplen) == 0;
-		}
-		if (sz > 0) {
-			if (memcmp(node->msg + from, sep, sz)) {
-				return false;
-			}
-		}
-		node = node->next;
-		sep += sz;
-		seplen -= sz;
-		from = 0;
+// search sep from the position from (after offset), return the position or -1
+static int
+find_sep(struct socket_buffer *sb, int from, const char *sep, int seplen) {
+	const char * data = sb->data + sb->offset;
+	int last = sb->size - seplen;
+	while (from <= last) {
+		const char * p = memchr(data + from, sep[0], last - from + 1);
+		if (p == NULL)
+			break;
+		if (memcmp(p + 1, sep + 1, seplen - 1) == 0)
+			return p - data;
+		from = p - data + 1;
 	}
+	return -1;
 }
 
 /*
-	userdata send_buffer
-	table pool , nil for check
+	userdata socket_buffer
 	string sep
+	boolean check , only check
  */
 static int
 lreadline(lua_State *L) {
@@ -322,37 +247,37 @@ lreadline(lua_State *L) {
 	if (sb == NULL) {
 		return luaL_error(L, "Need buffer object at param 1");
 	}
-	// only check
-	bool check = !lua_istable(L, 2);
 	size_t seplen = 0;
-	const char *sep = luaL_checklstring(L,3,&seplen);
-	int i;
-	struct buffer_node *current = sb->head;
-	if (current == NULL)
+	const char *sep = luaL_checklstring(L,2,&seplen);
+	bool check = lua_toboolean(L, 3);
+	if (sb->size == 0 || sb->size < (int)seplen)
 		return 0;
-	int from = sb->offset;
-	int bytes = current->sz - from;
-	for (i=0;i<=sb->size - (int)seplen;i++) {
-		if (check_sep(current, from, sep, seplen)) {
-			if (check) {
-				lua_pushboolean(L,true);
-			} else {
-				pop_lstring(L, sb, i+seplen, seplen);
-				sb->size -= i+seplen;
-			}
-			return 1;
+	int pos = 0;
+	if (seplen > 0) {
+		int from = 0;
+		if (sb->seplen == (int)seplen && memcmp(sb->sep, sep, seplen) == 0) {
+			from = sb->scan;
+		} else if (seplen <= MAX_SEP) {
+			memcpy(sb->sep, sep, seplen);
+			sb->seplen = seplen;
+		} else {
+			sb->seplen = 0;
 		}
-		++from;
-		--bytes;
-		if (bytes == 0) {
-			current = current->next;
-			from = 0;
-			if (current == NULL)
-				break;
-			bytes = current->sz;
+		pos = find_sep(sb, from, sep, seplen);
+		if (pos < 0) {
+			// the last seplen-1 bytes may be the beginning of sep
+			sb->scan = sb->size - seplen + 1;
+			return 0;
 		}
+		sb->scan = pos;
 	}
-	return 0;
+	if (check) {
+		lua_pushboolean(L,true);
+	} else {
+		lua_pushlstring(L, sb->data + sb->offset, pos);
+		buffer_skip(sb, pos + seplen);
+	}
+	return 1;
 }
 
 static int
@@ -474,8 +399,14 @@ llisten(lua_State *L) {
 	const char * host = luaL_checkstring(L,1);
 	int port = luaL_checkinteger(L,2);
 	int backlog = luaL_optinteger(L,3,BACKLOG);
+	int reuseport = lua_toboolean(L,4);
 	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
-	int id = skynet_socket_listen(ctx, host,port,backlog);
+	int id;
+	if (reuseport) {
+		id = skynet_socket_listen_reuseport(ctx, host,port,backlog);
+	} else {
+		id = skynet_socket_listen(ctx, host,port,backlog);
+	}
 	if (id < 0) {
 		return luaL_error(L, "Listen error");
 	}
@@ -484,17 +415,52 @@ llisten(lua_State *L) {
 	return 1;
 }
 
+/*
+	A table of strings and messages : { string, lightuserdata, integer size, string, ... }
+	A message (malloc by skynet_malloc) is followed by its size, it is freed after sending.
+	return the total size, *n is the number of pieces, *message is true if there are messages
+ */
 static size_t
-count_size(lua_State *L, int index) {
+count_size(lua_State *L, int index, int *n, bool *message) {
 	size_t tlen = 0;
+	int pieces = 0;
+	bool msg = false;
+	bool number = false;
 	int i;
 	for (i=1;lua_geti(L, index, i) != LUA_TNIL; ++i) {
 		size_t len;
-		luaL_checklstring(L, -1, &len);
+		int type = lua_type(L, -1);
+		if (type == LUA_TLIGHTUSERDATA) {
+			lua_geti(L, index, ++i);
+			int isnum;
+			lua_Integer sz = lua_tointegerx(L, -1, &isnum);
+			if (!isnum || sz < 0) {
+				return luaL_error(L, "Invalid size of message at %d", i);
+			}
+			len = (size_t)sz;
+			lua_pop(L,1);
+			msg = true;
+		} else {
+			if (type != LUA_TSTRING) {
+				number = true;
+			}
+			luaL_checklstring(L, -1, &len);
+		}
 		tlen += len;
+		++pieces;
 		lua_pop(L,1);
 	}
 	lua_pop(L,1);
+	if (msg && number) {
+		// the strings converted from numbers are not anchored, see send_table
+		return luaL_error(L, "Invalid strings table");
+	}
+	if (n) {
+		*n = pieces;
+	}
+	if (message) {
+		*message = msg;
+	}
 	return tlen;
 }
 
@@ -504,11 +470,24 @@ concat_table(lua_State *L, int index, void *buffer, size_t tlen) {
 	int i;
 	for (i=1;lua_geti(L, index, i) != LUA_TNIL; ++i) {
 		size_t len;
-		const char * str = lua_tolstring(L, -1, &len);
-		if (str == NULL || tlen < len) {
-			break;
+		const char * str;
+		if (lua_type(L, -1) == LUA_TLIGHTUSERDATA) {
+			void * msg = lua_touserdata(L, -1);
+			lua_geti(L, index, ++i);
+			len = (size_t)lua_tointeger(L, -1);
+			lua_pop(L,1);
+			if (tlen < len) {
+				break;
+			}
+			memcpy(ptr, msg, len);
+			skynet_free(msg);
+		} else {
+			str = lua_tolstring(L, -1, &len);
+			if (str == NULL || tlen < len) {
+				break;
+			}
+			memcpy(ptr, str, len);
 		}
-		memcpy(ptr, str, len);
 		ptr += len;
 		tlen -= len;
 		lua_pop(L,1);
@@ -531,13 +510,23 @@ get_buffer(lua_State *L, int index, int *sz) {
 		buffer = lua_touserdata(L,index);
 		*sz = luaL_checkinteger(L,index+1);
 		break;
-	case LUA_TTABLE:
-		// concat the table as a string
-		len = count_size(L, index);
-		buffer = skynet_malloc(len);
-		concat_table(L, index, buffer, len);
+	case LUA_TTABLE: {
+		int n;
+		bool message;
+		len = count_size(L, index, &n, &message);
+		if (n == 1 && message) {
+			// { msg, sz } : send the message without copy
+			lua_geti(L, index, 1);
+			buffer = lua_touserdata(L, -1);
+			lua_pop(L, 1);
+		} else {
+			// concat the table as a string
+			buffer = skynet_malloc(len);
+			concat_table(L, index, buffer, len);
+		}
 		*sz = (int)len;
 		break;
+	}
 	default:
 		str =  luaL_checklstring(L, index, &len);
 		buffer = skynet_malloc(len);
@@ -548,13 +537,56 @@ get_buffer(lua_State *L, int index, int *sz) {
 	return buffer;
 }
 
+/*
+	Send a table with messages (see count_size) by writev, the messages are not copied.
+	The strings are copied by socket_server_sendv, they are anchored by the table until then.
+ */
+static int
+send_table(lua_State *L, struct skynet_context *ctx, int id, int index, int n) {
+	struct skynet_socket_piece * piece = lua_newuserdata(L, n * sizeof(*piece) + 1);
+	int i, j;
+	for (i=1,j=0;lua_geti(L, index, i) != LUA_TNIL; ++i,++j) {
+		struct skynet_socket_piece *p = &piece[j];
+		if (lua_type(L, -1) == LUA_TLIGHTUSERDATA) {
+			p->buffer = lua_touserdata(L, -1);
+			lua_geti(L, index, ++i);
+			p->sz = (int)lua_tointeger(L, -1);
+			p->own = 1;
+			lua_pop(L,1);
+		} else {
+			size_t len;
+			p->buffer = lua_tolstring(L, -1, &len);
+			p->sz = (int)len;
+			p->own = 0;
+		}
+		lua_pop(L,1);
+	}
+	int err = skynet_socket_sendv(ctx, id, piece, n);
+	lua_pop(L,2);
+	return err;
+}
+
 static int
 lsend(lua_State *L) {
 	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
 	int id = luaL_checkinteger(L, 1);
-	int sz = 0;
-	void *buffer = get_buffer(L, 2, &sz);
-	int err = skynet_socket_send(ctx, id, buffer, sz);
+	int err;
+	if (lua_type(L, 2) == LUA_TTABLE) {
+		int n = 0;
+		bool message = false;
+		size_t len = count_size(L, 2, &n, &message);
+		if (message) {
+			err = send_table(L, ctx, id, 2, n);
+		} else {
+			void *buffer = skynet_malloc(len);
+			concat_table(L, 2, buffer, len);
+			err = skynet_socket_send(ctx, id, buffer, (int)len);
+		}
+	} else {
+		int sz = 0;
+		void *buffer = get_buffer(L, 2, &sz);
+		err = skynet_socket_send(ctx, id, buffer, sz);
+	}
 	lua_pushboolean(L, !err);
 	return 1;
 }
@@ -569,6 +601,81 @@ lsendlow(lua_State *L) {
 	return 0;
 }
 
+/*
+	table ids
+	string msg | lightuserdata/integer | table
+
+	send one msg to all the sockets in ids, the buffer is shared in socket thread
+ */
+static int
+lsendmulti(lua_State *L) {
+	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
+	luaL_checktype(L, 1, LUA_TTABLE);
+	int n = lua_rawlen(L, 1);
+	int *id = lua_newuserdata(L, n * sizeof(int) + 1);
+	int i;
+	for (i=0;i<n;i++) {
+		lua_rawgeti(L, 1, i+1);
+		int isnum;
+		id[i] = lua_tointegerx(L, -1, &isnum);
+		if (!isnum) {
+			return luaL_error(L, "Invalid socket id at [%d]", i+1);
+		}
+		lua_pop(L, 1);
+	}
+	int sz = 0;
+	void *buffer = get_buffer(L, 2, &sz);
+	skynet_socket_send_multi(ctx, id, n, buffer, sz);
+	return 0;
+}
+
+/*
+	integer id
+	string path
+	integer offset (default 0)
+	integer len (default to the end of file)
+
+	return boolean, error string
+ */
+static int
+lsendfile(lua_State *L) {
+	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
+	int id = luaL_checkinteger(L, 1);
+	const char * path = luaL_checkstring(L, 2);
+	lua_Integer offset = luaL_optinteger(L, 3, 0);
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		lua_pushboolean(L, 0);
+		lua_pushstring(L, strerror(errno));
+		return 2;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		lua_pushboolean(L, 0);
+		lua_pushstring(L, strerror(errno));
+		return 2;
+	}
+	lua_Integer len = luaL_optinteger(L, 4, st.st_size - offset);
+	if (offset < 0 || len < 0 || offset + len > st.st_size) {
+		close(fd);
+		return luaL_error(L, "Invalid range %I + %I of %s (size = %I)", offset, len, path, (lua_Integer)st.st_size);
+	}
+	if (len > INT_MAX) {
+		close(fd);
+		return luaL_error(L, "%s is too large to send (%I)", path, len);
+	}
+	if (len == 0) {
+		close(fd);
+		lua_pushboolean(L, 1);
+		return 1;
+	}
+	// the fd is closed by socket thread
+	int err = skynet_socket_sendfile(ctx, id, fd, offset, (int)len);
+	lua_pushboolean(L, !err);
+	return 1;
+}
+
 static int
 lbind(lua_State *L) {
 	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
@@ -594,6 +701,49 @@ lnodelay(lua_State *L) {
 	return 0;
 }
 
+/*
+	integer id
+	integer high (bytes, 0 turns off)
+	integer low
+	string policy : "pause" (default), "drop" or "close"
+ */
+static int
+lwatermark(lua_State *L) {
+	// the same order with SOCKET_WATERMARK_* in socket_server.h
+	static const char * policy[] = { "pause", "drop", "close", NULL };
+	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
+	int id = luaL_checkinteger(L, 1);
+	lua_Integer high = luaL_checkinteger(L, 2);
+	lua_Integer low = luaL_optinteger(L, 3, high / 2);
+	int p = luaL_checkoption(L, 4, "pause", policy);
+	if (high < 0 || low < 0 || (high > 0 && low > high)) {
+		return luaL_error(L, "Invalid watermark %d/%d", (int)high, (int)low);
+	}
+	skynet_socket_watermark(ctx, id, high, low, p);
+	return 0;
+}
+
+static int
+lframe(lua_State *L) {
+	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
+	int id = luaL_checkinteger(L, 1);
+	int header = luaL_optinteger(L, 2, 2);
+	lua_Integer max;
+	if (header == 2) {
+		max = luaL_optinteger(L, 3, 0xffff);
+	} else if (header == 4 || header == 0) {
+		max = luaL_optinteger(L, 3, 0xffffff);
+	} else {
+		return luaL_error(L, "Invalid frame header size %d", header);
+	}
+	// the package size (header included) is an int
+	if (max < 0 || max > 0x7fffffff - header) {
+		return luaL_error(L, "Invalid frame max size %d", (int)max);
+	}
+	skynet_socket_frame(ctx, id, header, (int)max);
+	return 0;
+}
+
 static int
 ludp(lua_State *L) {
 	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
@@ -699,9 +849,13 @@ luaopen_socketdriver(lua_State *L) {
 		{ "listen", llisten },
 		{ "send", lsend },
 		{ "lsend", lsendlow },
+		{ "sendfile", lsendfile },
 		{ "bind", lbind },
 		{ "start", lstart },
 		{ "nodelay", lnodelay },
+		{ "watermark", lwatermark },
+		{ "frame", lframe },
+		{ "send_multi", lsendmulti },
 		{ "udp", ludp },
 		{ "udp_connect", ludp_connect },
 		{ "udp_send", ludp_send },
@@ -0,0 +1,189 @@
+/*
+	LZ77 fast compression in LZ4 block format, used by cluster links (see lua-cluster.c).
+
+	sequence :
+		BYTE token ; high 4 bits : literal length, low 4 bits : match length - 4 (15 means more bytes follow)
+		[BYTE 255 ...] BYTE ; literal length - 15 , if the high 4 bits is 15
+		literals
+		WORD offset ; little endian , 1 ~ 65535
+		[BYTE 255 ...] BYTE ; match length - 19 , if the low 4 bits is 15
+
+	The last sequence has only literals, and the last 5 bytes are always literals.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#define HASH_LOG 12
+#define MINMATCH 4
+#define LASTLITERALS 5
+#define MFLIMIT 12
+#define MAX_DISTANCE 65535
+// skip faster on incompressible data : step = 1 + (literals >> SKIP_SHIFT)
+#define SKIP_SHIFT 6
+
+static inline uint32_t
+read32(const uint8_t *p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint32_t
+hash32(uint32_t v) {
+	return (v * 2654435761U) >> (32 - HASH_LOG);
+}
+
+static inline uint8_t *
+write_length(uint8_t *op, int len) {
+	while (len >= 255) {
+		*op++ = 255;
+		len -= 255;
+	}
+	*op++ = (uint8_t)len;
+	return op;
+}
+
+// the max size of compressed data
+int
+lz_bound(int sz) {
+	return sz + sz / 255 + 16;
+}
+
+static uint8_t *
+write_sequence(uint8_t *op, const uint8_t *op_end, const uint8_t *literal, int litlen, int offset, int matchlen) {
+	// token + literal length + literals + offset + match length
+	if (op + 1 + litlen / 255 + 1 + litlen + 2 + matchlen / 255 + 1 > op_end) {
+		return NULL;
+	}
+	uint8_t *token = op++;
+	if (litlen >= 15) {
+		*token = 15 << 4;
+		op = write_length(op, litlen - 15);
+	} else {
+		*token = (uint8_t)(litlen << 4);
+	}
+	memcpy(op, literal, litlen);
+	op += litlen;
+	if (matchlen == 0) {
+		// the last literals
+		return op;
+	}
+	op[0] = offset & 0xff;
+	op[1] = (offset >> 8) & 0xff;
+	op += 2;
+	matchlen -= MINMATCH;
+	if (matchlen >= 15) {
+		*token |= 15;
+		op = write_length(op, matchlen - 15);
+	} else {
+		*token |= (uint8_t)matchlen;
+	}
+	return op;
+}
+
+// return compressed size, 0 if dst is not large enough
+int
+lz_compress(const uint8_t *src, int sz, uint8_t *dst, int cap) {
+	const uint8_t *op_end = dst + cap;
+	uint8_t *op = dst;
+	int anchor = 0;
+	if (sz > MFLIMIT) {
+		int table[1 << HASH_LOG];	// position + 1 , 0 is empty
+		memset(table, 0, sizeof(table));
+		int limit = sz - MFLIMIT;
+		int matchlimit = sz - LASTLITERALS;
+		int ip = 0;
+		while (ip < limit) {
+			uint32_t seq = read32(src + ip);
+			uint32_t h = hash32(seq);
+			int ref = table[h] - 1;
+			table[h] = ip + 1;
+			if (ref < 0 || ip - ref > MAX_DISTANCE || read32(src + ref) != seq) {
+				ip += 1 + ((ip - anchor) >> SKIP_SHIFT);
+				continue;
+			}
+			// extend backward
+			while (ip > anchor && ref > 0 && src[ip-1] == src[ref-1]) {
+				--ip;
+				--ref;
+			}
+			int len = MINMATCH;
+			while (ip + len < matchlimit && src[ip+len] == src[ref+len]) {
+				++len;
+			}
+			op = write_sequence(op, op_end, src + anchor, ip - anchor, ip - ref, len);
+			if (op == NULL)
+				return 0;
+			ip += len;
+			anchor = ip;
+			if (ip - 2 < limit) {
+				table[hash32(read32(src + ip - 2))] = ip - 2 + 1;
+			}
+		}
+	}
+	op = write_sequence(op, op_end, src + anchor, sz - anchor, 0, 0);
+	if (op == NULL)
+		return 0;
+	return (int)(op - dst);
+}
+
+// the length can't be larger than limit, stop before it overflows
+static inline int
+read_length(const uint8_t *src, int sz, int *ip, int *len, int limit) {
+	uint8_t b;
+	do {
+		if (*ip >= sz)
+			return -1;
+		b = src[(*ip)++];
+		*len += b;
+		if (*len > limit)
+			return -1;
+	} while (b == 255);
+	return 0;
+}
+
+// return dsz, -1 if the data is invalid
+int
+lz_decompress(const uint8_t *src, int sz, uint8_t *dst, int dsz) {
+	int ip = 0;
+	int op = 0;
+	while (ip < sz) {
+		uint8_t token = src[ip++];
+		int litlen = token >> 4;
+		if (litlen == 15 && read_length(src, sz, &ip, &litlen, dsz - op))
+			return -1;
+		if (litlen > sz - ip || litlen > dsz - op)
+			return -1;
+		memcpy(dst + op, src + ip, litlen);
+		ip += litlen;
+		op += litlen;
+		if (ip == sz)
+			break;	// the last literals
+		if (sz - ip < 2)
+			return -1;
+		int offset = src[ip] | src[ip+1] << 8;
+		ip += 2;
+		if (offset == 0 || offset > op)
+			return -1;
+		int matchlen = token & 15;
+		if (matchlen == 15 && read_length(src, sz, &ip, &matchlen, dsz - op - MINMATCH))
+			return -1;
+		matchlen += MINMATCH;
+		if (matchlen > dsz - op)
+			return -1;
+		uint8_t *d = dst + op;
+		const uint8_t *m = d - offset;
+		if (offset >= matchlen) {
+			memcpy(d, m, matchlen);
+		} else {
+			// overlapped copy
+			int i;
+			for (i=0;i<matchlen;i++) {
+				d[i] = m[i];
+			}
+		}
+		op += matchlen;
+	}
+	return op == dsz ? op : -1;
+}
@@ -1,11 +1,49 @@
 local skynet = require "skynet"
+local core = require "cluster.core"
 
 local clusterd
+local gateway	-- the native cluster service, if cluster_native = true
+local node_id = {}	-- node name -> node id in gateway
 local cluster = {}
 
+local function gateway_node(node)
+	local id = node_id[node]
+	if not id then
+		id = skynet.call(clusterd, "lua", "node", node)
+		node_id[node] = id
+	end
+	return id
+end
+
+-- msg/sz (skynet.pack) is freed, return the packed response msg, sz
+function cluster.rawcall(node, address, msg, sz)
+	if gateway then
+		-- msg is not owned by packnative before the node id is resolved (it raises error for an unknown node)
+		local ok, id = pcall(gateway_node, node)
+		if not ok then
+			skynet.trash(msg, sz)
+			error(id, 0)
+		end
+		return skynet.rawcall(gateway, "lua", core.packnative(address, id, msg, sz))
+	end
+	return skynet.rawcall(clusterd, "lua", skynet.pack("req", node, address, msg, sz))
+end
+
 function cluster.call(node, address, ...)
-	-- skynet.pack(...) will free by cluster.core.packrequest
-	return skynet.call(clusterd, "lua", "req", node, address, skynet.pack(...))
+	-- skynet.pack(...) will free by cluster.core.packrequest (or packnative)
+	return skynet.unpack(cluster.rawcall(node, address, skynet.pack(...)))
+end
+
+-- one-way message, no session and no response on the link
+function cluster.send(node, address, ...)
+	-- skynet.pack(...) will free by cluster.core.packpush (or packnative)
+	if gateway then
+		local id = gateway_node(node)
+		local msg, sz = skynet.pack(...)
+		skynet.rawsend(gateway, "lua", core.packnative(address, id, msg, sz, true))
+	else
+		skynet.send(clusterd, "lua", "push", node, address, skynet.pack(...))
+	end
 end
 
 function cluster.open(port)
@@ -40,11 +78,14 @@ function cluster.register(name, addr)
 end
 
 function cluster.query(node, name)
-	return skynet.call(clusterd, "lua", "req", node, 0, skynet.pack(name))
+	return skynet.unpack(cluster.rawcall(node, 0, skynet.pack(name)))
 end
 
 skynet.init(function()
 	clusterd = skynet.uniqueservice("clusterd")
+	if skynet.getenv "cluster_native" == "true" then
+		gateway = skynet.call(clusterd, "lua", "gateway")
+	end
 end)
 
 return cluster
@@ -159,14 +159,21 @@ function mongo.client( conf	)
 	}
 
 	obj.__id = 0
-	obj.__sock = socketchannel.channel {
+	local desc = {
 		host = obj.host,
 		port = obj.port,
 		response = dispatch_reply,
 		auth = mongo_auth(obj),
 		backup = backup,
 		nodelay = true,
+		pool = conf.pool,
 	}
+	-- conf.pool : the number of connections, the requests go to the least busy one (see socketchannel.pool)
+	if conf.pool and conf.pool > 1 then
+		obj.__sock = socketchannel.pool(desc)
+	else
+		obj.__sock = socketchannel.channel(desc)
+	end
 	setmetatable(obj, client_meta)
 	obj.__sock:connect(true)	-- try connect only	once
 	return obj
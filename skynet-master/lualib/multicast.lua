@@ -12,6 +12,9 @@ local chan_meta = {
 		self:unsubscribe()
 	end,
 	__tostring = function (self)
+		if self.topic then
+			return string.format("[Multicast:%s]",self.topic)
+		end
 		return string.format("[Multicast:%x]",self.channel)
 	end,
 }
@@ -24,12 +27,16 @@ local function default_conf(conf)
 	return conf
 end
 
+-- conf.topic : a named topic of local node (such as "zone.1.guild.5") instead of a channel,
+-- subscribe may use a pattern ("zone.1.*" for one level, "zone.#" for all the levels below zone).
+-- The topic is the first value after source in dispatch : dispatch(self, source, topic, ...)
 function multicast.new(conf)
 	assert(multicastd, "Init first")
 	local self = {}
 	conf = conf or self
 	self.channel = conf.channel
-	if self.channel == nil then
+	self.topic = conf.topic
+	if self.channel == nil and self.topic == nil then
 		self.channel = skynet.call(multicastd, "lua", "NEW")
 	end
 	self.__pack = conf.pack or skynet.pack
@@ -40,6 +47,7 @@ function multicast.new(conf)
 end
 
 function chan:delete()
+	assert(not self.topic, "Can't delete a topic")
 	local c = assert(self.channel)
 	skynet.send(multicastd, "lua", "DEL", c)
 	self.channel = nil
@@ -47,17 +55,28 @@ function chan:delete()
 end
 
 function chan:publish(...)
+	if self.topic then
+		skynet.call(multicastd, "lua", "PUBT", self.topic, mc.pack(self.__pack(self.topic, ...)))
+		return
+	end
 	local c = assert(self.channel)
 	skynet.call(multicastd, "lua", "PUB", c, mc.pack(self.__pack(...)))
 end
 
 function chan:subscribe()
-	local c = assert(self.channel)
 	if self.__subscribe then
 		-- already subscribe
 		return
 	end
-	skynet.call(multicastd, "lua", "SUB", c)
+	local c
+	if self.topic then
+		-- the channel of topic is the subscription id
+		c = skynet.call(multicastd, "lua", "SUBT", self.topic, self.channel)
+		self.channel = c
+	else
+		c = assert(self.channel)
+		skynet.call(multicastd, "lua", "SUB", c)
+	end
 	self.__subscribe = true
 	dispatch[c] = self
 end
@@ -68,7 +87,7 @@ function chan:unsubscribe()
 		return
 	end
 	local c = assert(self.channel)
-	skynet.send(multicastd, "lua", "USUB", c)
+	skynet.send(multicastd, "lua", self.topic and "USUBT" or "USUB", c)
 	self.__subscribe = nil
 end
 
@@ -118,10 +118,11 @@ local function _compute_token(password, scramble)
 		end)
 end
 
+-- the packet is a table of strings, socket.write sends it without concatenating in lua
 local function _compose_packet(self, req, size)
    self.packet_no = self.packet_no + 1
 
-    local packet = _set_byte3(size) .. strchar(self.packet_no) .. req
+    local packet = { _set_byte3(size) .. strchar(self.packet_no), req }
     return packet
 end
 
@@ -489,10 +490,11 @@ local function _compose_query(self, query)
 
     self.packet_no = -1
 
-    local cmd_packet = strchar(COM_QUERY) .. query
     local packet_len = 1 + #query
 
-    local querypacket = _compose_packet(self, cmd_packet, packet_len)
+    local querypacket = _compose_packet(self, query, packet_len)
+    -- COM_QUERY goes after the header, query is not copied into a new string
+    querypacket[1] = querypacket[1] .. strchar(COM_QUERY)
     return querypacket
 end
 
@@ -636,11 +638,22 @@ function _M.connect(opts)
     local user = opts.user or ""
     local password = opts.password or ""
 
-    local channel = socketchannel.channel {
+    -- opts.pool : the number of connections, the queries go to the least busy one (see socketchannel.pool).
+    -- Each query may use a different connection, so the queries depend on the connection state
+    -- (BEGIN ... COMMIT, SET, USE, LAST_INSERT_ID() ...) must be in db:transaction(f).
+    -- The transaction control statements out of db:transaction raise an error, see _M.query
+    local desc = {
         host = opts.host,
         port = opts.port or 3306,
         auth = _mysql_login(self,user,password,database,opts.on_connect),
+        pool = opts.pool,
     }
+    local channel
+    if opts.pool and opts.pool > 1 then
+        channel = socketchannel.pool(desc)
+    else
+        channel = socketchannel.channel(desc)
+    end
     self.sockchannel = channel
     -- try connect first only once
     channel:connect(true)
@@ -657,15 +670,56 @@ function _M.disconnect(self)
 end
 
 
+-- the statements control the transaction of the connection
+local transaction_control = {
+    "^%s*BEGIN%f[%W]",
+    "^%s*START%s+TRANSACTION%f[%W]",
+    "^%s*COMMIT%f[%W]",
+    "^%s*ROLLBACK%f[%W]",
+    "^%s*SAVEPOINT%f[%W]",
+    "^%s*SET%s+AUTOCOMMIT%f[%W]",
+}
+
+local function check_transaction(sockchannel, query)
+    if sockchannel.bound == nil or sockchannel:bound() then
+        return
+    end
+    local head = string.upper(string.sub(query, 1, 32))
+    for _, pattern in ipairs(transaction_control) do
+        if string.find(head, pattern) then
+            error("Use db:transaction(f) for the transaction in pool mode : " .. query, 2)
+        end
+    end
+end
+
 function _M.query(self, query)
-    local querypacket = _compose_query(self, query)
     local sockchannel = self.sockchannel
+    check_transaction(sockchannel, query)
+    local querypacket = _compose_query(self, query)
     if not self.query_resp then
         self.query_resp = _query_resp(self)
     end
     return  sockchannel:request( querypacket, self.query_resp )
 end
 
+-- call f(self, ...) with one connection of the pool, the queries of a transaction (BEGIN ... COMMIT) must be in f.
+-- The connection is reset (reconnect, the transaction is rolled back) if f raises an error.
+function _M.transaction(self, f, ...)
+    local sockchannel = self.sockchannel
+    if not sockchannel.bind then
+        return f(self, ...)
+    end
+    local bound = sockchannel:bind()
+    local r = table.pack(pcall(f, self, ...))
+    if bound then
+        sockchannel:unbind(not r[1])
+    end
+    if not r[1] then
+        error(r[2], 0)
+    end
+    return table.unpack(r, 2, r.n)
+end
+
 function _M.server_ver(self)
     return self._server_ver
 end
@@ -137,13 +137,22 @@ local function redis_login(auth, db)
 	end
 end
 
+-- db_conf.pool : the number of connections, the requests go to the least busy one (see socketchannel.pool)
 function redis.connect(db_conf)
-	local channel = socketchannel.channel {
+	local desc = {
 		host = db_conf.host,
 		port = db_conf.port or 6379,
 		auth = redis_login(db_conf.auth, db_conf.db),
 		nodelay = true,
+		cork = db_conf.cork,
+		pool = db_conf.pool,
 	}
+	local channel
+	if db_conf.pool and db_conf.pool > 1 then
+		channel = socketchannel.pool(desc)
+	else
+		channel = socketchannel.channel(desc)
+	end
 	-- try connect first only once
 	channel:connect(true)
 	return setmetatable( { channel }, meta )
@@ -162,6 +171,87 @@ setmetatable(command, { __index = function(t,k)
 	return f
 end})
 
+-- the commands of a transaction (WATCH/MULTI ... EXEC/DISCARD, or WATCH ... UNWATCH) must use the same connection of the pool
+local transaction_state = setmetatable({}, { __mode = "k" })	-- coroutine -> "WATCH" or "MULTI" (bound to a connection of pool)
+local transaction_bound = setmetatable({}, { __mode = "k" })	-- coroutine -> true, in command:transaction (keep the binding after EXEC)
+
+local function begin_command(cmd)
+	return function(self, v, ...)
+		local c = self[1]
+		if not c.bind then
+			return c:request(compose_message(cmd, type(v) == "table" and v or {v, ...}), read_response)
+		end
+		local bound = c:bind()
+		local msg = compose_message(cmd, type(v) == "table" and v or {v, ...})
+		local ok, result = pcall(c.request, c, msg, read_response)
+		if not ok then
+			if bound then
+				c:unbind()
+			end
+			error(result, 0)
+		end
+		local co = coroutine.running()
+		if transaction_state[co] ~= "MULTI" then
+			transaction_state[co] = cmd
+		end
+		return result
+	end
+end
+
+local function end_command(cmd)
+	return function(self, v, ...)
+		local c = self[1]
+		local msg = compose_message(cmd, type(v) == "table" and v or {v, ...})
+		if not c.unbind then
+			return c:request(msg, read_response)
+		end
+		local co = coroutine.running()
+		if cmd == "UNWATCH" and transaction_state[co] == "MULTI" then
+			-- queued in MULTI
+			return c:request(msg, read_response)
+		end
+		local ok, result = pcall(c.request, c, msg, read_response)
+		transaction_state[co] = nil
+		if not transaction_bound[co] then
+			c:unbind()
+		end
+		if not ok then
+			error(result, 0)
+		end
+		return result
+	end
+end
+
+command.watch = begin_command("WATCH")
+command.multi = begin_command("MULTI")
+command.exec = end_command("EXEC")
+command.discard = end_command("DISCARD")
+command.unwatch = end_command("UNWATCH")
+
+-- call f(self, ...) with one connection of the pool, and release the connection after f returns.
+-- The connection is reset (reconnect) if f raises an error, or leaves WATCH/MULTI without EXEC/DISCARD/UNWATCH.
+function command:transaction(f, ...)
+	local c = self[1]
+	if not c.bind then
+		return f(self, ...)
+	end
+	local co = coroutine.running()
+	local bound = c:bind()
+	if bound then
+		transaction_bound[co] = true
+	end
+	local r = table.pack(pcall(f, self, ...))
+	if bound then
+		transaction_bound[co] = nil
+		c:unbind(not r[1] or transaction_state[co] ~= nil)
+		transaction_state[co] = nil
+	end
+	if not r[1] then
+		error(r[2], 0)
+	end
+	return table.unpack(r, 2, r.n)
+end
+
 local function read_boolean(so)
 	local ok, result = read_response(so)
 	return ok, result ~= 0
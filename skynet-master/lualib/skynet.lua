@@ -355,6 +355,12 @@ function skynet.send(addr, typename, ...)
 	return c.send(addr, p.id, 0 , p.pack(...))
 end
 
+-- msg/sz is packed already, as skynet.rawcall
+function skynet.rawsend(addr, typename, msg, sz)
+	local p = proto[typename]
+	return c.send(addr, p.id, 0 , msg, sz)
+end
+
 skynet.genid = assert(c.genid)
 
 skynet.redirect = function(dest,source,typename,...)
@@ -10,6 +10,9 @@ local maxclient	-- max client
 local client_number = 0
 local CMD = setmetatable({}, { __gc = function() netpack.clear(queue) end })
 local nodelay = false
+local header = 2	-- size of package header, 2 or 4
+local maxpackage	-- max size of package, default by netpack.filter
+local INVALID_SIZE = "Invalid package size"	-- the error of netpack.filter, see package_error in lua-netpack.c
 
 local connection = {}
 
@@ -37,8 +40,21 @@ function gateserver.start(handler)
 		local port = assert(conf.port)
 		maxclient = conf.maxclient or 1024
 		nodelay = conf.nodelay
+		-- conf.header = 4 for the packages larger than 64K
+		header = conf.header or 2
+		maxpackage = conf.maxpackage
 		skynet.error(string.format("Listen on %s:%d", address, port))
-		socket = socketdriver.listen(address, port)
+		-- conf.reuseport : start several gates on the same port, each gets a part of the connections
+		socket = socketdriver.listen(address, port, nil, conf.reuseport)
+		local watermark = conf.watermark
+		if watermark then
+			-- inherited by the accepted connections
+			socketdriver.watermark(socket, watermark.high, watermark.low, watermark.policy)
+		end
+		if conf.frame ~= false then
+			-- split packages in the socket thread, netpack gets complete packages only
+			socketdriver.frame(socket, header, maxpackage)
+		end
 		socketdriver.start(socket)
 		if handler.open then
 			return handler.open(source, conf)
@@ -62,20 +78,28 @@ function gateserver.start(handler)
 
 	MSG.data = dispatch_msg
 
-	local function dispatch_queue()
-		local fd, msg, sz = netpack.pop(queue)
-		if fd then
+	-- batch is { index = next package, n = 3 * packages, fd1, msg1, sz1, fd2, ... }
+	local function dispatch_batch(batch)
+		local i = batch.index
+		if i <= batch.n then
 			-- may dispatch even the handler.message blocked
-			-- If the handler.message never block, the queue should be empty, so only fork once and then exit.
-			skynet.fork(dispatch_queue)
-			dispatch_msg(fd, msg, sz)
-
-			for fd, msg, sz in netpack.pop, queue do
-				dispatch_msg(fd, msg, sz)
-			end
+			-- If the handler.message never block, the batch is done before the fork runs, so only fork once and then exit.
+			skynet.fork(dispatch_batch, batch)
+			repeat
+				batch.index = i + 3
+				dispatch_msg(batch[i], batch[i+1], batch[i+2])
+				i = batch.index
+			until i > batch.n
 		end
 	end
 
+	-- take all the packages of the read by one netpack.popall
+	local function dispatch_queue()
+		local batch = { index = 1 }
+		batch.n = netpack.popall(queue, batch) * 3
+		dispatch_batch(batch)
+	end
+
 	MSG.more = dispatch_queue
 
 	function MSG.open(fd, msg)
@@ -101,6 +125,10 @@ function gateserver.start(handler)
 
 	function MSG.close(fd)
 		if fd ~= socket then
+			if connection[fd] == nil then
+				-- closed by MSG.error already
+				return
+			end
 			if handler.disconnect then
 				handler.disconnect(fd)
 			end
@@ -115,10 +143,17 @@ function gateserver.start(handler)
 			socketdriver.close(fd)
 			skynet.error(msg)
 		else
+			-- dispatch the packages before the invalid one (netpack.filter), if any
+			dispatch_queue()
 			if handler.error then
 				handler.error(fd, msg)
 			end
 			close_fd(fd)
+			if msg == INVALID_SIZE then
+				-- netpack reports an invalid package size, the socket is still open
+				-- (the socket thread has closed the socket for the other errors)
+				socketdriver.close(fd)
+			end
 		end
 	end
 
@@ -128,11 +163,17 @@ function gateserver.start(handler)
 		end
 	end
 
+	function MSG.drain(fd, size)
+		if handler.drain then
+			handler.drain(fd, size)
+		end
+	end
+
 	skynet.register_protocol {
 		name = "socket",
 		id = skynet.PTYPE_SOCKET,	-- PTYPE_SOCKET = 6
 		unpack = function ( msg, sz )
-			return netpack.filter( queue, msg, sz)
+			return netpack.filter( queue, msg, sz, header, maxpackage)
 		end,
 		dispatch = function (_, _, q, type, ...)
 			queue = q
@@ -41,6 +41,8 @@ Protocol:
 		byte ok (1 is ok, 0 is error)
 		dword session
 
+	The size is a dword instead of word if the gate is opened with header = 4 (see gateserver)
+
 API:
 	server.userid(username)
 		return uid, subid, server
@@ -125,6 +127,8 @@ end
 
 function server.start(conf)
 	local expired_number = conf.expired_number or 128
+	local header = 2
+	local response_format = ">s2"
 
 	local handler = {}
 
@@ -141,6 +145,10 @@ function server.start(conf)
 
 	function handler.open(source, gateconf)
 		local servername = assert(gateconf.servername)
+		if gateconf.header == 4 then
+			header = 4
+			response_format = ">s4"
+		end
 		return conf.register_handler(servername)
 	end
 
@@ -203,7 +211,7 @@ function server.start(conf)
 			result = "200 OK"
 		end
 
-		socketdriver.send(fd, netpack.pack(result))
+		socketdriver.send(fd, netpack.pack(result, header))
 
 		if close then
 			gateserver.closeclient(fd)
@@ -266,7 +274,7 @@ function server.start(conf)
 				result = result .. string.pack(">BI4", 1, session)
 			end
 
-			p[2] = string.pack(">s2",result)
+			p[2] = string.pack(response_format,result)
 			p[3] = u.version
 			p[4] = u.index
 		else
@@ -4,13 +4,12 @@ local skynet_core = require "skynet.core"
 local assert = assert
 
 local socket = {}	-- api
-local buffer_pool = {}	-- store all message buffer object
 local socket_pool = setmetatable( -- store all socket object
 	{},
 	{ __gc = function(p)
 		for id,v in pairs(p) do
 			driver.close(id)
-			-- don't need clear v.buffer, because buffer pool will be free at the end
+			-- don't need clear v.buffer, it is freed by its __gc
 			p[id] = nil
 		end
 	end
@@ -27,6 +26,16 @@ local function wakeup(s)
 	end
 end
 
+local function wakeup_drain(s)
+	local q = s.drain_queue
+	if q then
+		s.drain_queue = nil
+		for _, co in ipairs(q) do
+			skynet.wakeup(co)
+		end
+	end
+end
+
 local function suspend(s)
 	assert(not s.co)
 	s.co = coroutine.running()
@@ -48,7 +57,7 @@ socket_message[1] = function(id, size, data)
 		return
 	end
 
-	local sz = driver.push(s.buffer, buffer_pool, data, size)
+	local sz = driver.push(s.buffer, data, size)
 	local rr = s.read_required
 	local rrt = type(rr)
 	if rrt == "number" then
@@ -60,13 +69,13 @@ socket_message[1] = function(id, size, data)
 	else
 		if s.buffer_limit and sz > s.buffer_limit then
 			skynet.error(string.format("socket buffer overflow: fd=%d size=%d", id , sz))
-			driver.clear(s.buffer,buffer_pool)
+			driver.clear(s.buffer)
 			driver.close(id)
 			return
 		end
 		if rrt == "string" then
 			-- read line
-			if driver.readline(s.buffer,nil,rr) then
+			if driver.readline(s.buffer, rr, true) then
 				s.read_required = nil
 				wakeup(s)
 			end
@@ -93,6 +102,7 @@ socket_message[3] = function(id)
 	end
 	s.connected = false
 	wakeup(s)
+	wakeup_drain(s)
 end
 
 -- SKYNET_SOCKET_TYPE_ACCEPT = 4
@@ -121,6 +131,7 @@ socket_message[5] = function(id, _, err)
 	driver.shutdown(id)
 
 	wakeup(s)
+	wakeup_drain(s)
 end
 
 -- SKYNET_SOCKET_TYPE_UDP = 6
@@ -150,11 +161,27 @@ end
 socket_message[7] = function(id, size)
 	local s = socket_pool[id]
 	if s then
+		if s.watermark then
+			-- reach high watermark, socket.drain will block until SKYNET_SOCKET_TYPE_DRAIN
+			s.overflow = true
+		end
 		local warning = s.warning or default_warning
 		warning(id, size)
 	end
 end
 
+-- SKYNET_SOCKET_TYPE_DRAIN
+socket_message[8] = function(id, size)
+	local s = socket_pool[id]
+	if s then
+		s.overflow = nil
+		wakeup_drain(s)
+	end
+end
+
+-- SKYNET_SOCKET_TYPE_FRAME, complete packets with the size header, the same as data
+socket_message[9] = socket_message[1]
+
 skynet.register_protocol {
 	name = "socket",
 	id = skynet.PTYPE_SOCKET,	-- PTYPE_SOCKET = 6
@@ -215,7 +242,7 @@ local function close_fd(id, func)
 	local s = socket_pool[id]
 	if s then
 		if s.buffer then
-			driver.clear(s.buffer,buffer_pool)
+			driver.clear(s.buffer)
 		end
 		if s.connected then
 			func(id)
@@ -262,7 +289,7 @@ function socket.read(id, sz)
 	assert(s)
 	if sz == nil then
 		-- read some bytes
-		local ret = driver.readall(s.buffer, buffer_pool)
+		local ret = driver.readall(s.buffer)
 		if ret ~= "" then
 			return ret
 		end
@@ -273,7 +300,7 @@ function socket.read(id, sz)
 		assert(not s.read_required)
 		s.read_required = 0
 		suspend(s)
-		ret = driver.readall(s.buffer, buffer_pool)
+		ret = driver.readall(s.buffer)
 		if ret ~= "" then
 			return ret
 		else
@@ -281,22 +308,22 @@ function socket.read(id, sz)
 		end
 	end
 
-	local ret = driver.pop(s.buffer, buffer_pool, sz)
+	local ret = driver.pop(s.buffer, sz)
 	if ret then
 		return ret
 	end
 	if not s.connected then
-		return false, driver.readall(s.buffer, buffer_pool)
+		return false, driver.readall(s.buffer)
 	end
 
 	assert(not s.read_required)
 	s.read_required = sz
 	suspend(s)
-	ret = driver.pop(s.buffer, buffer_pool, sz)
+	ret = driver.pop(s.buffer, sz)
 	if ret then
 		return ret
 	else
-		return false, driver.readall(s.buffer, buffer_pool)
+		return false, driver.readall(s.buffer)
 	end
 end
 
@@ -304,34 +331,34 @@ function socket.readall(id)
 	local s = socket_pool[id]
 	assert(s)
 	if not s.connected then
-		local r = driver.readall(s.buffer, buffer_pool)
+		local r = driver.readall(s.buffer)
 		return r ~= "" and r
 	end
 	assert(not s.read_required)
 	s.read_required = true
 	suspend(s)
 	assert(s.connected == false)
-	return driver.readall(s.buffer, buffer_pool)
+	return driver.readall(s.buffer)
 end
 
 function socket.readline(id, sep)
 	sep = sep or "\n"
 	local s = socket_pool[id]
 	assert(s)
-	local ret = driver.readline(s.buffer, buffer_pool, sep)
+	local ret = driver.readline(s.buffer, sep)
 	if ret then
 		return ret
 	end
 	if not s.connected then
-		return false, driver.readall(s.buffer, buffer_pool)
+		return false, driver.readall(s.buffer)
 	end
 	assert(not s.read_required)
 	s.read_required = sep
 	suspend(s)
 	if s.connected then
-		return driver.readline(s.buffer, buffer_pool, sep)
+		return driver.readline(s.buffer, sep)
 	else
-		return false, driver.readall(s.buffer, buffer_pool)
+		return false, driver.readall(s.buffer)
 	end
 end
 
@@ -348,18 +375,23 @@ end
 
 socket.write = assert(driver.send)
 socket.lwrite = assert(driver.lsend)
+-- socket.sendfile(id, path, offset, len) : send a range of file without copying it into lua
+socket.sendfile = assert(driver.sendfile)
+-- socket.write_multi({ id1, id2, ... }, msg) : send msg to many sockets, they share one buffer
+socket.write_multi = assert(driver.send_multi)
 socket.header = assert(driver.header)
 
 function socket.invalid(id)
 	return socket_pool[id] == nil
 end
 
-function socket.listen(host, port, backlog)
+-- reuseport : several services can listen the same address, the kernel spreads the connections
+function socket.listen(host, port, backlog, reuseport)
 	if port == nil then
 		host, port = string.match(host, "([^:]+):(.+)$")
 		port = tonumber(port)
 	end
-	return driver.listen(host, port, backlog)
+	return driver.listen(host, port, backlog, reuseport)
 end
 
 function socket.lock(id)
@@ -395,7 +427,7 @@ end
 function socket.abandon(id)
 	local s = socket_pool[id]
 	if s and s.buffer then
-		driver.clear(s.buffer,buffer_pool)
+		driver.clear(s.buffer)
 	end
 	socket_pool[id] = nil
 end
@@ -405,6 +437,39 @@ function socket.limit(id, limit)
 	s.buffer_limit = limit
 end
 
+-- policy : "pause" (stop reading id), "drop" (drop socket.lwrite data) or "close"
+-- high == 0 turns off the watermarks, low is high/2 by default
+function socket.watermark(id, high, low, policy)
+	local s = assert(socket_pool[id])
+	driver.watermark(id, high, low, policy)
+	s.watermark = high > 0 or nil
+end
+
+-- block until the write buffer falls to the low watermark, return false if the socket is closed
+function socket.drain(id)
+	local s = socket_pool[id]
+	if not s or not s.connected then
+		return false
+	end
+	if s.overflow then
+		local co = coroutine.running()
+		local q = s.drain_queue
+		if q then
+			table.insert(q, co)
+		else
+			s.drain_queue = { co }
+		end
+		skynet.wait(co)
+	end
+	return s.connected
+end
+
+-- split the stream into packets with a big-endian size header in the socket thread,
+-- so a read always ends at a packet boundary. header is 2 (default) or 4, 0 turns it off
+function socket.frame(id, header, max)
+	driver.frame(id, header, max)
+end
+
 ---------------------- UDP
 
 local function create_udp_object(id, cb)
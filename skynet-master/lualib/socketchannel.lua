@@ -3,7 +3,9 @@ local socket = require "socket"
 local socketdriver = require "socketdriver"
 
 -- channel support auto reconnect , and capture socket error in request/response transaction
--- { host = "", port = , auth = function(so) , response = function(so) session, data }
+-- { host = "", port = , auth = function(so) , response = function(so) session, data , cork = boolean }
+-- cork : the requests in one dispatch (before the coroutines yield) are sent in one socket write
+-- socket_channel.pool(desc) : desc.pool channels with the same desc, see pool:request
 
 local socket_channel = {}
 local channel = {}
@@ -39,6 +41,9 @@ function socket_channel.channel(desc)
 		__closed = false,
 		__authcoroutine = false,
 		__nodelay = desc.nodelay,
+		__cork = desc.cork,
+		__cork_queue = false,	-- the requests not sent in cork mode, see cork_request
+		__partial = 0,	-- the multi part responses receiving (session mode), see pick_channel
 	}
 
 	return setmetatable(c, channel_meta)
@@ -55,6 +60,7 @@ end
 
 local function wakeup_all(self, errmsg)
 	if self.__response then
+		self.__partial = 0
 		for k,co in pairs(self.__thread) do
 			self.__thread[k] = nil
 			self.__result[co] = socket_error
@@ -98,10 +104,17 @@ local function dispatch_by_session(self)
 			if co then
 				if padding and result_ok then
 					-- If padding is true, append result_data to a table (self.__result_data[co])
-					local result = self.__result_data[co] or {}
-					self.__result_data[co] = result
+					local result = self.__result_data[co]
+					if not result then
+						result = {}
+						self.__result_data[co] = result
+						self.__partial = self.__partial + 1
+					end
 					table.insert(result, result_data)
 				else
+					if self.__result_data[co] then
+						self.__partial = self.__partial - 1
+					end
 					self.__thread[session] = nil
 					self.__result[co] = result_ok
 					if result_ok and self.__result_data[co] then
@@ -376,10 +389,65 @@ end
 local socket_write = socket.write
 local socket_lwrite = socket.lwrite
 
+-- flush the corked requests when there are so many
+local CORK_LIMIT = 1024
+
+local function flush_cork(self, q)
+	if self.__cork_queue ~= q then
+		-- flushed already
+		return
+	end
+	self.__cork_queue = false
+	local buffer = {}
+	for i = 1, q.n do
+		local req = q[i]
+		if type(req) == "table" then
+			-- a table of strings (and messages), see socket.write
+			table.move(req, 1, #req, #buffer + 1, buffer)
+		else
+			buffer[#buffer + 1] = req
+		end
+	end
+	if not socket_write(q.fd, buffer) then
+		-- the requests waiting for response get socket_error
+		local so = self.__sock
+		if so and so[1] == q.fd then
+			close_channel_socket(self)
+			wakeup_all(self)
+		end
+	end
+end
+
+-- queue the request, the queue is sent after the current coroutine (and the others in this dispatch) yields
+local function cork_request(self, fd, request)
+	local q = self.__cork_queue
+	if q and q.fd ~= fd then
+		-- reconnected
+		flush_cork(self, q)
+		q = nil
+	end
+	if not q then
+		q = { fd = fd, n = 0 }
+		self.__cork_queue = q
+		skynet.fork(flush_cork, self, q)
+	end
+	local n = q.n + 1
+	q[n] = request
+	q.n = n
+	if n >= CORK_LIMIT then
+		flush_cork(self, q)
+	end
+end
+
 function channel:request(request, response, padding)
 	assert(block_connect(self, true))	-- connect once
 	local fd = self.__sock[1]
 
+	if padding and self.__cork_queue then
+		-- keep the order of requests
+		flush_cork(self, self.__cork_queue)
+	end
+
 	if padding then
 		-- padding may be a table, to support multi part request
 		-- multi part request use low priority socket write
@@ -388,6 +456,9 @@ function channel:request(request, response, padding)
 		for _,v in ipairs(padding) do
 			socket_lwrite(fd, v)
 		end
+	elseif self.__cork then
+		-- the response (order mode) is pushed before the request is sent, in the same order
+		cork_request(self, fd, request)
 	else
 		if not socket_write(fd , request) then
 			close_channel_socket(self)
@@ -438,6 +509,207 @@ end
 
 channel_meta.__gc = channel.close
 
+-- pool of channels, a request goes to the channel with the least outstanding requests.
+-- The connected channels are preferred, a broken one reconnects (with backup) by itself.
+-- The channels sending a multi part request or receiving a multi part response are avoided,
+-- so the small requests are not blocked behind the large ones.
+local pool = {}
+local pool_meta = { __index = pool }
+
+local POOL_BROKEN = 0x10000	-- outstanding penalty of the channel not connected
+local POOL_LARGE = 0x100	-- outstanding penalty of each multi part request/response in progress
+
+function socket_channel.pool(desc)
+	local size = assert(desc.pool)
+	local p = {
+		__channel = {},
+		__outstanding = {},
+		__large = {},	-- channel index -> multi part requests outstanding
+		__owner = {},	-- channel index -> coroutine, see pool:bind
+		__bind = {},	-- coroutine -> channel index
+		__wait = {},	-- coroutines waiting for a channel not bound
+		__next = 1,
+	}
+	for i = 1, size do
+		p.__channel[i] = socket_channel.channel(desc)
+		p.__outstanding[i] = 0
+		p.__large[i] = 0
+	end
+	return setmetatable(p, pool_meta)
+end
+
+local function release(self, co, reset)
+	local index = self.__bind[co]
+	-- the channel is still owned (not picked by the others) until reconnected
+	self.__bind[co] = nil
+	local c = self.__channel[index]
+	if reset and not c.__closed then
+		-- the connection may be in a transaction, reconnect it before the other coroutines use it
+		c:close()
+		local ok, err = pcall(c.connect, c, true)
+		if not ok then
+			skynet.error("socket: reset channel failed", err)
+		end
+	end
+	self.__owner[index] = nil
+	local wait = self.__wait
+	for i = 1, #wait do
+		skynet.wakeup(wait[i])
+		wait[i] = nil
+	end
+end
+
+-- release the channels bound by the dead coroutines (raised an error before unbind)
+local function release_dead(self)
+	local dead = {}
+	for co in pairs(self.__bind) do
+		if coroutine.status(co) == "dead" then
+			table.insert(dead, co)
+		end
+	end
+	for _, co in ipairs(dead) do
+		-- released by the other coroutine when yield
+		if self.__bind[co] then
+			release(self, co, true)
+		end
+	end
+	return #dead > 0
+end
+
+local function pick_channel(self)
+	local co = coroutine.running()
+	local index = self.__bind[co]
+	if index then
+		return index
+	end
+	local channels = self.__channel
+	local n = #channels
+	while true do
+		local min
+		for k = 0, n - 1 do
+			local i = (self.__next + k - 1) % n + 1
+			local c = channels[i]
+			if c.__authcoroutine == co then
+				-- the request in auth function must use the channel authenticating
+				return i
+			end
+			if not self.__owner[i] then
+				local load = self.__outstanding[i] + (self.__large[i] + c.__partial) * POOL_LARGE
+				if not c.__sock then
+					load = load + POOL_BROKEN
+				end
+				if min == nil or load < min then
+					index, min = i, load
+				end
+			end
+		end
+		if index then
+			-- round robin among the channels with the same load
+			self.__next = index % n + 1
+			return index
+		end
+		-- all the channels are bound
+		if not release_dead(self) then
+			table.insert(self.__wait, co)
+			skynet.wait(co)
+		end
+	end
+end
+
+function pool:connect(once)
+	local ok, err
+	for _, c in ipairs(self.__channel) do
+		local succ, r = pcall(c.connect, c, once)
+		if succ then
+			ok = true
+		else
+			err = r
+		end
+	end
+	if not ok then
+		error(err, 0)
+	end
+	return true
+end
+
+function pool:request(request, response, padding)
+	local i = pick_channel(self)
+	local c = self.__channel[i]
+	local outstanding = self.__outstanding
+	local large = padding and self.__large
+	outstanding[i] = outstanding[i] + 1
+	if large then
+		large[i] = large[i] + 1
+	end
+	local ok, result = pcall(c.request, c, request, response, padding)
+	outstanding[i] = outstanding[i] - 1
+	if large then
+		large[i] = large[i] - 1
+	end
+	if not ok then
+		error(result, 0)
+	end
+	return result
+end
+
+-- the following requests of current coroutine are sent by the same channel until pool:unbind,
+-- for the requests depend on the connection state (transaction, etc).
+-- The channel is not used by the other coroutines before pool:unbind (or the coroutine is dead).
+-- return true if the channel is bound by this call (false if it's bound already)
+function pool:bind()
+	local co = coroutine.running()
+	if self.__bind[co] then
+		return false
+	end
+	local index = pick_channel(self)
+	self.__bind[co] = index
+	self.__owner[index] = co
+	return true
+end
+
+-- reset : the connection state is unknown (an error in transaction), reconnect it
+-- return true if the channel was bound
+function pool:unbind(reset)
+	local co = coroutine.running()
+	if self.__bind[co] then
+		release(self, co, reset)
+		return true
+	end
+	return false
+end
+
+-- return true if the requests of current coroutine go to one channel (bound, or in the auth function)
+function pool:bound()
+	local co = coroutine.running()
+	if self.__bind[co] then
+		return true
+	end
+	for _, c in ipairs(self.__channel) do
+		if c.__authcoroutine == co then
+			return true
+		end
+	end
+	return false
+end
+
+function pool:close()
+	for _, c in ipairs(self.__channel) do
+		c:close()
+	end
+end
+
+function pool:changehost(host, port)
+	for _, c in ipairs(self.__channel) do
+		c:changehost(host, port)
+	end
+end
+
+function pool:changebackup(backup)
+	for _, c in ipairs(self.__channel) do
+		c:changebackup(backup)
+	end
+end
+
 local function wrapper_socket_function(f)
 	return function(self, ...)
 		local result = f(self[1], ...)
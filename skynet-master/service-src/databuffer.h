@@ -133,6 +133,23 @@ databuffer_read(struct databuffer *db, struct messagepool *mp, void * buffer, in
 }
 
 //data,СΪszݼ뵽 db
+// If the next sz bytes are the tail of the head message (a package ends with a read),
+// move them to the front of its buffer and take the buffer without copy. Or return NULL.
+static void *
+databuffer_take(struct databuffer *db, struct messagepool *mp, int sz) {
+	struct message *current = db->head;
+	if (current == NULL || current->size - db->offset != sz) {
+		return NULL;
+	}
+	char * buffer = current->buffer;
+	memmove(buffer, buffer + db->offset, sz);
+	current->buffer = NULL;
+	db->size -= sz;
+	db->offset = 0;
+	_return_message(db, mp);
+	return buffer;
+}
+
 static void
 databuffer_push(struct databuffer *db, struct messagepool *mp, void *data, int sz) {
 	struct message * m;
@@ -0,0 +1,1098 @@
+#include "skynet.h"
+#include "skynet_socket.h"
+#include "hashid.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+	The native cluster gateway, launched by clusterd.lua when cluster_native = true.
+	It speaks the wire protocol of lua-cluster.c, clusterd.lua is the control plane.
+
+	PTYPE_TEXT (from clusterd) :
+		listen host port	; accept the requests from other nodes
+		node id host port	; the address of node id, the link reconnects if it changed
+	PTYPE_RESERVED_LUA (skynet.rawcall "lua" from cluster.lua) :
+		request packages (see cluster.core.packnative) with session 0, DWORD node id
+		The sessions of link are filled here, and the response is sent back to the caller.
+		The push packages (cluster.send) are sent without session (except multi part) and response.
+	PTYPE_RESPONSE/PTYPE_ERROR :
+		the responses of local services, for the requests from other nodes
+
+	The small packages to a link in one dispatch are sent by one socket write (see send_reserve),
+	as the harbor service does.
+
+	The requests to the address (number) of a service are sent by this service directly.
+	The others (name query, string address and compressed messages) are forwarded to
+	clusterd as PTYPE_CLIENT message : package (without size header) , DWORD socket id.
+	clusterd writes their responses to the socket by itself. An empty package means the
+	link is closed.
+ */
+
+#define BACKLOG 32
+#define MAX_LINK 4096
+#define LISTEN_LINK -1
+#define SEND_BUFFER_SIZE 4096
+// flush the send buffer of a link at once when it is larger than this
+#define SEND_BATCH_LIMIT (64 * 1024)
+#define HEADER_SIZE 2
+#define MULTI_PART 0x8000
+
+// package type of request, see lua-cluster.c
+#define REQ_NUMBER 0
+#define REQ_NUMBER_MULTI 1
+#define REQ_PART 2
+#define REQ_PART_END 3
+#define REQ_STRING 0x80
+#define REQ_STRING_MULTI 0x81
+#define REQ_COMPRESSED 0x40
+#define REQ_PUSH 0x20
+
+// package type of response
+#define RESP_ERROR 0
+#define RESP_OK 1
+#define RESP_MULTI_BEGIN 2
+#define RESP_MULTI_PART 3
+#define RESP_MULTI_END 4
+
+// a request waiting for the response (or a multi part message receiving)
+struct pending {
+	uint32_t session;	// the key, 0 is empty
+	uint32_t address;	// the caller / the socket id / the service of request
+	int reply;		// the session of caller / the session of peer / forwarded to clusterd
+	uint32_t serial;	// the serial of link (a socket id may be reused)
+	char * buffer;		// multi part message
+	uint32_t size;
+	uint32_t offset;
+	int push;		// multi part push, no response
+};
+
+// open addressing, linear probing
+struct pending_map {
+	int cap;
+	int count;
+	struct pending * slot;
+};
+
+struct queue_request {
+	void * buffer;
+	int sz;
+	int multipart;
+};
+
+// a connection to other node
+struct node {
+	char * host;
+	int port;
+	int id;			// socket id, -1 if not connected
+	int connected;
+	uint32_t session;	// the next session on the link
+	struct pending_map request;	// session -> caller
+	int queue_n;		// the requests sent while connecting
+	int queue_cap;
+	struct queue_request * queue;
+};
+
+struct link {
+	int id;
+	uint32_t serial;
+	int node;		// the node id of outgoing link, 0 for the accepted one, or LISTEN_LINK
+	struct pending_map large;	// multi part requests receiving
+	int dirty;		// in the dirty list of cluster, see send_reserve
+	int send_size;
+	int send_cap;
+	uint8_t * send_buffer;
+};
+
+struct cluster {
+	struct skynet_context * ctx;
+	uint32_t clusterd;
+	uint32_t serial;
+	struct hashid hash;	// socket id -> link
+	struct link * link;
+	int node_cap;
+	struct node * node;	// node id -> node
+	struct pending_map service;	// the session of local service -> request from other node
+	int flush_session;	// the session of the timeout (0) to flush the send buffers, 0 if not waiting
+	int dirty_n;
+	int * dirty;		// the index of links have data in send buffer
+};
+
+static void
+pending_init(struct pending_map *m) {
+	m->cap = 16;
+	m->count = 0;
+	m->slot = skynet_malloc(m->cap * sizeof(struct pending));
+	memset(m->slot, 0, m->cap * sizeof(struct pending));
+}
+
+static inline int
+pending_hash(struct pending_map *m, uint32_t session) {
+	return (int)((session * 2654435761U) & (m->cap - 1));
+}
+
+static struct pending *
+pending_find(struct pending_map *m, uint32_t session) {
+	if (session == 0) {
+		// the response of push (a service may respond to skynet.send), or invalid package
+		return NULL;
+	}
+	int i = pending_hash(m, session);
+	for (;;) {
+		struct pending * p = &m->slot[i];
+		if (p->session == session)
+			return p;
+		if (p->session == 0)
+			return NULL;
+		i = (i + 1) & (m->cap - 1);
+	}
+}
+
+static struct pending *
+pending_insert(struct pending_map *m, uint32_t session);
+
+static void
+pending_grow(struct pending_map *m) {
+	struct pending * old = m->slot;
+	int cap = m->cap;
+	m->cap *= 2;
+	m->count = 0;
+	m->slot = skynet_malloc(m->cap * sizeof(struct pending));
+	memset(m->slot, 0, m->cap * sizeof(struct pending));
+	int i;
+	for (i=0;i<cap;i++) {
+		if (old[i].session) {
+			*pending_insert(m, old[i].session) = old[i];
+		}
+	}
+	skynet_free(old);
+}
+
+// the session should not be in the map
+static struct pending *
+pending_insert(struct pending_map *m, uint32_t session) {
+	if ((m->count + 1) * 4 > m->cap * 3) {
+		pending_grow(m);
+	}
+	int i = pending_hash(m, session);
+	while (m->slot[i].session) {
+		i = (i + 1) & (m->cap - 1);
+	}
+	struct pending * p = &m->slot[i];
+	memset(p, 0, sizeof(*p));
+	p->session = session;
+	++m->count;
+	return p;
+}
+
+// backward shift deletion, p is not valid after removing
+static void
+pending_remove(struct pending_map *m, struct pending *p) {
+	int mask = m->cap - 1;
+	int i = p - m->slot;
+	int j = i;
+	for (;;) {
+		j = (j + 1) & mask;
+		if (m->slot[j].session == 0)
+			break;
+		int k = pending_hash(m, m->slot[j].session);
+		// move slot j to i if its home k is not in (i, j]
+		if ((i <= j) ? (k <= i || k > j) : (k <= i && k > j)) {
+			m->slot[i] = m->slot[j];
+			i = j;
+		}
+	}
+	memset(&m->slot[i], 0, sizeof(struct pending));
+	--m->count;
+}
+
+static void
+pending_clear(struct pending_map *m) {
+	int i;
+	for (i=0;i<m->cap;i++) {
+		skynet_free(m->slot[i].buffer);
+	}
+	skynet_free(m->slot);
+	m->slot = NULL;
+	m->cap = 0;
+	m->count = 0;
+}
+
+static inline uint32_t
+unpack_uint32(const uint8_t * buf) {
+	return buf[0] | buf[1]<<8 | buf[2]<<16 | buf[3]<<24;
+}
+
+static inline void
+fill_uint32(uint8_t * buf, uint32_t n) {
+	buf[0] = n & 0xff;
+	buf[1] = (n >> 8) & 0xff;
+	buf[2] = (n >> 16) & 0xff;
+	buf[3] = (n >> 24) & 0xff;
+}
+
+static inline void
+fill_header(uint8_t * buf, int sz) {
+	buf[0] = (sz >> 8) & 0xff;
+	buf[1] = sz & 0xff;
+}
+
+struct cluster *
+cluster_create(void) {
+	struct cluster * c = skynet_malloc(sizeof(*c));
+	memset(c, 0, sizeof(*c));
+	return c;
+}
+
+static void
+free_queue(struct node * n) {
+	int i;
+	for (i=0;i<n->queue_n;i++) {
+		skynet_free(n->queue[i].buffer);
+	}
+	n->queue_n = 0;
+}
+
+void
+cluster_release(struct cluster *c) {
+	struct skynet_context * ctx = c->ctx;
+	if (ctx == NULL) {
+		// init failed
+		skynet_free(c);
+		return;
+	}
+	int i;
+	for (i=0;i<MAX_LINK;i++) {
+		struct link * l = &c->link[i];
+		if (l->id >= 0) {
+			skynet_socket_close(ctx, l->id);
+			pending_clear(&l->large);
+		}
+	}
+	for (i=0;i<c->node_cap;i++) {
+		struct node * n = &c->node[i];
+		skynet_free(n->host);
+		free_queue(n);
+		skynet_free(n->queue);
+		pending_clear(&n->request);
+	}
+	skynet_free(c->node);
+	pending_clear(&c->service);
+	hashid_clear(&c->hash);
+	for (i=0;i<MAX_LINK;i++) {
+		skynet_free(c->link[i].send_buffer);
+	}
+	skynet_free(c->link);
+	skynet_free(c->dirty);
+	skynet_free(c);
+}
+
+static struct link *
+add_link(struct cluster *c, int id, int node) {
+	if (hashid_full(&c->hash)) {
+		return NULL;
+	}
+	struct link * l = &c->link[hashid_insert(&c->hash, id)];
+	l->id = id;
+	l->serial = ++c->serial;
+	l->node = node;
+	pending_init(&l->large);
+	// keep l->dirty, the index may be in the dirty list
+	l->send_size = 0;
+	return l;
+}
+
+static struct link *
+find_link(struct cluster *c, int id) {
+	int index = hashid_lookup(&c->hash, id);
+	if (index < 0)
+		return NULL;
+	return &c->link[index];
+}
+
+static struct node *
+get_node(struct cluster *c, uint32_t id) {
+	if (id == 0 || id >= (uint32_t)c->node_cap)
+		return NULL;
+	struct node * n = &c->node[id];
+	if (n->host == NULL)
+		return NULL;
+	return n;
+}
+
+// the requests on the link failed, the callers get PTYPE_ERROR
+static void
+node_broken(struct cluster *c, struct node *n) {
+	int i;
+	for (i=0;i<n->request.cap;i++) {
+		struct pending * p = &n->request.slot[i];
+		if (p->session) {
+			skynet_send(c->ctx, 0, p->address, PTYPE_ERROR, p->reply, NULL, 0);
+			skynet_free(p->buffer);
+		}
+	}
+	memset(n->request.slot, 0, n->request.cap * sizeof(struct pending));
+	n->request.count = 0;
+	free_queue(n);
+	n->id = -1;
+	n->connected = 0;
+}
+
+static void forward_clusterd(struct cluster *c, struct link *l, const uint8_t * pkg, int sz);
+
+static void
+flush_link(struct cluster *c, struct link *l) {
+	if (l->send_size == 0)
+		return;
+	// ignore send error, the link is closed by the socket message later
+	skynet_socket_send(c->ctx, l->id, l->send_buffer, l->send_size);
+	l->send_buffer = NULL;
+	l->send_size = 0;
+	l->send_cap = 0;
+}
+
+static void
+flush_all(struct cluster *c) {
+	c->flush_session = 0;
+	int i;
+	for (i=0;i<c->dirty_n;i++) {
+		struct link * l = &c->link[c->dirty[i]];
+		l->dirty = 0;
+		if (l->id >= 0) {
+			flush_link(c, l);
+		}
+	}
+	c->dirty_n = 0;
+}
+
+// return the space of sz bytes at the end of send buffer, send_commit after filling it
+static uint8_t *
+send_reserve(struct cluster *c, struct link *l, int sz) {
+	int need = l->send_size + sz;
+	if (need > l->send_cap) {
+		int cap = l->send_cap == 0 ? SEND_BUFFER_SIZE : l->send_cap;
+		while (cap < need) {
+			cap *= 2;
+		}
+		l->send_buffer = skynet_realloc(l->send_buffer, cap);
+		l->send_cap = cap;
+	}
+	uint8_t * ptr = l->send_buffer + l->send_size;
+	l->send_size = need;
+	if (!l->dirty) {
+		l->dirty = 1;
+		c->dirty[c->dirty_n++] = l - c->link;
+		if (c->flush_session == 0) {
+			// the timeout (0) message is pushed to the tail of the queue,
+			// so the send buffers are flushed after the messages already in queue.
+			const char * session = skynet_command(c->ctx, "TIMEOUT", "0");
+			c->flush_session = strtol(session, NULL, 10);
+		}
+	}
+	return ptr;
+}
+
+static inline void
+send_commit(struct cluster *c, struct link *l) {
+	if (l->send_size >= SEND_BATCH_LIMIT) {
+		flush_link(c, l);
+	}
+}
+
+static void
+close_link(struct cluster *c, struct link *l) {
+	if (l->node > 0) {
+		struct node * n = get_node(c, l->node);
+		if (n && n->id == l->id) {
+			node_broken(c, n);
+		}
+	} else if (l->node == 0) {
+		// clusterd clears the states of the link
+		forward_clusterd(c, l, NULL, 0);
+	}
+	pending_clear(&l->large);
+	skynet_free(l->send_buffer);
+	l->send_buffer = NULL;
+	l->send_size = 0;
+	l->send_cap = 0;
+	hashid_remove(&c->hash, l->id);
+	l->id = -1;
+}
+
+// return 1 if buffer is sent, or 0 if it's copied into the send buffer
+static int
+send_request(struct cluster *c, struct node *n, void * buffer, int sz, int multipart) {
+	struct link * l = find_link(c, n->id);
+	if (l == NULL) {
+		skynet_free(buffer);
+		return 1;
+	}
+	if (multipart) {
+		// multi part request use low priority socket write, as clusterd.lua
+		flush_link(c, l);
+		skynet_socket_send_lowpriority(c->ctx, n->id, buffer, sz);
+		return 1;
+	}
+	memcpy(send_reserve(c, l, sz), buffer, sz);
+	send_commit(c, l);
+	return 0;
+}
+
+static int
+connect_node(struct cluster *c, uint32_t id, struct node *n) {
+	int fd = skynet_socket_connect(c->ctx, n->host, n->port);
+	if (fd < 0) {
+		return -1;
+	}
+	if (add_link(c, fd, id) == NULL) {
+		skynet_socket_close(c->ctx, fd);
+		return -1;
+	}
+	skynet_socket_frame(c->ctx, fd, HEADER_SIZE, 0xffff);
+	n->id = fd;
+	n->connected = 0;
+	return 0;
+}
+
+// fill the sessions of the packages in buffer (see cluster.core.packnative), return multipart or -1
+// one package push keeps session 0
+static int
+fill_session(uint8_t * buffer, int sz, uint32_t session) {
+	int multipart = 0;
+	int pos = 0;
+	while (pos < sz) {
+		if (sz - pos < HEADER_SIZE + 5)
+			return -1;
+		int size = buffer[pos] << 8 | buffer[pos+1];
+		uint8_t * pkg = buffer + pos + HEADER_SIZE;
+		if (size > sz - pos - HEADER_SIZE)
+			return -1;
+		int offset;
+		int type = pkg[0] & ~(REQ_COMPRESSED | REQ_PUSH);
+		switch (type) {
+		case REQ_NUMBER_MULTI:
+			multipart = 1;
+			// fall through
+		case REQ_NUMBER:
+			offset = 5;
+			break;
+		case REQ_PART:
+		case REQ_PART_END:
+			offset = 1;
+			break;
+		case REQ_STRING_MULTI:
+			multipart = 1;
+			// fall through
+		case REQ_STRING:
+			offset = 2 + pkg[1];
+			break;
+		default:
+			return -1;
+		}
+		if (offset + 4 > size)
+			return -1;
+		if (!(pkg[0] & REQ_PUSH) || type == REQ_NUMBER_MULTI || type == REQ_STRING_MULTI) {
+			fill_uint32(pkg + offset, session);
+		}
+		pos += HEADER_SIZE + size;
+	}
+	return multipart;
+}
+
+// the caller of request gets PTYPE_ERROR, the sender of push (session 0) gets nothing
+static void
+request_failed(struct cluster *c, uint32_t source, int session) {
+	if (session) {
+		skynet_send(c->ctx, 0, source, PTYPE_ERROR, session, NULL, 0);
+	}
+}
+
+// request (or push) from cluster.lua, return 1 if msg is kept (sent or queued)
+static int
+forward_request(struct cluster *c, uint32_t source, int session, void * msg, int sz) {
+	struct skynet_context * ctx = c->ctx;
+	if (sz <= 4) {
+		skynet_error(ctx, "[cluster] Invalid request from %x", source);
+		request_failed(c, source, session);
+		return 0;
+	}
+	sz -= 4;
+	uint32_t id = unpack_uint32((const uint8_t *)msg + sz);
+	struct node * n = get_node(c, id);
+	if (n == NULL) {
+		skynet_error(ctx, "[cluster] Unknown node %u from %x", id, source);
+		request_failed(c, source, session);
+		return 0;
+	}
+	uint32_t s = n->session;
+	int multipart = fill_session(msg, sz, s);
+	if (multipart < 0) {
+		skynet_error(ctx, "[cluster] Invalid request package from %x", source);
+		request_failed(c, source, session);
+		return 0;
+	}
+	int push = ((uint8_t *)msg)[HEADER_SIZE] & REQ_PUSH;
+	if (!push || multipart) {
+		if (++n->session == 0) {
+			n->session = 1;
+		}
+	}
+	if (n->id < 0 && connect_node(c, id, n)) {
+		skynet_error(ctx, "[cluster] Connect %s:%d failed", n->host, n->port);
+		request_failed(c, source, session);
+		return 0;
+	}
+	if (!push) {
+		struct pending * p = pending_find(&n->request, s);
+		if (p) {
+			// the session wraps around, the old request will never be responded
+			skynet_send(ctx, 0, p->address, PTYPE_ERROR, p->reply, NULL, 0);
+			skynet_free(p->buffer);
+			p->buffer = NULL;
+		} else {
+			p = pending_insert(&n->request, s);
+		}
+		p->address = source;
+		p->reply = session;
+	}
+	if (n->connected) {
+		return send_request(c, n, msg, sz, multipart);
+	} else {
+		if (n->queue_n >= n->queue_cap) {
+			n->queue_cap = n->queue_cap ? n->queue_cap * 2 : 16;
+			n->queue = skynet_realloc(n->queue, n->queue_cap * sizeof(struct queue_request));
+		}
+		struct queue_request * q = &n->queue[n->queue_n++];
+		q->buffer = msg;
+		q->sz = sz;
+		q->multipart = multipart;
+	}
+	return 1;
+}
+
+static void
+reply_caller(struct cluster *c, struct pending *p, void * data, int sz) {
+	if (data) {
+		skynet_send(c->ctx, 0, p->address, PTYPE_RESPONSE | PTYPE_TAG_DONTCOPY, p->reply, data, sz);
+	} else {
+		skynet_send(c->ctx, 0, p->address, PTYPE_ERROR, p->reply, NULL, 0);
+	}
+}
+
+// a response package on the link to node (msg/msz is the package without session and type),
+// data (the msg of RESP_OK) is freed or sent
+static void
+dispatch_response(struct cluster *c, struct node *n, uint32_t session, int type, const uint8_t * msg, int msz, void * data, int dsz) {
+	struct pending * p = pending_find(&n->request, session);
+	if (p == NULL) {
+		skynet_error(c->ctx, "[cluster] Unknown session %u from %s:%d", session, n->host, n->port);
+		skynet_free(data);
+		return;
+	}
+	switch (type) {
+	case RESP_OK:
+		reply_caller(c, p, data, dsz);
+		pending_remove(&n->request, p);
+		return;
+	case RESP_MULTI_BEGIN:
+		if (msz == 4 && p->buffer == NULL) {
+			p->size = unpack_uint32(msg);
+			p->offset = 0;
+			p->buffer = skynet_malloc(p->size);
+			skynet_free(data);
+			return;
+		}
+		break;
+	case RESP_MULTI_PART:
+	case RESP_MULTI_END:
+		if (p->buffer && msz <= p->size - p->offset) {
+			memcpy(p->buffer + p->offset, msg, msz);
+			p->offset += msz;
+			skynet_free(data);
+			if (type == RESP_MULTI_END) {
+				if (p->offset == p->size) {
+					reply_caller(c, p, p->buffer, p->size);
+				} else {
+					skynet_free(p->buffer);
+					reply_caller(c, p, NULL, 0);
+				}
+				p->buffer = NULL;
+				pending_remove(&n->request, p);
+			}
+			return;
+		}
+		break;
+	case RESP_ERROR:
+		break;
+	default:
+		// compressed response is never negotiated by this service
+		skynet_error(c->ctx, "[cluster] Invalid response type %d from %s:%d", type, n->host, n->port);
+		break;
+	}
+	skynet_free(data);
+	skynet_free(p->buffer);
+	p->buffer = NULL;
+	reply_caller(c, p, NULL, 0);
+	pending_remove(&n->request, p);
+}
+
+static void
+forward_clusterd(struct cluster *c, struct link *l, const uint8_t * pkg, int sz) {
+	uint8_t * msg = skynet_malloc(sz + 4);
+	if (sz > 0) {
+		memcpy(msg, pkg, sz);
+	}
+	fill_uint32(msg + sz, (uint32_t)l->id);
+	skynet_send(c->ctx, 0, c->clusterd, PTYPE_CLIENT | PTYPE_TAG_DONTCOPY, 0, msg, sz + 4);
+}
+
+static void
+send_response(struct cluster *c, struct link *l, uint32_t session, int type, const void * msg, int sz) {
+	uint8_t * buf = send_reserve(c, l, HEADER_SIZE + 5 + sz);
+	fill_header(buf, sz + 5);
+	fill_uint32(buf + 2, session);
+	buf[6] = type;
+	memcpy(buf + 7, msg, sz);
+	send_commit(c, l);
+}
+
+static void
+send_error(struct cluster *c, struct link *l, uint32_t session, const char * err) {
+	send_response(c, l, session, RESP_ERROR, err, strlen(err));
+}
+
+// call the service for the request from other node, data (malloc) is sent or freed
+static void
+call_service(struct cluster *c, struct link *l, uint32_t addr, uint32_t session, void * data, int sz) {
+	int s = skynet_send(c->ctx, 0, addr, PTYPE_RESERVED_LUA | PTYPE_TAG_ALLOCSESSION | PTYPE_TAG_DONTCOPY, 0, data, sz);
+	if (s < 0) {
+		send_error(c, l, session, "call to invalid address");
+		return;
+	}
+	struct pending * p = pending_insert(&c->service, (uint32_t)s);
+	p->address = (uint32_t)l->id;
+	p->reply = (int)session;
+	p->serial = l->serial;
+}
+
+// the push from other node, data (malloc) is sent or freed
+static void
+push_service(struct cluster *c, struct link *l, uint32_t addr, void * data, int sz) {
+	if (skynet_send(c->ctx, 0, addr, PTYPE_RESERVED_LUA | PTYPE_TAG_DONTCOPY, 0, data, sz) < 0) {
+		skynet_error(c->ctx, "[cluster] Push to invalid address %x from link %d", addr, l->id);
+	}
+}
+
+// a request (or push) package on the accepted link
+static void
+dispatch_request(struct cluster *c, struct link *l, const uint8_t * pkg, int sz) {
+	if (sz < 5) {
+		goto _invalid;
+	}
+	uint32_t addr, session;
+	struct pending * p;
+	int push = pkg[0] & REQ_PUSH;
+	switch (pkg[0] & ~REQ_PUSH) {
+	case REQ_NUMBER:
+		if (sz < 9)
+			goto _invalid;
+		addr = unpack_uint32(pkg + 1);
+		if (addr == 0) {
+			// name query
+			break;
+		}
+		session = unpack_uint32(pkg + 5);
+		void * data = skynet_malloc(sz - 9);
+		memcpy(data, pkg + 9, sz - 9);
+		if (push) {
+			push_service(c, l, addr, data, sz - 9);
+		} else {
+			call_service(c, l, addr, session, data, sz - 9);
+		}
+		return;
+	case REQ_NUMBER_MULTI:
+		if (sz != 13)
+			goto _invalid;
+		addr = unpack_uint32(pkg + 1);
+		session = unpack_uint32(pkg + 5);
+		if (addr == 0 || session == 0 || pending_find(&l->large, session))
+			goto _invalid;
+		p = pending_insert(&l->large, session);
+		p->address = addr;
+		p->size = unpack_uint32(pkg + 9);
+		p->buffer = skynet_malloc(p->size);
+		p->push = push;
+		return;
+	case REQ_PART:
+	case REQ_PART_END:
+		if (push)
+			goto _invalid;
+		session = unpack_uint32(pkg + 1);
+		p = pending_find(&l->large, session);
+		if (p == NULL)
+			goto _invalid;
+		if (p->reply) {
+			// the multi part request is forwarded
+			if (pkg[0] == REQ_PART_END) {
+				pending_remove(&l->large, p);
+			}
+			break;
+		}
+		if (sz - 5 > p->size - p->offset) {
+			skynet_free(p->buffer);
+			pending_remove(&l->large, p);
+			goto _invalid;
+		}
+		memcpy(p->buffer + p->offset, pkg + 5, sz - 5);
+		p->offset += sz - 5;
+		if (pkg[0] == REQ_PART_END) {
+			void * data = p->buffer;
+			int dsz = p->offset;
+			int complete = (p->offset == p->size);
+			addr = p->address;
+			push = p->push;
+			pending_remove(&l->large, p);
+			if (!complete) {
+				skynet_free(data);
+				if (push) {
+					skynet_error(c->ctx, "[cluster] Invalid large push from link %d", l->id);
+				} else {
+					send_error(c, l, session, "Invalid large req");
+				}
+			} else if (push) {
+				push_service(c, l, addr, data, dsz);
+			} else {
+				call_service(c, l, addr, session, data, dsz);
+			}
+		}
+		return;
+	case REQ_NUMBER_MULTI | REQ_COMPRESSED:
+	case REQ_STRING_MULTI:
+	case REQ_STRING_MULTI | REQ_COMPRESSED:
+		// the parts follow it are forwarded too
+		if ((pkg[0] & ~(REQ_COMPRESSED | REQ_PUSH)) == REQ_STRING_MULTI) {
+			if (sz < 2 + pkg[1] + 4)
+				goto _invalid;
+			session = unpack_uint32(pkg + 2 + pkg[1]);
+		} else {
+			session = unpack_uint32(pkg + 5);
+		}
+		if (session && pending_find(&l->large, session) == NULL) {
+			p = pending_insert(&l->large, session);
+			p->reply = 1;
+		}
+		break;
+	default:
+		// string address, compressed message (request or push) : handled by clusterd
+		break;
+	}
+	forward_clusterd(c, l, pkg, sz);
+	return;
+_invalid:
+	skynet_error(c->ctx, "[cluster] Invalid request package from link %d", l->id);
+	skynet_socket_close(c->ctx, l->id);
+}
+
+// the response of local service, for the request from other node
+static void
+dispatch_service_response(struct cluster *c, int session, const void * msg, int sz, int ok) {
+	struct pending * p = pending_find(&c->service, (uint32_t)session);
+	if (p == NULL) {
+		return;
+	}
+	int id = (int)p->address;
+	uint32_t remote = (uint32_t)p->reply;
+	uint32_t serial = p->serial;
+	pending_remove(&c->service, p);
+	struct link * l = find_link(c, id);
+	if (l == NULL || l->serial != serial) {
+		// the link is closed
+		return;
+	}
+	if (!ok) {
+		send_error(c, l, remote, "call failed");
+		return;
+	}
+	if (sz <= MULTI_PART) {
+		send_response(c, l, remote, RESP_OK, msg, sz);
+		return;
+	}
+	// multi part begin, and the parts in one buffer
+	int part = (sz - 1) / MULTI_PART + 1;
+	int total = HEADER_SIZE + 9 + part * (HEADER_SIZE + 5) + sz;
+	uint8_t * buf = skynet_malloc(total);
+	uint8_t * ptr = buf;
+	fill_header(ptr, 9);
+	fill_uint32(ptr + 2, remote);
+	ptr[6] = RESP_MULTI_BEGIN;
+	fill_uint32(ptr + 7, (uint32_t)sz);
+	ptr += HEADER_SIZE + 9;
+	const uint8_t * data = msg;
+	while (sz > 0) {
+		int s = sz > MULTI_PART ? MULTI_PART : sz;
+		fill_header(ptr, s + 5);
+		fill_uint32(ptr + 2, remote);
+		ptr[6] = sz > MULTI_PART ? RESP_MULTI_PART : RESP_MULTI_END;
+		memcpy(ptr + 7, data, s);
+		ptr += HEADER_SIZE + 5 + s;
+		data += s;
+		sz -= s;
+	}
+	assert(ptr - buf == total);
+	flush_link(c, l);
+	skynet_socket_send_lowpriority(c->ctx, id, buf, total);
+}
+
+// SKYNET_SOCKET_TYPE_FRAME : complete packages with 2 bytes size header, see skynet_socket_frame
+static void
+dispatch_frame(struct cluster *c, struct link *l, uint8_t * data, int sz) {
+	uint8_t * ptr = data;
+	struct node * n = l->node > 0 ? get_node(c, l->node) : NULL;
+	for (;;) {
+		int size = ptr[0] << 8 | ptr[1];
+		const uint8_t * pkg = ptr + HEADER_SIZE;
+		sz -= HEADER_SIZE + size;
+		if (l->node == 0) {
+			dispatch_request(c, l, pkg, size);
+		} else if (n == NULL) {
+			// drop
+		} else if (size < 5) {
+			skynet_error(c->ctx, "[cluster] Invalid response package from %s:%d", n->host, n->port);
+		} else {
+			uint32_t session = unpack_uint32(pkg);
+			int type = pkg[4];
+			void * msg = NULL;
+			if (type == RESP_OK) {
+				// the response ok is sent to the caller without copy if it's the last package
+				if (sz == 0) {
+					memmove(data, pkg + 5, size - 5);
+					msg = data;
+					data = NULL;
+				} else {
+					msg = skynet_malloc(size - 5);
+					memcpy(msg, pkg + 5, size - 5);
+				}
+			}
+			dispatch_response(c, n, session, type, pkg + 5, size - 5, msg, size - 5);
+		}
+		if (sz == 0)
+			break;
+		ptr += HEADER_SIZE + size;
+	}
+	skynet_free(data);
+}
+
+static void
+dispatch_socket_message(struct cluster *c, const struct skynet_socket_message * message, int sz) {
+	struct skynet_context * ctx = c->ctx;
+	switch(message->type) {
+	case SKYNET_SOCKET_TYPE_FRAME: {
+		struct link * l = find_link(c, message->id);
+		if (l) {
+			dispatch_frame(c, l, (uint8_t *)message->buffer, message->ud);
+		} else {
+			skynet_free(message->buffer);
+		}
+		break;
+	}
+	case SKYNET_SOCKET_TYPE_DATA:
+		// the links are always in frame mode
+		skynet_free(message->buffer);
+		break;
+	case SKYNET_SOCKET_TYPE_CONNECT: {
+		struct link * l = find_link(c, message->id);
+		if (l == NULL) {
+			skynet_socket_close(ctx, message->id);
+			break;
+		}
+		if (l->node == LISTEN_LINK) {
+			// start listening
+			break;
+		}
+		skynet_socket_nodelay(ctx, message->id);
+		struct node * n = l->node > 0 ? get_node(c, l->node) : NULL;
+		if (n && n->id == message->id) {
+			n->connected = 1;
+			int i;
+			for (i=0;i<n->queue_n;i++) {
+				struct queue_request * q = &n->queue[i];
+				if (send_request(c, n, q->buffer, q->sz, q->multipart) == 0) {
+					skynet_free(q->buffer);
+				}
+			}
+			n->queue_n = 0;
+		}
+		break;
+	}
+	case SKYNET_SOCKET_TYPE_CLOSE:
+	case SKYNET_SOCKET_TYPE_ERROR: {
+		struct link * l = find_link(c, message->id);
+		if (l) {
+			skynet_error(ctx, "[cluster] link %d %s", message->id,
+				message->type == SKYNET_SOCKET_TYPE_CLOSE ? "closed" : "error");
+			close_link(c, l);
+		}
+		break;
+	}
+	case SKYNET_SOCKET_TYPE_ACCEPT: {
+		if (add_link(c, message->ud, 0) == NULL) {
+			skynet_socket_close(ctx, message->ud);
+			break;
+		}
+		char remote[64];
+		if (sz >= sizeof(remote)) {
+			sz = sizeof(remote) - 1;
+		}
+		memcpy(remote, message + 1, sz);
+		remote[sz] = '\0';
+		skynet_error(ctx, "[cluster] accept %d from %s", message->ud, remote);
+		skynet_socket_start(ctx, message->ud);
+		break;
+	}
+	case SKYNET_SOCKET_TYPE_WARNING:
+		skynet_error(ctx, "[cluster] link %d send buffer (%d)K", message->id, message->ud);
+		break;
+	}
+}
+
+static int
+cmd_listen(struct cluster *c, char * param) {
+	char host[sizeof("ffff:ffff:ffff:ffff:ffff:ffff:255.255.255.255")];
+	int port;
+	if (sscanf(param, "%45s %d", host, &port) != 2) {
+		return 1;
+	}
+	int id = skynet_socket_listen(c->ctx, host, port, BACKLOG);
+	if (id < 0) {
+		return 1;
+	}
+	if (add_link(c, id, LISTEN_LINK) == NULL) {
+		skynet_socket_close(c->ctx, id);
+		return 1;
+	}
+	// split packages in the socket thread, the accepted links inherit it
+	skynet_socket_frame(c->ctx, id, HEADER_SIZE, 0xffff);
+	skynet_socket_start(c->ctx, id);
+	return 0;
+}
+
+static int
+cmd_node(struct cluster *c, char * param) {
+	unsigned int id;
+	int port;
+	int len = strlen(param);
+	char host[len + 1];
+	if (sscanf(param, "%u %s %d", &id, host, &port) != 3 || id == 0 || id > 0xffff) {
+		return 1;
+	}
+	if (id >= (unsigned int)c->node_cap) {
+		int cap = c->node_cap ? c->node_cap : 16;
+		while (cap <= id)
+			cap *= 2;
+		c->node = skynet_realloc(c->node, cap * sizeof(struct node));
+		memset(c->node + c->node_cap, 0, (cap - c->node_cap) * sizeof(struct node));
+		int i;
+		for (i=c->node_cap;i<cap;i++) {
+			c->node[i].id = -1;
+		}
+		c->node_cap = cap;
+	}
+	struct node * n = &c->node[id];
+	if (n->host) {
+		if (strcmp(n->host, host) == 0 && n->port == port)
+			return 0;
+		// address changed, reconnect at next request
+		if (n->id >= 0) {
+			struct link * l = find_link(c, n->id);
+			skynet_socket_close(c->ctx, n->id);
+			if (l) {
+				close_link(c, l);
+			} else {
+				node_broken(c, n);
+			}
+		}
+		skynet_free(n->host);
+	} else {
+		n->session = 1;
+		pending_init(&n->request);
+	}
+	n->host = skynet_strdup(host);
+	n->port = port;
+	return 0;
+}
+
+static void
+ctrl(struct cluster *c, const void * msg, int sz, uint32_t source, int session) {
+	char tmp[sz+1];
+	memcpy(tmp, msg, sz);
+	tmp[sz] = '\0';
+	char * param = tmp;
+	char * command = strsep(&param, " ");
+	int err;
+	if (param == NULL) {
+		err = 1;
+	} else if (strcmp(command, "listen") == 0) {
+		err = cmd_listen(c, param);
+	} else if (strcmp(command, "node") == 0) {
+		err = cmd_node(c, param);
+	} else {
+		err = 1;
+	}
+	if (err) {
+		skynet_error(c->ctx, "[cluster] Invalid command : %s", (const char *)msg);
+	}
+	if (session) {
+		skynet_send(c->ctx, 0, source, err ? PTYPE_ERROR : PTYPE_RESPONSE, session, NULL, 0);
+	}
+}
+
+static int
+cluster_cb(struct skynet_context * ctx, void * ud, int type, int session, uint32_t source, const void * msg, size_t sz) {
+	struct cluster * c = ud;
+	switch (type) {
+	case PTYPE_TEXT:
+		ctrl(c, msg, (int)sz, source, session);
+		break;
+	case PTYPE_RESERVED_LUA:
+		return forward_request(c, source, session, (void *)msg, (int)sz);
+	case PTYPE_RESPONSE:
+		if (source == 0 && session == c->flush_session) {
+			flush_all(c);
+		} else {
+			dispatch_service_response(c, session, msg, (int)sz, 1);
+		}
+		break;
+	case PTYPE_ERROR:
+		dispatch_service_response(c, session, msg, (int)sz, 0);
+		break;
+	case PTYPE_SOCKET:
+		dispatch_socket_message(c, msg, (int)(sz - sizeof(struct skynet_socket_message)));
+		break;
+	}
+	return 0;
+}
+
+// parm : the handle of clusterd (:%08x)
+int
+cluster_init(struct cluster *c, struct skynet_context * ctx, const char * parm) {
+	if (parm == NULL || parm[0] != ':') {
+		skynet_error(ctx, "Invalid cluster parm %s", parm ? parm : "");
+		return 1;
+	}
+	c->clusterd = strtoul(parm+1, NULL, 16);
+	c->ctx = ctx;
+	hashid_init(&c->hash, MAX_LINK);
+	c->link = skynet_malloc(MAX_LINK * sizeof(struct link));
+	memset(c->link, 0, MAX_LINK * sizeof(struct link));
+	int i;
+	for (i=0;i<MAX_LINK;i++) {
+		c->link[i].id = -1;
+	}
+	c->dirty = skynet_malloc(MAX_LINK * sizeof(int));
+	pending_init(&c->service);
+	skynet_callback(ctx, c, cluster_cb);
+	return 0;
+}
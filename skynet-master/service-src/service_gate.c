@@ -22,6 +22,11 @@ struct connection {
 	uint32_t client;
 	char remote_name[32];
 	struct databuffer buffer;
+
+	// flow metrics, the send side is counted in socket_server. see _top
+	uint64_t recv_bytes;
+	uint64_t recv_count;
+	uint64_t last_active;	// skynet_now() of the last data received
 };
 
 
@@ -141,8 +146,106 @@ _forward_agent(struct gate * g, int fd, uint32_t agentaddr, uint32_t clientaddr)
 
 // Ĵ
 //szʾmsgС
+// the metrics of top command
+enum {
+	METRIC_RECV,		// bytes received
+	METRIC_RECVCOUNT,	// packages received
+	METRIC_SEND,		// bytes sent, include the packages sent by agents directly
+	METRIC_SENDCOUNT,	// packages sent
+	METRIC_BUFFER,		// bytes of the incomplete package (framed by socket_server, or in databuffer)
+	METRIC_WB,		// bytes in the write buffer of socket_server
+	METRIC_IDLE,		// 1/100 s since the last data received
+	METRIC_COUNT,
+};
+
+static const char * metric_name[METRIC_COUNT] = {
+	"recv", "recvcount", "send", "sendcount", "buffer", "wb", "idle",
+};
+
+struct top_item {
+	int64_t key;
+	struct connection *c;
+	int64_t metric[METRIC_COUNT];
+};
+
+static int
+_top_compar(const void *a, const void *b) {
+	const struct top_item *ia = a;
+	const struct top_item *ib = b;
+	if (ia->key == ib->key)
+		return ia->c->id - ib->c->id;
+	return ia->key < ib->key ? 1 : -1;
+}
+
+// top n metric : the n connections with the largest metric (recv by default), one line for each
+static char *
+_top(struct gate *g, char * param, int *sz) {
+	char * name = param;
+	int n = strtol(strsep(&name, " "), NULL, 10);
+	if (n <= 0) {
+		n = 10;
+	}
+	int m = METRIC_RECV;
+	if (name) {
+		for (m=0;m<METRIC_COUNT;m++) {
+			if (strcmp(name, metric_name[m]) == 0)
+				break;
+		}
+		if (m == METRIC_COUNT) {
+			skynet_error(g->ctx, "[gate] Unknown metric : %s", name);
+			m = METRIC_RECV;
+		}
+	}
+	struct top_item * item = skynet_malloc(g->max_connection * sizeof(*item));
+	uint64_t now = skynet_now();
+	int count = 0;
+	int i;
+	for (i=0;i<g->max_connection;i++) {
+		struct connection *c = &g->conn[i];
+		if (c->id < 0)
+			continue;
+		struct skynet_socket_stat stat;
+		if (skynet_socket_stat(g->ctx, c->id, &stat)) {
+			memset(&stat, 0, sizeof(stat));
+		}
+		struct top_item *t = &item[count++];
+		t->c = c;
+		t->metric[METRIC_RECV] = c->recv_bytes;
+		t->metric[METRIC_RECVCOUNT] = c->recv_count;
+		t->metric[METRIC_SEND] = stat.send_bytes;
+		t->metric[METRIC_SENDCOUNT] = stat.send_count;
+		t->metric[METRIC_BUFFER] = stat.frame_read + c->buffer.size;
+		t->metric[METRIC_WB] = stat.wb_size;
+		t->metric[METRIC_IDLE] = now - c->last_active;
+		t->key = t->metric[m];
+	}
+	qsort(item, count, sizeof(*item), _top_compar);
+	if (n > count) {
+		n = count;
+	}
+	int cap = 128 + n * (48 + 21 * METRIC_COUNT + 1);
+	char * result = skynet_malloc(cap);
+	int len = snprintf(result, cap, "id remote");
+	for (i=0;i<METRIC_COUNT;i++) {
+		len += snprintf(result + len, cap - len, " %s", metric_name[i]);
+	}
+	len += snprintf(result + len, cap - len, "\n");
+	for (i=0;i<n;i++) {
+		struct top_item *t = &item[i];
+		len += snprintf(result + len, cap - len, "%d %s", t->c->id, t->c->remote_name);
+		int j;
+		for (j=0;j<METRIC_COUNT;j++) {
+			len += snprintf(result + len, cap - len, " %lld", (long long)t->metric[j]);
+		}
+		len += snprintf(result + len, cap - len, "\n");
+	}
+	skynet_free(item);
+	*sz = len;
+	return result;
+}
+
 static void
-_ctrl(struct gate * g, const void * msg, int sz) {
+_ctrl(struct gate * g, const void * msg, int sz, uint32_t source, int session) {
 	struct skynet_context * ctx = g->ctx;
 
 	char tmp[sz+1];
@@ -254,6 +357,53 @@ _ctrl(struct gate * g, const void * msg, int sz) {
 		return;
 	}
 
+	// broadcast id1,id2,... data : send data (with header) to the connections in one call
+	if (memcmp(command, "broadcast", i) == 0 && i < sz) {
+		const char * ids = command + i + 1;
+		const char * data = memchr(ids, ' ', sz - i - 1);
+		if (data == NULL) {
+			return;
+		}
+		++data;
+		int n = 1;
+		const char * p;
+		for (p = ids; p < data; p++) {
+			if (*p == ',')
+				++n;
+		}
+		int id[n];
+		int m = 0;
+		char * endptr = (char *)ids;
+		while (endptr < data - 1) {
+			int uid = strtol(endptr, &endptr, 10);
+			if (hashid_lookup(&g->hash, uid) >= 0) {
+				id[m++] = uid;
+			}
+			if (*endptr != ',')
+				break;
+			++endptr;
+		}
+		int dsz = sz - (data - command);
+		void * buffer = skynet_malloc(dsz);
+		memcpy(buffer, data, dsz);
+		skynet_socket_send_multi(ctx, id, m, buffer, dsz);
+		return;
+	}
+
+	// top [n] [metric] : reply the connections sorted by a metric, or log them if no session
+	if (memcmp(command, "top", i) == 0) {
+		_parm(tmp, sz, i);
+		int len;
+		char * result = _top(g, command, &len);
+		if (session) {
+			skynet_send(ctx, 0, source, PTYPE_RESPONSE | PTYPE_TAG_DONTCOPY, session, result, len);
+		} else {
+			skynet_error(ctx, "[gate] top\n%s", result);
+			skynet_free(result);
+		}
+		return;
+	}
+
 	//close
 	if (memcmp(command, "close", i) == 0) {
 
@@ -290,18 +440,28 @@ _report(struct gate * g, const char * data, ...) {
 	skynet_send(ctx, 0, g->watchdog, PTYPE_TEXT,  0, tmp, n);
 }
 
+// the package ends with a read is sent in the socket buffer, the others are copied out
+static void *
+_read_package(struct gate *g, struct connection * c, int size) {
+	void * temp = databuffer_take(&c->buffer, &g->mp, size);
+	if (temp == NULL) {
+		temp = skynet_malloc(size);
+		databuffer_read(&c->buffer,&g->mp,temp, size);
+	}
+	return temp;
+}
+
 static void
 _forward(struct gate *g, struct connection * c, int size) {
 	struct skynet_context * ctx = g->ctx;
+	++c->recv_count;
 	if (g->broker) {
-		void * temp = skynet_malloc(size);
-		databuffer_read(&c->buffer,&g->mp,temp, size);
+		void * temp = _read_package(g, c, size);
 		skynet_send(ctx, 0, g->broker, g->client_tag | PTYPE_TAG_DONTCOPY, 0, temp, size);
 		return;
 	}
 	if (c->agent) {
-		void * temp = skynet_malloc(size);
-		databuffer_read(&c->buffer,&g->mp,temp, size);
+		void * temp = _read_package(g, c, size);
 		skynet_send(ctx, c->client, c->agent, g->client_tag | PTYPE_TAG_DONTCOPY, 0 , temp, size);
 	} else if (g->watchdog) {
 		char * tmp = skynet_malloc(size + 32);
@@ -333,6 +493,68 @@ dispatch_message(struct gate *g, struct connection *c, int id, void * data, int
 	}
 }
 
+// forward a package in msg (malloc by skynet_malloc), the msg is freed or sent
+static void
+_forward_frame(struct gate *g, struct connection * c, void * msg, int size) {
+	struct skynet_context * ctx = g->ctx;
+	++c->recv_count;
+	if (g->broker) {
+		skynet_send(ctx, 0, g->broker, g->client_tag | PTYPE_TAG_DONTCOPY, 0, msg, size);
+		return;
+	}
+	if (c->agent) {
+		skynet_send(ctx, c->client, c->agent, g->client_tag | PTYPE_TAG_DONTCOPY, 0 , msg, size);
+	} else if (g->watchdog) {
+		char * tmp = skynet_malloc(size + 32);
+		int n = snprintf(tmp,32,"%d data ",c->id);
+		memcpy(tmp+n, msg, size);
+		skynet_free(msg);
+		skynet_send(ctx, 0, g->watchdog, PTYPE_TEXT | PTYPE_TAG_DONTCOPY, 0, tmp, size + n);
+	} else {
+		skynet_free(msg);
+	}
+}
+
+static inline int
+frame_size(const uint8_t * ptr, int header_size) {
+	if (header_size == 2) {
+		return ptr[0] << 8 | ptr[1];
+	}
+	return ptr[0] << 24 | ptr[1] << 16 | ptr[2] << 8 | ptr[3];
+}
+
+// SKYNET_SOCKET_TYPE_FRAME : the packages in data are complete, see skynet_socket_frame
+static void
+dispatch_frame(struct gate *g, struct connection *c, void * data, int sz) {
+	int header_size = g->header_size;
+	uint8_t * ptr = data;
+	while (sz > 0) {
+		int size = frame_size(ptr, header_size);
+		if (size < 0 || size > sz - header_size) {
+			// never happens if socket_server frames the packages, drop the rest
+			skynet_error(g->ctx, "Invalid frame size %d from connection %d", size, c->id);
+			break;
+		}
+		sz -= header_size + size;
+		if (size == 0) {
+			// skip the empty package, as dispatch_message does
+			ptr += header_size;
+			continue;
+		}
+		if (sz == 0) {
+			// the last package reuses the buffer
+			memmove(data, ptr + header_size, size);
+			_forward_frame(g, c, data, size);
+			return;
+		}
+		void * temp = skynet_malloc(size);
+		memcpy(temp, ptr + header_size, size);
+		_forward_frame(g, c, temp, size);
+		ptr += header_size + size;
+	}
+	skynet_free(data);
+}
+
 
 // PTYPE_SOCKET:ʱøú
 // socketϢĴ
@@ -346,6 +568,8 @@ dispatch_socket_message(struct gate *g, const struct skynet_socket_message * mes
 		int id = hashid_lookup(&g->hash, message->id);
 		if (id>=0) {
 			struct connection *c = &g->conn[id];
+			c->recv_bytes += message->ud;
+			c->last_active = skynet_now();
 			dispatch_message(g, c, message->id, message->buffer, message->ud);
 		} else {
 			skynet_error(ctx, "Drop unknown connection %d message", message->id);
@@ -354,6 +578,20 @@ dispatch_socket_message(struct gate *g, const struct skynet_socket_message * mes
 		}
 		break;
 	}
+	case SKYNET_SOCKET_TYPE_FRAME: {
+		int id = hashid_lookup(&g->hash, message->id);
+		if (id>=0) {
+			struct connection *c = &g->conn[id];
+			c->recv_bytes += message->ud;
+			c->last_active = skynet_now();
+			dispatch_frame(g, c, message->buffer, message->ud);
+		} else {
+			skynet_error(ctx, "Drop unknown connection %d message", message->id);
+			skynet_socket_close(ctx, message->id);
+			skynet_free(message->buffer);
+		}
+		break;
+	}
 	case SKYNET_SOCKET_TYPE_CONNECT: {
 		if (message->id == g->listen_id) {
 			// start listening
@@ -403,6 +641,7 @@ dispatch_socket_message(struct gate *g, const struct skynet_socket_message * mes
 				sz = sizeof(c->remote_name) - 1;
 			}
 			c->id = message->ud;
+			c->last_active = skynet_now();
 			memcpy(c->remote_name, message+1, sz);
 			c->remote_name[sz] = '\0';
 			
@@ -426,7 +665,7 @@ _cb(struct skynet_context * ctx, void * ud, int type, int session, uint32_t sour
 
 		// skynetڲıЭ һ˵ǿ
 	case PTYPE_TEXT:
-		_ctrl(g , msg , (int)sz);
+		_ctrl(g , msg , (int)sz, source, session);
 		break;
 
 		// ͻ˵Ϣ
@@ -509,6 +748,9 @@ start_listen(struct gate *g, char * listen_addr) {
 		return 1;
 	}
 
+	// split packages in the socket thread, the accepted connections inherit it
+	skynet_socket_frame(ctx, g->listen_id, g->header_size, 0xffffff);
+
 	//׽ּ뵽epollй
 	skynet_socket_start(ctx, g->listen_id);
 	return 0;
@@ -6,6 +6,7 @@
 /*
 	harbor listen the PTYPE_HARBOR (in text)
 	N name : update the global name
+	B names : update the global names in bulk, each is the name (GLOBALNAME_LENGTH bytes) and the handle (uint32_t)
 	S fd id: connect to new harbor , we should send self_id to fd first , and then recv a id (check it), and at last send queue.
 	A fd id: accept new harbor , we should send self_id to fd , and then send queue.
 
@@ -23,6 +24,9 @@
 
 #define HASH_SIZE 4096
 #define DEFAULT_QUEUE_SIZE 1024
+#define SEND_BUFFER_SIZE 4096
+// flush the send buffer of a slave at once when it is larger than this
+#define SEND_BATCH_LIMIT (64 * 1024)
 
 // 12 is sizeof(struct remote_message_header)
 #define HEADER_COOKIE_LENGTH 12
@@ -104,6 +108,12 @@ struct slave {
 	int read;
 	uint8_t size[4];
 	char * recv_buffer;
+
+	// the messages sent in one dispatch are joined into one socket write, see send_remote
+	uint8_t * send_buffer;
+	int send_size;
+	int send_cap;
+	bool link_dirty;	// the link buffer (harbor_direct) has data, flushed with the send buffer
 };
 
 //harbor˱Ⱥнڵͨŵַ
@@ -115,6 +125,12 @@ struct harbor {
 
 	//hash
 	struct hashmap * map;
+
+	// the session of the timeout (0) to flush the send buffers, 0 if not waiting
+	int flush_session;
+
+	// harbor_direct in config : the workers send the message to handle by the link buffer directly
+	bool direct;
 	
 				// 256
 	struct slave s[REMOTE_MAX];
@@ -212,10 +228,27 @@ release_queue(struct harbor_msg_queue *queue) {
 
 
 //namehashmapвkeyvalue
+// Mix each word of the name, the xor of the words only keeps the bytes of the same lane apart
+// (the names as "name1234" fall into a few buckets), and the snapshot from master may be large.
+static inline uint32_t
+hash_name(const char name[GLOBALNAME_LENGTH]) {
+	const uint32_t *ptr = (const uint32_t *)name;
+	uint32_t h = 0;
+	int i;
+	for (i=0;i<GLOBALNAME_LENGTH/4;i++) {
+		h ^= ptr[i];
+		h ^= h >> 16;
+		h *= 0x85ebca6b;
+		h ^= h >> 13;
+		h *= 0xc2b2ae35;
+		h ^= h >> 16;
+	}
+	return h;
+}
+
 static struct keyvalue *
 hash_search(struct hashmap * hash, const char name[GLOBALNAME_LENGTH]) {
-	uint32_t *ptr = (uint32_t*) name;
-	uint32_t h = ptr[0] ^ ptr[1] ^ ptr[2] ^ ptr[3];
+	uint32_t h = hash_name(name);
 
 	//õָ
 	struct keyvalue * node = hash->node[h % HASH_SIZE];
@@ -254,10 +287,8 @@ hash_erase(struct hashmap * hash, char name[GLOBALNAME_LENGTH) {
 //hashmapвԪ
 static struct keyvalue *
 hash_insert(struct hashmap * hash, const char name[GLOBALNAME_LENGTH]) {
-	uint32_t *ptr = (uint32_t *)name;
-
 	//hashֵ
-	uint32_t h = ptr[0] ^ ptr[1] ^ ptr[2] ^ ptr[3];
+	uint32_t h = hash_name(name);
 
 	//ݹϣֵҵеָλ
 	struct keyvalue ** pkv = &hash->node[h % HASH_SIZE];
@@ -317,6 +348,10 @@ static void
 close_harbor(struct harbor *h, int id) {
 	struct slave *s = &h->s[id];
 
+	if (h->direct) {
+		skynet_harbor_link(id, 0);
+	}
+
 	//״̬
 	s->status = STATUS_DOWN;
 
@@ -330,6 +365,10 @@ close_harbor(struct harbor *h, int id) {
 		release_queue(s->queue);
 		s->queue = NULL;
 	}
+	skynet_free(s->send_buffer);
+	s->send_buffer = NULL;
+	s->send_size = 0;
+	s->send_cap = 0;
 }
 
 static void
@@ -375,6 +414,7 @@ harbor_release(struct harbor *h) {
 			// don't call report_harbor_down.
 			// never call skynet_send during module exit, because of dead lock
 		}
+		skynet_free(s->send_buffer);
 	}
 
 	//hashmap
@@ -448,19 +488,106 @@ forward_local_messsage(struct harbor *h, void *msg, int sz) {
 }
 
 static void
-send_remote(struct skynet_context * ctx, int fd, const char * buffer, size_t sz, struct remote_message_header * cookie) {
+flush_slave(struct harbor *h, struct slave *s) {
+	if (s->send_size == 0)
+		return;
+	// ignore send error, because if the connection is broken, the mainloop will recv a message.
+	skynet_socket_send(h->ctx, s->fd, s->send_buffer, s->send_size);
+	s->send_buffer = NULL;
+	s->send_size = 0;
+	s->send_cap = 0;
+}
+
+static void
+flush_all(struct harbor *h) {
+	h->flush_session = 0;
+	int i;
+	for (i=1;i<REMOTE_MAX;i++) {
+		struct slave *s = &h->s[i];
+		if (s->send_size > 0) {
+			flush_slave(h, s);
+		}
+		if (s->link_dirty) {
+			s->link_dirty = false;
+			skynet_harbor_link_flush(i);
+		}
+	}
+}
+
+static void
+wait_flush(struct harbor *h) {
+	if (h->flush_session == 0) {
+		// the timeout (0) message is pushed to the tail of the queue,
+		// so the send buffers are flushed after the messages already in queue.
+		const char * session = skynet_command(h->ctx, "TIMEOUT", "0");
+		h->flush_session = strtol(session, NULL, 10);
+	}
+}
+
+/*
+	The package (4 bytes size + message + cookie) is appended to the send buffer of the slave,
+	the packages in one dispatch are sent by one skynet_socket_send. The remote side reads them
+	as a stream of packages, so the protocol is not changed.
+	queued : the message is counted by skynet_harbor_link_send (harbor_direct), see skynet_harbor_link_push
+ */
+static void
+send_remote(struct harbor *h, struct slave *s, const char * buffer, size_t sz, struct remote_message_header * cookie, int queued) {
+	if (h->direct && skynet_harbor_link_push((int)(s - h->s), queued, cookie->source, cookie->destination, (int)cookie->session, buffer, sz) == 0) {
+		// the link buffer keeps the order with the messages sent by workers directly
+		return;
+	}
 	size_t sz_header = sz+sizeof(*cookie);
 	if (sz_header > UINT32_MAX) {
-		skynet_error(ctx, "remote message from :%08x to :%08x is too large.", cookie->source, cookie->destination);
+		skynet_error(h->ctx, "remote message from :%08x to :%08x is too large.", cookie->source, cookie->destination);
+		return;
+	}
+	uint8_t * sendbuf;
+	if (sz_header+4 >= SEND_BATCH_LIMIT) {
+		// large message, send it alone after the buffered ones
+		flush_slave(h, s);
+		if (h->direct) {
+			// and after the messages in the link buffer
+			s->link_dirty = false;
+			skynet_harbor_link_flush((int)(s - h->s));
+		}
+		sendbuf = skynet_malloc(sz_header+4);
+		to_bigendian(sendbuf, (uint32_t)sz_header);
+		memcpy(sendbuf+4, buffer, sz);
+		header_to_message(cookie, sendbuf+4+sz);
+		skynet_socket_send(h->ctx, s->fd, sendbuf, sz_header+4);
 		return;
 	}
-	uint8_t * sendbuf = skynet_malloc(sz_header+4);
+	int need = s->send_size + (int)sz_header + 4;
+	if (need > s->send_cap) {
+		int cap = s->send_cap == 0 ? SEND_BUFFER_SIZE : s->send_cap;
+		while (cap < need) {
+			cap *= 2;
+		}
+		s->send_buffer = skynet_realloc(s->send_buffer, cap);
+		s->send_cap = cap;
+	}
+	sendbuf = s->send_buffer + s->send_size;
 	to_bigendian(sendbuf, (uint32_t)sz_header);
 	memcpy(sendbuf+4, buffer, sz);
 	header_to_message(cookie, sendbuf+4+sz);
+	s->send_size = need;
 
-	// ignore send error, because if the connection is broken, the mainloop will recv a message.
-	skynet_socket_send(ctx, fd, sendbuf, sz_header+4);
+	if (need >= SEND_BATCH_LIMIT) {
+		flush_slave(h, s);
+	} else {
+		wait_flush(h);
+	}
+}
+
+// the link is ready (after handshake and the queue sent)
+static void
+link_slave(struct harbor *h, int id) {
+	if (h->direct) {
+		struct slave *s = &h->s[id];
+		// the messages buffered must be sent before the direct ones
+		flush_slave(h, s);
+		skynet_harbor_link(id, s->fd);
+	}
 }
 
 static void
@@ -503,7 +630,7 @@ dispatch_name_queue(struct harbor *h, struct keyvalue * node) {
 	struct harbor_msg * m;
 	while ((m = pop_queue(queue)) != NULL) {
 		m->header.destination |= (handle & HANDLE_MASK);
-		send_remote(context, fd, m->buffer, m->size, &m->header);
+		send_remote(h, s, m->buffer, m->size, &m->header, 0);
 		skynet_free(m->buffer);
 	}
 }
@@ -520,7 +647,7 @@ dispatch_queue(struct harbor *h, int id) {
 
 	struct harbor_msg * m;
 	while ((m = pop_queue(queue)) != NULL) {
-		send_remote(h->ctx, fd, m->buffer, m->size, &m->header);
+		send_remote(h, s, m->buffer, m->size, &m->header, 0);
 		skynet_free(m->buffer);
 	}
 	release_queue(queue);
@@ -564,6 +691,7 @@ push_socket_data(struct harbor *h, const struct skynet_socket_message * message)
 			s->status = STATUS_HEADER;
 
 			dispatch_queue(h, id);
+			link_slave(h, id);
 
 			if (size == 0) {
 				break;
@@ -636,17 +764,22 @@ update_name(struct harbor *h, const char name[GLOBALNAME_LENGTH], uint32_t handl
 	}
 }
 
+// queued : the message is counted by skynet_harbor_link_send, it must be pushed or done
 static int
-remote_send_handle(struct harbor *h, uint32_t source, uint32_t destination, int type, int session, const char * msg, size_t sz) {
+remote_send_handle(struct harbor *h, uint32_t source, uint32_t destination, int type, int session, const char * msg, size_t sz, int queued) {
 	int harbor_id = destination >> HANDLE_REMOTE_SHIFT;
 	struct skynet_context * context = h->ctx;
+	struct slave * s = &h->s[harbor_id];
+	if (queued && (harbor_id == h->id || s->fd == 0 || s->status == STATUS_HANDSHAKE)) {
+		// not sent by the link, the following messages can go through the link after the harbor is linked
+		skynet_harbor_link_done(harbor_id);
+	}
 	if (harbor_id == h->id) {
 		// local message
 		skynet_send(context, source, destination , type | PTYPE_TAG_DONTCOPY, session, (void *)msg, sz);
 		return 1;
 	}
 
-	struct slave * s = &h->s[harbor_id];
 	if (s->fd == 0 || s->status == STATUS_HANDSHAKE) {
 		if (s->status == STATUS_DOWN) {
 			// throw an error return to source
@@ -669,7 +802,7 @@ remote_send_handle(struct harbor *h, uint32_t source, uint32_t destination, int
 		cookie.source = source;
 		cookie.destination = (destination & HANDLE_MASK) | ((uint32_t)type << HANDLE_REMOTE_SHIFT);
 		cookie.session = (uint32_t)session;
-		send_remote(context, s->fd, msg,sz,&cookie);
+		send_remote(h, s, msg,sz,&cookie, queued);
 	}
 
 	return 0;
@@ -696,7 +829,7 @@ remote_send_name(struct harbor *h, uint32_t source, const char name[GLOBALNAME_L
 		skynet_send(h->ctx, 0, h->slave, PTYPE_TEXT, 0, query, strlen(query));
 		return 1;
 	} else {
-		return remote_send_handle(h, source, node->value, type, session, msg, sz);
+		return remote_send_handle(h, source, node->value, type, session, msg, sz, 0);
 	}
 }
 
@@ -726,6 +859,26 @@ harbor_command(struct harbor * h, const char * msg, size_t sz, int session, uint
 		update_name(h, rn.name, rn.handle);
 		break;
 	}
+	case 'B' : {
+		// the snapshot of global names from master, see update_names in cslave.lua
+		const int record = GLOBALNAME_LENGTH + sizeof(uint32_t);
+		if (s < 0 || s % record != 0) {
+			skynet_error(h->ctx, "Invalid global names (size = %d)", s);
+			return;
+		}
+		int i;
+		for (i=0;i<s;i+=record) {
+			struct remote_name rn;
+			memcpy(rn.name, name + i, GLOBALNAME_LENGTH);
+			memcpy(&rn.handle, name + i + GLOBALNAME_LENGTH, sizeof(uint32_t));
+			if (rn.name[0] == 0 || rn.name[GLOBALNAME_LENGTH-1] != 0) {
+				skynet_error(h->ctx, "Invalid global name %.*s", GLOBALNAME_LENGTH, rn.name);
+				continue;
+			}
+			update_name(h, rn.name, rn.handle);
+		}
+		break;
+	}
 
 	case 'S' :
 	case 'A' : {
@@ -752,6 +905,7 @@ harbor_command(struct harbor * h, const char * msg, size_t sz, int session, uint
 		} else {
 			slave->status = STATUS_HEADER;
 			dispatch_queue(h,id);
+			link_slave(h, id);
 		}
 		break;
 	}
@@ -790,6 +944,9 @@ mainloop(struct skynet_context * context, void * ud, int type, int session, uint
 		case SKYNET_SOCKET_TYPE_CLOSE: {
 			int id = harbor_id(h, message->id);
 			if (id) {
+				if (h->direct) {
+					skynet_harbor_link(id, 0);
+				}
 				report_harbor_down(h,id);
 			} else {
 				skynet_error(context, "Unkown fd (%d) closed", message->id);
@@ -813,9 +970,21 @@ mainloop(struct skynet_context * context, void * ud, int type, int session, uint
 		return 0;
 	}
 	case PTYPE_HARBOR: {
+		if (msg == NULL) {
+			// from skynet_harbor_link_send, session is the harbor id
+			h->s[session].link_dirty = true;
+			wait_flush(h);
+			return 0;
+		}
 		harbor_command(h, msg,sz,session,source);
 		return 0;
 	}
+	case PTYPE_RESPONSE:
+		if (source == 0 && session == h->flush_session) {
+			flush_all(h);
+			return 0;
+		}
+		// the response to remote service, go through
 	default: {
 		// remote message out
 		const struct remote_message *rmsg = msg;
@@ -824,7 +993,8 @@ mainloop(struct skynet_context * context, void * ud, int type, int session, uint
 				return 0;
 			}
 		} else {
-			if (remote_send_handle(h, source , rmsg->destination.handle, type, session, rmsg->message, rmsg->sz)) {
+			// the messages to handle are counted by skynet_harbor_link_send in harbor_direct mode
+			if (remote_send_handle(h, source , rmsg->destination.handle, type, session, rmsg->message, rmsg->sz, h->direct)) {
 				return 0;
 			}
 		}
@@ -846,6 +1016,12 @@ harbor_init(struct harbor *h, struct skynet_context *ctx, const char * args) {
 	}
 	h->id = harbor_id;
 	h->slave = slave;
+	const char * direct = skynet_command(ctx, "GETENV", "harbor_direct");
+	h->direct = direct != NULL && strcmp(direct, "true") == 0;
+	if (h->direct) {
+		// before skynet_harbor_start, so all the messages to harbor service are counted
+		skynet_harbor_link_enable();
+	}
 
 	//ctxĻص mainloop ,صĲh
 	skynet_callback(ctx, h, mainloop);
@@ -2,10 +2,23 @@ local skynet = require "skynet"
 local sc = require "socketchannel"
 local socket = require "socket"
 local cluster = require "cluster.core"
+require "skynet.manager"	-- import skynet.launch
 
 local config_name = skynet.getenv "cluster"
+-- compress the messages larger than it on the links to the nodes support compression
+local compress_threshold = tonumber(skynet.getenv "cluster_compress")
+-- the connections to each node, a request goes to the least loaded one (see socketchannel pool)
+local channel_count = tonumber(skynet.getenv "cluster_channels") or 1
+-- the requests and responses go through the native cluster service (service_cluster.c),
+-- clusterd handles the control messages only (listen, node address, name query, compression)
+local native = skynet.getenv "cluster_native" == "true"
+local gateway
+local node_id = {}	-- node name -> node id in gateway
+local node_count = 0
 local node_address = {}
 local node_session = {}
+local node_compress = {}	-- node -> threshold, negotiated when the channel connected
+local link_compress = {}	-- fd -> threshold, the threshold of responses asked by peer
 local command = {}
 
 local function read_response(sock)
@@ -14,16 +27,43 @@ local function read_response(sock)
 	return cluster.unpackresponse(msg)	-- session, ok, data, padding
 end
 
+-- ask the peer to compress the messages on this link, it's a name query of nil (addr 0),
+-- so the peer doesn't support compression replies "name not found".
+local function negotiate_compress(c, node)
+	node_compress[node] = nil
+	local session = node_session[node] or 1
+	local request, new_session = cluster.packrequest(0, session, skynet.pack(nil, "compress", compress_threshold))
+	node_session[node] = new_session
+	local ok, err = pcall(c.request, c, request, session)
+	if ok then
+		node_compress[node] = compress_threshold
+	elseif err == sc.error then
+		error(err)
+	end
+end
+
 local function open_channel(t, key)
 	local host, port = string.match(node_address[key], "([^:]+):(.*)$")
-	local c = sc.channel {
+	local desc = {
 		host = host,
 		port = tonumber(port),
 		response = read_response,
 		nodelay = true,
+		auth = compress_threshold and function(c)
+			negotiate_compress(c, key)
+		end,
 	}
-	assert(c:connect(true))
+	local c
+	if channel_count > 1 then
+		-- the sessions of node_session[key] are shared by the channels
+		desc.pool = channel_count
+		c = sc.pool(desc)
+	else
+		c = sc.channel(desc)
+	end
+	-- set before connecting, the requests at the same time wait for the same channel
 	t[key] = c
+	assert(c:connect(true))
 	return c
 end
 
@@ -43,6 +83,9 @@ local function loadconfig()
 				node_channel[name] = nil	-- reset connection
 			end
 			node_address[name] = address
+			if node_id[name] then
+				skynet.send(gateway, "text", string.format("node %d %s", node_id[name], (address:gsub(":", " "))))
+			end
 		end
 	end
 end
@@ -53,23 +96,55 @@ function command.reload()
 end
 
 function command.listen(source, addr, port)
-	local gate = skynet.newservice("gate")
 	if port == nil then
 		addr, port = string.match(node_address[addr], "([^:]+):(.*)$")
 	end
-	skynet.call(gate, "lua", "open", { address = addr, port = port })
+	if native then
+		skynet.call(gateway, "text", string.format("listen %s %d", addr, port))
+	else
+		local gate = skynet.newservice("gate")
+		skynet.call(gate, "lua", "open", { address = addr, port = port })
+	end
 	skynet.ret(skynet.pack(nil))
 end
 
+function command.gateway()
+	skynet.ret(skynet.pack(gateway))
+end
+
+-- the node id in gateway, see cluster.rawcall
+function command.node(source, node)
+	local id = node_id[node]
+	if not id then
+		local address = assert(node_address[node], node)
+		node_count = node_count + 1
+		id = node_count
+		skynet.call(gateway, "text", string.format("node %d %s", id, (address:gsub(":", " "))))
+		node_id[node] = id
+	end
+	skynet.ret(skynet.pack(id))
+end
+
+local function connect_node(node)
+	local c = node_channel[node]
+	assert(c:connect(true))
+	return c
+end
+
 local function send_request(source, node, addr, msg, sz)
+	-- node_channel[node] may yield or throw error, connect before packing the request,
+	-- so the session is not changed by others (compression negotiation) and request is always sent
+	local ok, c = pcall(connect_node, node)
+	if not ok then
+		skynet.trash(msg, sz)
+		error(c)
+	end
+
 	local session = node_session[node] or 1
-	-- msg is a local pointer, cluster.packrequest will free it
-	local request, new_session, padding = cluster.packrequest(addr, session, msg, sz)
+	-- msg is a local pointer, cluster.packrequest will free it, or put it in request { header, msg, sz }
+	local request, new_session, padding = cluster.packrequest(addr, session, msg, sz, node_compress[node])
 	node_session[node] = new_session
 
-	-- node_channel[node] may yield or throw error
-	local c = node_channel[node]
-
 	return c:request(request, session, padding)
 end
 
@@ -87,6 +162,29 @@ function command.req(...)
 	end
 end
 
+local function send_push(source, node, addr, msg, sz)
+	local ok, c = pcall(connect_node, node)
+	if not ok then
+		skynet.trash(msg, sz)
+		error(c)
+	end
+
+	local session = node_session[node] or 1
+	-- the session is used by multi part push only, no one waits for it
+	local request, new_session, padding = cluster.packpush(addr, session, msg, sz, node_compress[node])
+	node_session[node] = new_session
+
+	c:request(request, nil, padding)
+end
+
+-- cluster.send : no response from the peer
+function command.push(...)
+	local ok, err = pcall(send_push, ...)
+	if not ok then
+		skynet.error(err)
+	end
+end
+
 local proxy = {}
 
 function command.proxy(source, node, name)
@@ -112,47 +210,65 @@ function command.register(source, name, addr)
 	skynet.error(string.format("Register [%s] :%08x", name, addr))
 end
 
+-- fd -> { session -> the buffer of multi part request }, the peer may send by many connections
 local large_request = {}
 
 function command.socket(source, subcmd, fd, msg)
 	if subcmd == "data" then
-		local sz
-		local addr, session, msg, padding = cluster.unpackrequest(msg)
+		local link_request = large_request[fd]
+		if not link_request then
+			link_request = {}
+			large_request[fd] = link_request
+		end
+		-- the multi part request is reassembled in link_request, msg is a lightuserdata at the last part
+		local addr, session, msg, padding, push, sz = cluster.unpackrequest(msg, link_request)
 		if padding then
-			local req = large_request[session] or { addr = addr }
-			large_request[session] = req
-			table.insert(req, msg)
 			return
-		else
-			local req = large_request[session]
-			if req then
-				large_request[session] = nil
-				table.insert(req, msg)
-				msg,sz = cluster.concat(req)
-				addr = req.addr
-			end
-			if not msg then
+		end
+		if not msg then
+			if push then
+				skynet.error(string.format("Invalid large push from fd %d", fd))
+			else
 				local response = cluster.packresponse(session, false, "Invalid large req")
 				socket.write(fd, response)
-				return
 			end
+			return
+		end
+		if push then
+			if addr == 0 then
+				skynet.error(string.format("Invalid push (address 0) from fd %d", fd))
+				-- a single package push is a string, only the reassembled one (lightuserdata) is freed
+				if type(msg) == "userdata" then
+					skynet.trash(msg, sz)
+				end
+			else
+				skynet.rawsend(addr, "lua", msg, sz)
+			end
+			return
 		end
 		local ok, response
 		if addr == 0 then
-			local name = skynet.unpack(msg, sz)
-			local addr = register_name[name]
-			if addr then
+			local name, opt, threshold = skynet.unpack(msg, sz)
+			if name == nil and opt == "compress" then
+				-- see negotiate_compress
+				link_compress[fd] = threshold
 				ok = true
-				msg, sz = skynet.pack(addr)
+				msg, sz = skynet.pack(threshold)
 			else
-				ok = false
-				msg = "name not found"
+				local addr = register_name[name]
+				if addr then
+					ok = true
+					msg, sz = skynet.pack(addr)
+				else
+					ok = false
+					msg = "name not found"
+				end
 			end
 		else
 			ok , msg, sz = pcall(skynet.rawcall, addr, "lua", msg, sz)
 		end
 		if ok then
-			response = cluster.packresponse(session, true, msg, sz)
+			response = cluster.packresponse(session, true, msg, sz, link_compress[fd])
 			if type(response) == "table" then
 				for _, v in ipairs(response) do
 					socket.lwrite(fd, v)
@@ -165,15 +281,45 @@ function command.socket(source, subcmd, fd, msg)
 			socket.write(fd, response)
 		end
 	elseif subcmd == "open" then
+		link_compress[fd] = nil
+		large_request[fd] = nil
 		skynet.error(string.format("socket accept from %s", msg))
 		skynet.call(source, "lua", "accept", fd)
 	else
-		large_request = {}
+		large_request[fd] = nil
+		link_compress[fd] = nil
 		skynet.error(string.format("socket %s %d : %s", subcmd, fd, msg))
 	end
 end
 
+skynet.register_protocol {
+	name = "text",
+	id = skynet.PTYPE_TEXT,
+	pack = function(...) return ... end,
+	unpack = skynet.tostring,
+}
+
+-- the packages forwarded by gateway : package, DWORD fd ; an empty package if the link is closed
+skynet.register_protocol {
+	name = "client",
+	id = skynet.PTYPE_CLIENT,
+	unpack = function(msg, sz)
+		local data = skynet.tostring(msg, sz)
+		return string.unpack("<I4", data, #data - 3), data:sub(1, -5)
+	end,
+	dispatch = function(_, source, fd, msg)
+		if msg == "" then
+			command.socket(source, "close", fd, "")
+		else
+			command.socket(source, "data", fd, msg)
+		end
+	end,
+}
+
 skynet.start(function()
+	if native then
+		gateway = skynet.launch("cluster", skynet.address(skynet.self()))
+	end
 	loadconfig()
 	skynet.dispatch("lua", function(session , source, cmd, ...)
 		local f = assert(command[cmd])
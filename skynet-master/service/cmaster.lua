@@ -11,7 +11,7 @@ local socket = require "socket"
 	protocol slave->master :
 		package size 1 byte
 		type 1 byte :
-			'H' : HANDSHAKE, report slave id, and address.
+			'H' : HANDSHAKE, report slave id, and address. (and true if the slave wants the global names)
 			'R' : REGISTER name address
 			'Q' : QUERY name
 
@@ -19,7 +19,7 @@ local socket = require "socket"
 	protocol master->slave:
 		package size 1 byte
 		type 1 byte :
-			'W' : WAIT n
+			'W' : WAIT n (and the number of global names if the slave wants them, followed by the 'N' of each name)
 			'C' : CONNECT slave_id slave_address
 			'N' : NAME globalname address
 			'D' : DISCONNECT slave_id
@@ -43,7 +43,7 @@ local function pack_package(...)
 	return string.char(size) .. message
 end
 
-local function report_slave(fd, slave_id, slave_addr)
+local function report_slave(fd, slave_id, slave_addr, names)
 	local message = pack_package("C", slave_id, slave_addr)
 	local n = 0
 	for k,v in pairs(slave_node) do
@@ -52,17 +52,30 @@ local function report_slave(fd, slave_id, slave_addr)
 			n = n + 1
 		end
 	end
-	socket.write(fd, pack_package("W", n))
+	if not names then
+		socket.write(fd, pack_package("W", n))
+		return
+	end
+	-- all the global names registered before, the names registered later are sent by 'N' too
+	local packages = {}
+	for name, address in pairs(global_name) do
+		table.insert(packages, pack_package("N", name, address))
+	end
+	socket.write(fd, pack_package("W", n, #packages))
+	if #packages > 0 then
+		socket.write(fd, table.concat(packages))
+	end
 end
 
 local function handshake(fd)
-	local t, slave_id, slave_addr = read_package(fd)
+	local t, slave_id, slave_addr, names = read_package(fd)
 	assert(t=='H', "Invalid handshake type " .. t)
 	assert(slave_id ~= 0 , "Invalid slave id 0")
 	if slave_node[slave_id] then
 		error(string.format("Slave %d already register on %s", slave_id, slave_node[slave_id].addr))
 	end
-	report_slave(fd, slave_id, slave_addr)
+	-- send the global names and add the slave at the same time (no yield), so no name is missed
+	report_slave(fd, slave_id, slave_addr, names)
 	slave_node[slave_id] = {
 		fd = fd,
 		id = slave_id,
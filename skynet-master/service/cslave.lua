@@ -53,15 +53,24 @@ local function connect_slave(slave_id, address)
 	end
 end
 
+-- update the global names of harbor service in one message, each record is the name (GLOBALNAME_LENGTH bytes) and the address
+local function update_names(names)
+	local records = {}
+	for name, address in pairs(names) do
+		table.insert(records, string.pack("c16I4", name, address))
+	end
+	if #records > 0 then
+		skynet.send(harbor_service, "harbor", "B " .. table.concat(records))
+	end
+end
+
 local function ready()
 	local queue = connect_queue
 	connect_queue = nil
 	for k,v in pairs(queue) do
 		connect_slave(k,v)
 	end
-	for name,address in pairs(globalname) do
-		skynet.redirect(harbor_service, address, "harbor", 0, "N " .. name)
-	end
+	update_names(globalname)
 end
 
 local function response_name(name)
@@ -239,10 +248,17 @@ skynet.start(function()
 
 	harbor_service = assert(skynet.launch("harbor", harbor_id, skynet.self()))
 
-	local hs_message = pack_package("H", harbor_id, slave_address)
+	-- ask for the global names registered before, so the first send to a global name doesn't wait for a query to master
+	local hs_message = pack_package("H", harbor_id, slave_address, true)
 	socket.write(master_fd, hs_message)
-	local t, n = read_package(master_fd)
+	local t, n, names = read_package(master_fd)
 	assert(t == "W" and type(n) == "number", "slave shakehand failed")
+	-- names is nil if the master doesn't send them (older version), and the names are queried later
+	for i = 1, names or 0 do
+		local t, name, address = read_package(master_fd)
+		assert(t == "N", "slave shakehand failed")
+		globalname[name] = address
+	end
 	skynet.error(string.format("Waiting for %d harbors", n))
 	skynet.fork(monitor_master, master_fd)
 	if n > 0 then
@@ -5,12 +5,61 @@ local datacenter = require "datacenter"
 local harbor_id = skynet.harbor(skynet.self())
 
 local command = {}
-local channel = {}
+local channel = {}	-- channel id -> the group of local subscribers (mc.group)
 local channel_n = {}
 local channel_remote = {}
 local channel_id = harbor_id
 local NORET = {}
 
+-- topics are local to the node, a topic is a name of levels separated by ".", such as "zone.1.guild.5"
+-- a subscription pattern may use "*" for one level, and "#" (only the last level) for zero or more levels
+local topic_root = { child = {}, n = 0 }	-- the trie of patterns, a node per level (n : the subscriptions in the subtree)
+local subscription = {}	-- subscription id -> { source = source, levels = the levels of pattern }
+local topic_cache = {}	-- topic -> the group of all the subscriptions match it, clear when the subscriptions change
+local topic_cache_n = 0
+local TOPIC_CACHE_MAX = 4096
+local EMPTY = mc.group()
+local group_member = setmetatable({}, { __mode = "k" })	-- group -> { member key -> index in group }, see join/leave
+
+-- a member is a service (handle) with the session it receives the message (channel id or subscription id)
+-- lua hashes an integer key by its low bits, and the members of a channel share the session, so keep both in them.
+local function member_key(handle, session)
+	session = session & 0xffffffff
+	return session << 32 | (handle ~ session)
+end
+
+-- return true if the member is added (false if it's in the group already)
+local function join(group, handle, session)
+	local member = group_member[group]
+	if member == nil then
+		member = {}
+		group_member[group] = member
+	end
+	local key = member_key(handle, session)
+	if member[key] then
+		return false
+	end
+	member[key] = mc.join(group, handle, session)
+	return true
+end
+
+-- return true if the member is removed
+local function leave(group, handle, session)
+	local member = group_member[group]
+	local key = member_key(handle, session)
+	local index = member and member[key]
+	if index == nil then
+		return false
+	end
+	member[key] = nil
+	-- the last member is moved to index
+	local h, s = mc.leave(group, index)
+	if h then
+		member[member_key(h, s)] = index
+	end
+	return true
+end
+
 local function get_address(t, id)
 	local v = assert(datacenter.get("multicast", id))
 	t[id] = v
@@ -19,18 +68,24 @@ end
 
 local node_address = setmetatable({}, { __index = get_address })
 
--- new LOCAL channel , The low 8bit is the same with harbor_id
-function command.NEW()
-	while channel[channel_id] do
+-- channel ids and subscription ids share the session field of multicast message, so they are allocated together
+local function new_id()
+	while channel[channel_id] or subscription[channel_id] do
 		channel_id = mc.nextid(channel_id)
 	end
-	channel[channel_id] = {}
-	channel_n[channel_id] = 0
 	local ret = channel_id
 	channel_id = mc.nextid(channel_id)
 	return ret
 end
 
+-- new LOCAL channel , The low 8bit is the same with harbor_id
+function command.NEW()
+	local c = new_id()
+	channel[c] = mc.group()
+	channel_n[c] = 0
+	return c
+end
+
 -- MUST call by the owner node of channel, delete a remote channel
 function command.DELR(source, c)
 	channel[c] = nil
@@ -63,7 +118,7 @@ local function remote_publish(node, channel, source, ...)
 	skynet.redirect(node_address[node], source, "multicast", channel, ...)
 end
 
--- publish a message, for local node, use the message pointer (call mc.bind to add the reference)
+-- publish a message, for local node, use the message pointer (mc.publish adds the reference and sends it to all the subscribers)
 -- for remote node, call remote_publish. (call mc.unpack and skynet.tostring to convert message pointer to string)
 local function publish(c , source, pack, size)
 	local remote = channel_remote[c]
@@ -77,18 +132,15 @@ local function publish(c , source, pack, size)
 	end
 
 	local group = channel[c]
-	if group == nil or next(group) == nil then
+	if group == nil then
 		-- dead channel, delete the pack. mc.bind returns the pointer in pack and free the pack (struct mc_package **)
 		local pack = mc.bind(pack, 1)
 		mc.close(pack)
 		return
 	end
-	local msg = skynet.tostring(pack, size)	-- copy (pack,size) to a string
-	mc.bind(pack, channel_n[c])	-- mc.bind will free the pack(struct mc_package **)
-	for k in pairs(group) do
-		-- the msg is a pointer to the real message, publish pointer in local is ok.
-		skynet.redirect(k, source, "multicast", c , msg)
-	end
+	-- the pointer to the real message is sent to all the subscribers in C, publish pointer in local is ok.
+	-- mc.publish will free the pack (struct mc_package **), and the message if the group is empty
+	mc.publish(group, pack, source)
 end
 
 skynet.register_protocol {
@@ -144,15 +196,14 @@ function command.SUB(source, c)
 			end
 			if channel[c] == nil then
 				-- double check, because skynet.call whould yield, other SUB may occur.
-				channel[c] = {}
+				channel[c] = mc.group()
 				channel_n[c] = 0
 			end
 		end
 	end
 	local group = channel[c]
-	if group and not group[source] then
+	if group and join(group, source, c) then
 		channel_n[c] = channel_n[c] + 1
-		group[source] = true
 	end
 end
 
@@ -168,8 +219,7 @@ end
 -- Unsubscribe a channel, if the subscriber is empty and the channel is remote, send USUBR to the channel owner
 function command.USUB(source, c)
 	local group = assert(channel[c])
-	if group[source] then
-		group[source] = nil
+	if leave(group, source, c) then
 		channel_n[c] = channel_n[c] - 1
 		if channel_n[c] == 0 then
 			local node = c % 256
@@ -184,6 +234,143 @@ function command.USUB(source, c)
 	return NORET
 end
 
+local function topic_levels(topic, pattern)
+	local levels = {}
+	for level in (topic .. "."):gmatch "(.-)%." do
+		if level == "" or (level:find "[%*#]" and not (pattern and (level == "*" or level == "#"))) then
+			error(string.format("Invalid topic %s", topic))
+		end
+		table.insert(levels, level)
+	end
+	for i=1,#levels-1 do
+		if levels[i] == "#" then
+			error(string.format("Invalid topic %s : # should be the last level", topic))
+		end
+	end
+	return levels
+end
+
+-- collect the groups of the patterns match levels[i..]
+local function topic_match(node, levels, i, result)
+	local child = node.child
+	local rest = child["#"]
+	if rest then
+		table.insert(result, rest.group)
+	end
+	local level = levels[i]
+	if level == nil then
+		if node.group then
+			table.insert(result, node.group)
+		end
+		return
+	end
+	local c = child[level]
+	if c then
+		topic_match(c, levels, i+1, result)
+	end
+	c = child["*"]
+	if c then
+		topic_match(c, levels, i+1, result)
+	end
+end
+
+-- The group of a topic is cached, so publishing to a topic is the same as a channel, except the first time.
+-- If more than one pattern match the topic, the groups are merged into a new one. (the members are not unique,
+-- a service subscribes two patterns receives the message twice, once for each subscription)
+local function topic_group(topic)
+	local group = topic_cache[topic]
+	if group then
+		return group
+	end
+	local result = {}
+	topic_match(topic_root, topic_levels(topic), 1, result)
+	if #result == 0 then
+		group = EMPTY
+	elseif #result == 1 then
+		group = result[1]
+	else
+		group = mc.group()
+		mc.merge(group, table.unpack(result))
+	end
+	if topic_cache_n >= TOPIC_CACHE_MAX then
+		topic_cache = {}
+		topic_cache_n = 0
+	end
+	topic_cache[topic] = group
+	topic_cache_n = topic_cache_n + 1
+	return group
+end
+
+local function clear_topic_cache()
+	if topic_cache_n > 0 then
+		topic_cache = {}
+		topic_cache_n = 0
+	end
+end
+
+-- publish a message to a topic, MUST call by local service
+function command.PUBT(source, topic, pack, size)
+	assert(skynet.harbor(source) == harbor_id)
+	local ok, group = pcall(topic_group, topic)
+	if not ok then
+		mc.close(mc.bind(pack, 1))
+		error(group)
+	end
+	mc.publish(group, pack, source)
+end
+
+-- the service (source) subscribe a topic pattern, return the subscription id (use id if it's free)
+function command.SUBT(source, pattern, id)
+	local levels = topic_levels(pattern, true)
+	if id == nil or channel[id] or subscription[id] then
+		id = new_id()
+	end
+	subscription[id] = { source = source, levels = levels }
+	local node = topic_root
+	node.n = node.n + 1
+	for _, level in ipairs(levels) do
+		local c = node.child[level]
+		if c == nil then
+			c = { child = {}, n = 0 }
+			node.child[level] = c
+		end
+		c.n = c.n + 1
+		node = c
+	end
+	if node.group == nil then
+		node.group = mc.group()
+	end
+	join(node.group, source, id)
+	clear_topic_cache()
+	return id
+end
+
+-- unsubscribe a topic pattern, the empty nodes are removed from the trie
+function command.USUBT(source, id)
+	local s = subscription[id]
+	if s == nil or s.source ~= source then
+		return NORET
+	end
+	subscription[id] = nil
+	local node = topic_root
+	node.n = node.n - 1
+	for _, level in ipairs(s.levels) do
+		local c = node.child[level]
+		c.n = c.n - 1
+		if c.n == 0 then
+			node.child[level] = nil
+			node = nil
+			break
+		end
+		node = c
+	end
+	if node then
+		leave(node.group, source, id)
+	end
+	clear_topic_cache()
+	return NORET
+end
+
 skynet.start(function()
 	skynet.dispatch("lua", function(_,source, cmd, ...)
 		local f = assert(command[cmd])
@@ -3,10 +3,13 @@
 #include "skynet_server.h"
 #include "skynet_mq.h"
 #include "skynet_handle.h"
+#include "skynet_socket.h"
+#include "spinlock.h"
 
 #include <string.h>
 #include <stdio.h>
 #include <assert.h>
+#include <stdint.h>
 
 //harbor Զͨ master ͳһ
 
@@ -15,6 +18,122 @@
 static struct skynet_context * REMOTE = 0;
 static unsigned int HARBOR = ~0;
 
+#define LINK_BUFFER_SIZE 4096
+
+/*
+	The harbor link for direct sending (harbor_direct = true in config), see skynet_harbor_link.
+	The workers append the packages to the buffer of the link, without the harbor service.
+	The first one appended to the empty buffer pushes a PTYPE_HARBOR message (no data, session is harbor id)
+	to the harbor service, and the harbor service sends the whole buffer by skynet_harbor_link_flush.
+	The messages to the harbor service (not linked, or too large) are counted in pending, the workers don't
+	append to the buffer until the harbor service sends them (skynet_harbor_link_push), so the order is kept.
+ */
+struct harbor_link {
+	struct spinlock lock;
+	int fd;		// 0 : not linked, the message goes through the harbor service
+	int pending;	// the messages in the queue of harbor service, from skynet_harbor_link_send
+	int size;
+	int cap;
+	uint8_t * buffer;
+};
+
+static struct harbor_link LINK[REMOTE_MAX];
+static int DIRECT = 0;
+
+static inline void
+to_bigendian(uint8_t *buffer, uint32_t n) {
+	buffer[0] = (n >> 24) & 0xff;
+	buffer[1] = (n >> 16) & 0xff;
+	buffer[2] = (n >> 8) & 0xff;
+	buffer[3] = n & 0xff;
+}
+
+// return 1 if the package is appended to the empty buffer (kick the harbor service)
+static int
+link_append(struct harbor_link * l, uint32_t source, uint32_t destination, int session, const void * msg, size_t sz) {
+	// 4 bytes size + message + cookie (source, destination, session) , the same package as service_harbor
+	size_t sz_header = sz + 12;
+	int need = l->size + (int)sz_header + 4;
+	if (need > l->cap) {
+		int cap = l->cap == 0 ? LINK_BUFFER_SIZE : l->cap;
+		while (cap < need) {
+			cap *= 2;
+		}
+		l->buffer = skynet_realloc(l->buffer, cap);
+		l->cap = cap;
+	}
+	uint8_t * sendbuf = l->buffer + l->size;
+	to_bigendian(sendbuf, (uint32_t)sz_header);
+	memcpy(sendbuf+4, msg, sz);
+	uint8_t * cookie = sendbuf+4+sz;
+	to_bigendian(cookie, source);
+	to_bigendian(cookie+4, destination);
+	to_bigendian(cookie+8, (uint32_t)session);
+	int kick = (l->size == 0);
+	l->size = need;
+	return kick;
+}
+
+static inline int
+link_large(size_t sz) {
+	return sz + 12 >= 0x1000000;
+}
+
+int
+skynet_harbor_link_send(int harbor_id, uint32_t source, uint32_t destination, int session, const void * msg, size_t sz) {
+	if (!DIRECT) {
+		return 1;
+	}
+	struct harbor_link * l = &LINK[harbor_id];
+	SPIN_LOCK(l)
+	if (l->fd == 0 || l->pending > 0 || link_large(sz)) {
+		// go through the harbor service, and the following messages go after it
+		++l->pending;
+		SPIN_UNLOCK(l)
+		return 1;
+	}
+	int kick = link_append(l, source, destination, session, msg, sz);
+	SPIN_UNLOCK(l)
+
+	if (kick) {
+		skynet_context_send(REMOTE, NULL, 0, 0, PTYPE_HARBOR, harbor_id);
+	}
+	return 0;
+}
+
+int
+skynet_harbor_link_push(int harbor_id, int queued, uint32_t source, uint32_t destination, int session, const void * msg, size_t sz) {
+	struct harbor_link * l = &LINK[harbor_id];
+	SPIN_LOCK(l)
+	if (queued) {
+		--l->pending;
+	}
+	if (l->fd == 0 || link_large(sz)) {
+		SPIN_UNLOCK(l)
+		return 1;
+	}
+	int kick = link_append(l, source, destination, session, msg, sz);
+	SPIN_UNLOCK(l)
+
+	if (kick) {
+		skynet_context_send(REMOTE, NULL, 0, 0, PTYPE_HARBOR, harbor_id);
+	}
+	return 0;
+}
+
+void
+skynet_harbor_link_done(int harbor_id) {
+	struct harbor_link * l = &LINK[harbor_id];
+	SPIN_LOCK(l)
+	--l->pending;
+	SPIN_UNLOCK(l)
+}
+
+void
+skynet_harbor_link_enable() {
+	DIRECT = 1;
+}
+
 
 
 //Զ̷Ϣ
@@ -24,9 +143,52 @@ skynet_harbor_send(struct remote_message *rmsg, uint32_t source, int session) {
 	rmsg->sz &= MESSAGE_TYPE_MASK;
 	assert(type != PTYPE_SYSTEM && type != PTYPE_HARBOR && REMOTE);
 
+	uint32_t handle = rmsg->destination.handle;
+	if (handle) {
+		uint32_t destination = (handle & HANDLE_MASK) | ((uint32_t)type << HANDLE_REMOTE_SHIFT);
+		if (skynet_harbor_link_send(handle >> HANDLE_REMOTE_SHIFT, source, destination, session, rmsg->message, rmsg->sz) == 0) {
+			skynet_free((void *)rmsg->message);
+			skynet_free(rmsg);
+			return;
+		}
+	}
+
 	skynet_context_send(REMOTE, rmsg, sizeof(*rmsg) , source, type , session);
 }
 
+void
+skynet_harbor_link(int harbor_id, int fd) {
+	struct harbor_link * l = &LINK[harbor_id];
+	SPIN_LOCK(l)
+	l->fd = fd;
+	if (fd == 0) {
+		skynet_free(l->buffer);
+		l->buffer = NULL;
+		l->size = 0;
+		l->cap = 0;
+	}
+	SPIN_UNLOCK(l)
+}
+
+void
+skynet_harbor_link_flush(int harbor_id) {
+	struct harbor_link * l = &LINK[harbor_id];
+	SPIN_LOCK(l)
+	int fd = l->fd;
+	void * buffer = l->buffer;
+	int sz = l->size;
+	l->buffer = NULL;
+	l->size = 0;
+	l->cap = 0;
+	SPIN_UNLOCK(l)
+	if (sz > 0) {
+		// ignore send error, the harbor service will recv the close message of the broken link.
+		skynet_socket_send(REMOTE, fd, buffer, sz);
+	} else {
+		skynet_free(buffer);
+	}
+}
+
 
 //жϢǲԶ
 int 
@@ -45,6 +207,11 @@ skynet_harbor_init(int harbor) {
 	//߰λҶԶͨŵ harbor
 	//                   HANDLE_REMOTE_SHIFT 24   harbor24λ
 	HARBOR = (unsigned int)harbor << HANDLE_REMOTE_SHIFT;
+
+	int i;
+	for (i=0;i<REMOTE_MAX;i++) {
+		SPIN_INIT(&LINK[i])
+	}
 }
 
 void
@@ -59,6 +226,11 @@ skynet_harbor_start(void *ctx) {
 void
 skynet_harbor_exit() {
 	struct skynet_context * ctx = REMOTE;
+	int i;
+	for (i=0;i<REMOTE_MAX;i++) {
+		skynet_harbor_link(i, 0);
+		SPIN_DESTROY(&LINK[i])
+	}
 	REMOTE= NULL;
 	if (ctx) {
 		skynet_context_release(ctx);
@@ -33,6 +33,22 @@ void skynet_harbor_init(int harbor);
 
 void skynet_harbor_start(void * ctx);
 
+// harbor link for direct sending, used by the harbor service (harbor_direct = true in config)
+// set the socket of the link (0 : unlink)
+void skynet_harbor_link(int harbor_id, int fd);
+// the harbor service uses the links (harbor_direct = true), the messages to harbor service are counted since then
+void skynet_harbor_link_enable();
+// append a package to the buffer of the link by a worker, returns 1 if it should go through the harbor service
+// (not linked, too large, or the messages before it are in the harbor service), and the message is counted
+int skynet_harbor_link_send(int harbor_id, uint32_t source, uint32_t destination, int session, const void * msg, size_t sz);
+// append a package to the buffer of the link by the harbor service, returns 1 if the harbor is not linked (or too large)
+// queued : the message is counted by skynet_harbor_link_send, it's not pending any more
+int skynet_harbor_link_push(int harbor_id, int queued, uint32_t source, uint32_t destination, int session, const void * msg, size_t sz);
+// the message counted by skynet_harbor_link_send is not sent by the link (local, dropped, or queued for connecting)
+void skynet_harbor_link_done(int harbor_id);
+// send the buffer of the link, when the harbor service recv the PTYPE_HARBOR message without data
+void skynet_harbor_link_flush(int harbor_id);
+
 void skynet_harbor_exit();
 
 #endif
@@ -186,6 +186,17 @@ struct socket_message {
 	case SOCKET_UDP:
 		forward_message(SKYNET_SOCKET_TYPE_UDP, false, &result);
 		break;
+
+	//ͻˮλ / ˮλ
+	case SOCKET_WARNING:
+		forward_message(SKYNET_SOCKET_TYPE_WARNING, false, &result);
+		break;
+	case SOCKET_DRAIN:
+		forward_message(SKYNET_SOCKET_TYPE_DRAIN, false, &result);
+		break;
+	case SOCKET_FRAME:
+		forward_message(SKYNET_SOCKET_TYPE_FRAME, false, &result);
+		break;
 	default:
 		skynet_error(NULL, "Unknown socket message type %d.",type);
 		return -1;
@@ -238,12 +249,46 @@ skynet_socket_send_lowpriority(struct skynet_context *ctx, int id, void *buffer,
 	socket_server_send_lowpriority(SOCKET_SERVER, id, buffer, sz);
 }
 
+//M Ӧĵsend_multi() ׽ֹͬһͻ
+void
+skynet_socket_send_multi(struct skynet_context *ctx, const int *id, int n, void *buffer, int sz) {
+	socket_server_send_multi(SOCKET_SERVER, id, n, buffer, sz);
+}
+
+//VӦĵsendv_socket() ݿΪһ(writev)
+int
+skynet_socket_sendv(struct skynet_context *ctx, int id, const struct skynet_socket_piece *piece, int n) {
+	struct socket_sendpiece tmp[n > 0 ? n : 1];
+	int i;
+	for (i=0;i<n;i++) {
+		tmp[i].buffer = piece[i].buffer;
+		tmp[i].sz = piece[i].sz;
+		tmp[i].own = piece[i].own;
+	}
+	int64_t wsz = socket_server_sendv(SOCKET_SERVER, id, tmp, n);
+	return check_wsz(ctx, id, NULL, wsz);
+}
+
+//ļ Ӧĵ sendfile_socket(), F, fdsocket̹߳ر
+int
+skynet_socket_sendfile(struct skynet_context *ctx, int id, int fd, int64_t offset, int sz) {
+	int64_t wsz = socket_server_sendfile(SOCKET_SERVER, id, fd, offset, sz);
+	return check_wsz(ctx, id, NULL, wsz);
+}
+
 //socket()  bind()  listen()  socket   ûм뵽epollй
 int 
 skynet_socket_listen(struct skynet_context *ctx, const char *host, int port, int backlog) {
 	uint32_t source = skynet_context_handle(ctx);
 	//socket()  bind()  listen()  socket   ûм뵽epollй
-	return socket_server_listen(SOCKET_SERVER, source, host, port, backlog);
+	return socket_server_listen(SOCKET_SERVER, source, host, port, backlog, 0);
+}
+
+//ͬ, SO_REUSEPORT, Լͬһַ, ں˷
+int 
+skynet_socket_listen_reuseport(struct skynet_context *ctx, const char *host, int port, int backlog) {
+	uint32_t source = skynet_context_handle(ctx);
+	return socket_server_listen(SOCKET_SERVER, source, host, port, backlog, 1);
 }
 
 //  Ӧĵ open_socket() ܵO 
@@ -301,6 +346,34 @@ skynet_socket_nodelay(struct skynet_context *ctx, int id) {
 	socket_server_nodelay(SOCKET_SERVER, id);
 }
 
+//'W'
+//Ӧĵwatermark_socket ÷ͻĸߵˮλ
+void
+skynet_socket_watermark(struct skynet_context *ctx, int id, int64_t high, int64_t low, int policy) {
+	socket_server_watermark(SOCKET_SERVER, id, high, low, policy);
+}
+
+//'H'
+//Ӧĵframe_socket socket߳аͷְ
+void
+skynet_socket_frame(struct skynet_context *ctx, int id, int header, int max) {
+	socket_server_frame(SOCKET_SERVER, id, header, max);
+}
+
+//ֱӶȡsocketķͳ, ܵ
+int
+skynet_socket_stat(struct skynet_context *ctx, int id, struct skynet_socket_stat *stat) {
+	struct socket_stat s;
+	if (socket_server_stat(SOCKET_SERVER, id, &s)) {
+		return -1;
+	}
+	stat->send_bytes = s.send_bytes;
+	stat->send_count = s.send_count;
+	stat->wb_size = s.wb_size;
+	stat->frame_read = s.frame_read;
+	return 0;
+}
+
 
 
 //'U'
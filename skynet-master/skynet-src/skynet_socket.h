@@ -1,6 +1,8 @@
 #ifndef skynet_socket_h
 #define skynet_socket_h
 
+#include <stdint.h>
+
 struct skynet_context;
 
 #define SKYNET_SOCKET_TYPE_DATA 1
@@ -10,6 +12,8 @@ struct skynet_context;
 #define SKYNET_SOCKET_TYPE_ERROR 5
 #define SKYNET_SOCKET_TYPE_UDP 6
 #define SKYNET_SOCKET_TYPE_WARNING 7
+#define SKYNET_SOCKET_TYPE_DRAIN 8
+#define SKYNET_SOCKET_TYPE_FRAME 9
 
 
 // skynetsocketϢṹ
@@ -22,6 +26,21 @@ struct skynet_socket_message {
 	char * buffer;
 };
 
+// a piece of skynet_socket_sendv, see socket_server_sendv
+struct skynet_socket_piece {
+	const void * buffer;
+	int sz;
+	int own;	// 1 : buffer (malloc by skynet_malloc) is freed after sending, 0 : buffer is copied
+};
+
+// socketķͳ see skynet_socket_stat
+struct skynet_socket_stat {
+	uint64_t send_bytes;
+	uint64_t send_count;
+	int64_t wb_size;
+	int frame_read;
+};
+
 void skynet_socket_init();
 void skynet_socket_exit();
 void skynet_socket_free();
@@ -29,13 +48,23 @@ int skynet_socket_poll();
 
 int skynet_socket_send(struct skynet_context *ctx, int id, void *buffer, int sz);
 void skynet_socket_send_lowpriority(struct skynet_context *ctx, int id, void *buffer, int sz);
+void skynet_socket_send_multi(struct skynet_context *ctx, const int *id, int n, void *buffer, int sz);
+int skynet_socket_sendv(struct skynet_context *ctx, int id, const struct skynet_socket_piece *piece, int n);
+int skynet_socket_sendfile(struct skynet_context *ctx, int id, int fd, int64_t offset, int sz);
 int skynet_socket_listen(struct skynet_context *ctx, const char *host, int port, int backlog);
+int skynet_socket_listen_reuseport(struct skynet_context *ctx, const char *host, int port, int backlog);
 int skynet_socket_connect(struct skynet_context *ctx, const char *host, int port);
 int skynet_socket_bind(struct skynet_context *ctx, int fd);
 void skynet_socket_close(struct skynet_context *ctx, int id);
 void skynet_socket_shutdown(struct skynet_context *ctx, int id);
 void skynet_socket_start(struct skynet_context *ctx, int id);
 void skynet_socket_nodelay(struct skynet_context *ctx, int id);
+// policy : SOCKET_WATERMARK_PAUSE(0) / DROP(1) / CLOSE(2) , see socket_server.h
+void skynet_socket_watermark(struct skynet_context *ctx, int id, int64_t high, int64_t low, int policy);
+// header : 2 or 4 (big-endian size), 0 turns off. see socket_server_frame
+void skynet_socket_frame(struct skynet_context *ctx, int id, int header, int max);
+// read the send counters and the write buffer size of a socket, return -1 when the id is invalid
+int skynet_socket_stat(struct skynet_context *ctx, int id, struct skynet_socket_stat *stat);
 
 int skynet_socket_udp(struct skynet_context *ctx, const char * addr, int port);
 int skynet_socket_udp_connect(struct skynet_context *ctx, int id, const char * addr, int port);
@@ -10,6 +10,14 @@
 #include <arpa/inet.h>
 #include <fcntl.h>
 
+// Define SOCKET_EDGE_TRIGGER to use edge triggered epoll, socket_server drains a socket
+// at each event and calls sp_enable to re-arm it when it stops before EAGAIN.
+#ifdef SOCKET_EDGE_TRIGGER
+#define SP_EVENT_MODE EPOLLET
+#else
+#define SP_EVENT_MODE 0
+#endif
+
 //ǷЧ
 static bool 
 sp_invalid(int efd) {
@@ -32,7 +40,7 @@ sp_release(int efd) {
 static int 
 sp_add(int efd, int sock, void *ud) {
 	struct epoll_event ev;
-	ev.events = EPOLLIN;
+	ev.events = EPOLLIN | SP_EVENT_MODE;
 	ev.data.ptr = ud;
 	if (epoll_ctl(efd, EPOLL_CTL_ADD, sock, &ev) == -1) {
 		return 1;
@@ -47,11 +55,11 @@ sp_del(int efd, int sock) {
 	epoll_ctl(efd, EPOLL_CTL_DEL, sock , NULL);
 }
 
-//enableжǷEPOLLOUT¼
+//read_enable,write_enableжǷEPOLLIN,EPOLLOUT¼
 static void 
-sp_write(int efd, int sock, void *ud, bool enable) {
+sp_enable(int efd, int sock, void *ud, bool read_enable, bool write_enable) {
 	struct epoll_event ev;
-	ev.events = EPOLLIN | (enable ? EPOLLOUT : 0);
+	ev.events = (read_enable ? EPOLLIN : 0) | (write_enable ? EPOLLOUT : 0) | SP_EVENT_MODE;
 	ev.data.ptr = ud;
 	epoll_ctl(efd, EPOLL_CTL_MOD, sock, &ev);
 }
@@ -56,10 +56,11 @@ sp_add(int kfd, int sock, void *ud) {
 }
 
 static void 
-sp_write(int kfd, int sock, void *ud, bool enable) {
-	struct kevent ke;
-	EV_SET(&ke, sock, EVFILT_WRITE, enable ? EV_ENABLE : EV_DISABLE, 0, 0, ud);
-	if (kevent(kfd, &ke, 1, NULL, 0, NULL) == -1) {
+sp_enable(int kfd, int sock, void *ud, bool read_enable, bool write_enable) {
+	struct kevent ke[2];
+	EV_SET(&ke[0], sock, EVFILT_READ, read_enable ? EV_ENABLE : EV_DISABLE, 0, 0, ud);
+	EV_SET(&ke[1], sock, EVFILT_WRITE, write_enable ? EV_ENABLE : EV_DISABLE, 0, 0, ud);
+	if (kevent(kfd, ke, 2, NULL, 0, NULL) == -1) {
 		// todo: check error
 	}
 }
@@ -1,3 +1,7 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE	// for recvmmsg / sendmmsg
+#endif
+
 #include "skynet.h"
 
 #include "socket_server.h"
@@ -6,6 +10,7 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/tcp.h>
 #include <unistd.h>
 #include <errno.h>
@@ -15,15 +20,33 @@
 #include <stdint.h>
 #include <assert.h>
 #include <string.h>
+#include <limits.h>
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
 
 #define MAX_INFO 128
 // MAX_SOCKET will be 2^MAX_SOCKET_P
 #define MAX_SOCKET_P 16
 
+#ifndef MAX_EVENT
 #define MAX_EVENT 64		// epoll_waitĵÿepollص¼
+#endif
 
 #define MIN_READ_BUFFER 64	// readСĻС
 
+// size class i of the read pool holds buffers of MIN_READ_BUFFER << i bytes
+#define READ_POOL_CLASS 16
+#define READ_POOL_SLOT 4
+#define READ_POOL_LIMIT (1024 * 1024)	// max bytes cached by the read pool
+#define MAX_READ_BUFFER (MIN_READ_BUFFER << (READ_POOL_CLASS-1))
+
+// In edge trigger mode, a socket reads at most READ_BUDGET bytes per wake-up
+#ifndef READ_BUDGET
+#define READ_BUDGET (256 * 1024)
+#endif
+
 #define SOCKET_TYPE_INVALID 0 	//Ч׽
 
 #define SOCKET_TYPE_RESERVE 1	// Ԥѱ룬Ͷʹ
@@ -59,6 +82,10 @@
 //udpbuffer С
 #define MAX_UDP_PACKAGE 65535
 
+#ifdef __linux__
+#define UDP_BATCH 16	// datagrams per recvmmsg / sendmmsg
+#endif
+
 // EAGAIN and EWOULDBLOCK may be not the same value.
 #if (EAGAIN != EWOULDBLOCK)
 #define AGAIN_WOULDBLOCK EAGAIN : case EWOULDBLOCK
@@ -78,6 +105,16 @@ struct write_buffer {
 	//Ƿʹ struct socket_object_interface soi;
 	bool userobject;
 
+	// sendfile : fd of the file (-1 for memory buffer), sz bytes from offset
+	int file;
+	int64_t offset;
+
+	// the buffer shared by socket_server_send_multi, NULL for others
+	struct multi_buffer *multi;
+
+	// the pieces of socket_server_sendv, NULL for others
+	struct send_vector *vector;
+
 	//udp_addressС			16+2+1
 	//Ҫ͵ĵַϢ
 	uint8_t udp_address[UDP_ADDRESS_SIZE];
@@ -126,6 +163,28 @@ struct socket {
 	
 	uint16_t type;		//socket״̬(д......)
 
+	bool reading;		// EPOLLIN is enabled
+	bool writing;		// EPOLLOUT is enabled
+	bool accept_blocked;	// the listen socket stops reading when no fd or id is available, see accept_block
+
+	// write buffer watermarks, wb_high == 0 means no limit. see check_watermark
+	uint8_t wb_policy;
+	bool wb_over;		// wb_size reached wb_high, waiting for drain
+	int64_t wb_high;
+	int64_t wb_low;
+
+	// bytes and packages accepted by send, see socket_server_stat
+	uint64_t send_bytes;
+	uint64_t send_count;
+
+	// packet framing, frame_header == 0 means no framing. see forward_frame
+	uint8_t frame_header;	// size of the big-endian length header, 2 or 4
+	uint8_t frame_head[4];	// the incomplete header
+	int frame_max;		// max size of one packet (header excluded)
+	int frame_read;		// bytes read of the incomplete packet
+	int frame_need;		// size of the incomplete packet (header included)
+	char * frame_pending;	// the incomplete packet, NULL while reading the header
+
 	union {
 				
 		int size;  //ԤƵĴС		
@@ -134,6 +193,16 @@ struct socket {
 	} p;
 };
 
+// Read buffers are owned by the socket thread until they are forwarded.
+// Buffers not forwarded (EAGAIN, close, half close) go back to the pool.
+struct read_pool {
+	int n[READ_POOL_CLASS];
+	int bytes;
+	void * slot[READ_POOL_CLASS][READ_POOL_SLOT];
+};
+
+struct udp_batch;
+
 
 // socketֵĳ,socket
 struct socket_server {
@@ -167,6 +236,11 @@ struct socket_server {
 	char buffer[MAX_INFO];				// ʱݣ籣½ӵĶԵȶ˵ĵַϢ
 	
 	uint8_t udpbuffer[MAX_UDP_PACKAGE];
+
+	struct read_pool rpool;
+	struct udp_batch *udp;	// recvmmsg buffers, created at the first udp read
+	struct multi_buffer *multi;	// the send_multi request in progress
+	int accept_blocked;	// the number of the listen sockets blocked, see accept_block
 	
 	fd_set rfds;		// selectfd
 };
@@ -239,6 +313,66 @@ struct request_udp {
 	uintptr_t opaque;
 };
 
+struct request_watermark {
+	int id;
+	int policy;
+	int64_t high;
+	int64_t low;
+};
+
+struct request_sendfile {
+	int id;
+	int fd;
+	int64_t offset;
+	int sz;
+};
+
+struct request_frame {
+	int id;
+	int header;
+	int max;
+};
+
+/*
+	One buffer sent to n sockets. The socket thread owns it after the 'M' request,
+	every write_buffer referencing it holds a ref, and the request itself holds one
+	until all the sockets are handled.
+ */
+struct multi_buffer {
+	int ref;
+	int sz;
+	void * buffer;
+	int n;
+	int index;	// the next socket to send
+	int id[1];
+};
+
+struct request_send_multi {
+	struct multi_buffer *multi;
+};
+
+// writev at most MAX_SEND_IOV pieces once
+#define MAX_SEND_IOV 64
+
+/*
+	The buffer of socket_server_sendv, one block : the struct, iov[n], own[nown] and the copied pieces.
+	iov[index] is the first piece not sent (iov_base/iov_len are moved after a partial write),
+	own[] are the pieces freed after sending.
+ */
+struct send_vector {
+	int n;
+	int index;
+	int nown;
+	void ** own;
+	struct iovec iov[1];
+};
+
+struct request_sendv {
+	int id;
+	int sz;
+	struct send_vector *vector;
+};
+
 /*
 	The first byte is TYPE
 
@@ -254,6 +388,10 @@ struct request_udp {
 	T Set opt
 	U Create UDP socket
 	C set udp address
+	W Set write buffer watermark
+	F Send file
+	H Set packet framing
+	M Send a package to multiple sockets
  */
 
 
@@ -277,6 +415,11 @@ struct request_package {
 		struct request_setopt setopt;
 		struct request_udp udp;
 		struct request_setudp set_udp;
+		struct request_watermark watermark;
+		struct request_sendfile sendfile;
+		struct request_sendv sendv;
+		struct request_frame frame;
+		struct request_send_multi send_multi;
 	} u;
 	uint8_t dummy[256];
 };
@@ -288,6 +431,17 @@ union sockaddr_all {
 	struct sockaddr_in6 v6;
 };
 
+#ifdef UDP_BATCH
+struct udp_batch {
+	int id;		// socket id of the pending datagrams
+	int n;
+	int index;
+	struct mmsghdr msg[UDP_BATCH];
+	struct iovec iov[UDP_BATCH];
+	union sockaddr_all addr[UDP_BATCH];
+	uint8_t buffer[UDP_BATCH][MAX_UDP_PACKAGE];
+};
+#endif
 
 struct send_object {
 	void * buffer;
@@ -297,6 +451,7 @@ struct send_object {
 
 // ϻ #define skynet_malloc malloc
 #define MALLOC skynet_malloc
+#define REALLOC skynet_realloc
 #define FREE skynet_free
 
 
@@ -316,6 +471,48 @@ send_object_init(struct socket_server *ss, struct send_object *so, void *object,
 	}
 }
 
+// only the socket thread touches the ref after the 'M' request, it needn't be atomic
+static void
+multi_buffer_release(struct multi_buffer *m) {
+	if (--m->ref == 0) {
+		FREE(m->buffer);
+		FREE(m);
+	}
+}
+
+static void
+send_vector_free(struct send_vector *v) {
+	int i;
+	for (i=0;i<v->nown;i++) {
+		FREE(v->own[i]);
+	}
+	FREE(v);
+}
+
+// writev the pieces not sent, and skip the bytes written
+static int
+write_vector(int fd, struct send_vector *v) {
+	int n = v->n - v->index;
+	if (n > MAX_SEND_IOV) {
+		n = MAX_SEND_IOV;
+	}
+	int sz = writev(fd, v->iov + v->index, n);
+	if (sz > 0) {
+		size_t left = sz;
+		while (left > 0) {
+			struct iovec *iov = &v->iov[v->index];
+			if (left < iov->iov_len) {
+				iov->iov_base = (char *)iov->iov_base + left;
+				iov->iov_len -= left;
+				break;
+			}
+			left -= iov->iov_len;
+			++v->index;
+		}
+	}
+	return sz;
+}
+
 //ͷһͻڵ
 static inline void
 write_buffer_free(struct socket_server *ss, struct write_buffer *wb) {
@@ -326,9 +523,63 @@ write_buffer_free(struct socket_server *ss, struct write_buffer *wb) {
 	} else {
 		FREE(wb->buffer);
 	}
+	if (wb->file >= 0) {
+		close(wb->file);
+	}
+	if (wb->multi) {
+		multi_buffer_release(wb->multi);
+	}
+	if (wb->vector) {
+		send_vector_free(wb->vector);
+	}
 	FREE(wb);
 }
 
+static inline int
+read_pool_class(int sz) {
+	int c = 0;
+	while ((MIN_READ_BUFFER << c) < sz) {
+		++c;
+	}
+	return c;
+}
+
+// sz must be a size class (MIN_READ_BUFFER << n)
+static void *
+read_buffer_alloc(struct socket_server *ss, int sz) {
+	struct read_pool *rp = &ss->rpool;
+	int c = read_pool_class(sz);
+	if (rp->n[c] > 0) {
+		rp->bytes -= sz;
+		return rp->slot[c][--rp->n[c]];
+	}
+	return MALLOC(sz);
+}
+
+static void
+read_buffer_release(struct socket_server *ss, void *buffer, int sz) {
+	struct read_pool *rp = &ss->rpool;
+	int c = read_pool_class(sz);
+	if (rp->n[c] < READ_POOL_SLOT && rp->bytes + sz <= READ_POOL_LIMIT) {
+		rp->slot[c][rp->n[c]++] = buffer;
+		rp->bytes += sz;
+	} else {
+		FREE(buffer);
+	}
+}
+
+static void
+read_pool_clear(struct read_pool *rp) {
+	int i,j;
+	for (i=0;i<READ_POOL_CLASS;i++) {
+		for (j=0;j<rp->n[i];j++) {
+			FREE(rp->slot[i][j]);
+		}
+		rp->n[i] = 0;
+	}
+	rp->bytes = 0;
+}
+
 
 //ʵ
 static void
@@ -446,6 +697,10 @@ socket_server_create() {
 	ss->event_n = 0;
 	ss->event_index = 0;
 	memset(&ss->soi, 0, sizeof(ss->soi));
+	memset(&ss->rpool, 0, sizeof(ss->rpool));
+	ss->udp = NULL;
+	ss->multi = NULL;
+	ss->accept_blocked = 0;
 
 	//select 輯Ϊ0
 	FD_ZERO(&ss->rfds);
@@ -470,6 +725,44 @@ free_wb_list(struct socket_server *ss, struct wb_list *list) {
 	list->tail = NULL;
 }
 
+// drop the incomplete packet of a framing socket
+static void
+frame_reset(struct socket *s) {
+	FREE(s->frame_pending);
+	s->frame_pending = NULL;
+	s->frame_read = 0;
+	s->frame_need = 0;
+}
+
+/*
+	accept fails by EMFILE/ENFILE or no socket id, and the connection is still in the backlog.
+	The listen socket stops reading (or the event is reported again and again), and it's resumed
+	when a socket is closed. In edge triggered mode, sp_enable re-arms it for the pending connections.
+ */
+static void
+accept_block(struct socket_server *ss, struct socket *s) {
+	if (!s->accept_blocked) {
+		s->accept_blocked = true;
+		++ss->accept_blocked;
+	}
+	s->reading = false;
+	sp_enable(ss->event_fd, s->fd, s, false, s->writing);
+}
+
+static void
+accept_resume(struct socket_server *ss) {
+	int i;
+	for (i=0;i<MAX_SOCKET && ss->accept_blocked > 0;i++) {
+		struct socket *s = &ss->slot[i];
+		if (s->accept_blocked) {
+			s->accept_blocked = false;
+			--ss->accept_blocked;
+			s->reading = true;
+			sp_enable(ss->event_fd, s->fd, s, true, s->writing);
+		}
+	}
+}
+
 
 //ǿƹر׽,socket_serverжӦ struct socket *s  resultǴ봫
 static void
@@ -491,6 +784,7 @@ force_close(struct socket_server *ss, struct socket *s, struct socket_message *r
 	//ٷͻ
 	free_wb_list(ss,&s->high);
 	free_wb_list(ss,&s->low);
+	frame_reset(s);
 
 
 	//SOCKET_TYPE_PACCEPT   SOCKET_TYPE_PLISTENδ뵽epollй
@@ -510,6 +804,15 @@ force_close(struct socket_server *ss, struct socket *s, struct socket_message *r
 
 	//״̬Ϊδʹ
 	s->type = SOCKET_TYPE_INVALID;
+
+	if (s->accept_blocked) {
+		s->accept_blocked = false;
+		--ss->accept_blocked;
+	}
+	if (ss->accept_blocked > 0) {
+		// a fd and an id are free now
+		accept_resume(ss);
+	}
 }
 
 
@@ -538,11 +841,29 @@ socket_server_release(struct socket_server *ss) {
 	// close() ر epoll
 	sp_release(ss->event_fd);
 
+	read_pool_clear(&ss->rpool);
+	FREE(ss->udp);
+	if (ss->multi) {
+		multi_buffer_release(ss->multi);
+	}
+
 	//free
 	FREE(ss);
 }
 
 
+static inline void
+enable_read(struct socket_server *ss, struct socket *s, bool enable) {
+	s->reading = enable;
+	sp_enable(ss->event_fd, s->fd, s, enable, s->writing);
+}
+
+static inline void
+enable_write(struct socket_server *ss, struct socket *s, bool enable) {
+	s->writing = enable;
+	sp_enable(ss->event_fd, s->fd, s, s->reading, enable);
+}
+
 //ԷͻΪ
 static inline void
 check_wb_list(struct wb_list *s) {
@@ -585,6 +906,21 @@ new_fd(struct socket_server *ss, int id, int fd, int protocol, uintptr_t opaque,
 	//ͻδݵĴС
 	s->wb_size = 0;
 
+	s->reading = true;
+	s->writing = false;
+	s->accept_blocked = false;
+	s->wb_policy = SOCKET_WATERMARK_PAUSE;
+	s->wb_over = false;
+	s->wb_high = 0;
+	s->wb_low = 0;
+	s->send_bytes = 0;
+	s->send_count = 0;
+	s->frame_header = 0;
+	s->frame_max = 0;
+	s->frame_read = 0;
+	s->frame_need = 0;
+	s->frame_pending = NULL;
+
 	//Ϊ
 	check_wb_list(&s->high);
 	check_wb_list(&s->low);
@@ -694,7 +1030,7 @@ open_socket(struct socket_server *ss, struct request_open * request, struct sock
 		//˵׽ֳ
 		ns->type = SOCKET_TYPE_CONNECTING;
 		//׽ֳУעд¼Ժepollܲӳ˻ǳɹ
-		sp_write(ss->event_fd, ns->fd, ns, true);
+		enable_write(ss, ns, true);
 	}
 
 	freeaddrinfo( ai_list );
@@ -705,6 +1041,37 @@ _failed:
 	return SOCKET_ERROR;
 }
 
+// send at most sz bytes of file from *offset, return the bytes sent or -1 (see errno)
+static int
+send_file(struct socket_server *ss, int fd, int file, int64_t *offset, int sz) {
+	int n;
+#ifdef __linux__
+	off_t off = (off_t)*offset;
+	n = (int)sendfile(fd, file, &off, sz);
+	if (n > 0) {
+		*offset = off;
+	}
+#else
+	// no portable sendfile, copy a piece through the udp buffer of socket thread
+	if (sz > MAX_UDP_PACKAGE) {
+		sz = MAX_UDP_PACKAGE;
+	}
+	n = (int)pread(file, ss->udpbuffer, sz, (off_t)*offset);
+	if (n > 0) {
+		n = write(fd, ss->udpbuffer, n);
+		if (n > 0) {
+			*offset += n;
+		}
+	}
+#endif
+	if (n == 0) {
+		// the file is shorter than the request (truncated)
+		errno = EIO;
+		return -1;
+	}
+	return n;
+}
+
 //ͻеݷ tcp
 //resultǴ
 static int
@@ -716,7 +1083,18 @@ send_list_tcp(struct socket_server *ss, struct socket *s, struct wb_list *list,
 		for (;;) {
 
 			////tmp->szʾýδ͵ݴС
-			int sz = write(s->fd, tmp->ptr, tmp->sz);
+			int sz;
+			// the pieces sent by this writev (at most MAX_SEND_IOV)
+			int batch = 0;
+			if (tmp->file >= 0) {
+				sz = send_file(ss, s->fd, tmp->file, &tmp->offset, tmp->sz);
+			} else if (tmp->vector) {
+				batch = tmp->vector->index;
+				sz = write_vector(s->fd, tmp->vector);
+				batch = tmp->vector->index - batch;
+			} else {
+				sz = write(s->fd, tmp->ptr, tmp->sz);
+			}
 			
 			if (sz < 0) {
 				switch(errno) {
@@ -735,9 +1113,14 @@ send_list_tcp(struct socket_server *ss, struct socket *s, struct wb_list *list,
 
 			//tmp->szʾýδ͵
 			if (sz != tmp->sz) {
-				
-				tmp->ptr += sz;
+				if (tmp->file < 0 && tmp->vector == NULL) {
+					tmp->ptr += sz;
+				}
 				tmp->sz -= sz;
+				if (batch == MAX_SEND_IOV) {
+					// a full batch, the socket may be still writable (no more EPOLLOUT edge), write again until EAGAIN
+					continue;
+				}
 				return -1;
 			}
 			
@@ -801,6 +1184,57 @@ udp_socket_address(struct socket *s, const uint8_t udp_address[UDP_ADDRESS_SIZE]
 
 
 
+#ifdef UDP_BATCH
+
+// send the queued datagrams by sendmmsg, UDP_BATCH per syscall
+static int
+send_list_udp(struct socket_server *ss, struct socket *s, struct wb_list *list, struct socket_message *result) {
+	struct mmsghdr msg[UDP_BATCH];
+	struct iovec iov[UDP_BATCH];
+	union sockaddr_all sa[UDP_BATCH];
+	while (list->head) {
+		int n = 0;
+		struct write_buffer * tmp = list->head;
+		while (tmp && n < UDP_BATCH) {
+			memset(&msg[n].msg_hdr, 0, sizeof(msg[n].msg_hdr));
+			msg[n].msg_hdr.msg_name = &sa[n];
+			msg[n].msg_hdr.msg_namelen = udp_socket_address(s, tmp->udp_address, &sa[n]);
+			iov[n].iov_base = tmp->ptr;
+			iov[n].iov_len = tmp->sz;
+			msg[n].msg_hdr.msg_iov = &iov[n];
+			msg[n].msg_hdr.msg_iovlen = 1;
+			++n;
+			tmp = tmp->next;
+		}
+		int sent = sendmmsg(s->fd, msg, n, 0);
+		if (sent < 0) {
+			switch(errno) {
+			case EINTR:
+			case AGAIN_WOULDBLOCK:
+				return -1;
+			}
+			fprintf(stderr, "socket-server : udp (%d) sendto error %s.\n",s->id, strerror(errno));
+			return -1;
+		}
+		int i;
+		for (i=0;i<sent;i++) {
+			tmp = list->head;
+			s->wb_size -= tmp->sz;
+			list->head = tmp->next;
+			write_buffer_free(ss,tmp);
+		}
+		if (sent < n) {
+			// kernel buffer is full
+			return -1;
+		}
+	}
+	list->tail = NULL;
+
+	return -1;
+}
+
+#else
+
 //ӷͶ  sendto udp͵
 static int
 send_list_udp(struct socket_server *ss, struct socket *s, struct wb_list *list, struct socket_message *result) {
@@ -843,6 +1277,8 @@ send_list_udp(struct socket_server *ss, struct socket *s, struct wb_list *list,
 	return -1;
 }
 
+#endif
+
 
 //Эtcpudp ͻеݣ
 static int
@@ -899,6 +1335,70 @@ raise_uncomplete(struct socket * s) {
 	high->head = high->tail = tmp;
 }
 
+// free the low priority list, the head of low list is never sent a part (see raise_uncomplete)
+static void
+drop_low_list(struct socket_server *ss, struct socket *s) {
+	struct write_buffer *wb = s->low.head;
+	while (wb) {
+		struct write_buffer *tmp = wb;
+		wb = wb->next;
+		s->wb_size -= tmp->sz;
+		write_buffer_free(ss, tmp);
+	}
+	s->low.head = NULL;
+	s->low.tail = NULL;
+}
+
+/*
+	Call it after the write buffer grows. When wb_size goes over wb_high the first time :
+
+	SOCKET_WATERMARK_PAUSE : stop reading the socket, report SOCKET_WARNING.
+	SOCKET_WATERMARK_DROP : drop the low priority list and the low priority data sent before drain, report SOCKET_WARNING.
+	SOCKET_WATERMARK_CLOSE : close the socket and report SOCKET_ERROR.
+
+	The socket is marked wb_over until wb_size falls to wb_low (see report_drain).
+ */
+static int
+check_watermark(struct socket_server *ss, struct socket *s, struct socket_message *result) {
+	if (s->wb_high == 0 || s->wb_over || s->wb_size <= s->wb_high) {
+		return -1;
+	}
+	int sz = (int)(s->wb_size / 1024);
+	switch (s->wb_policy) {
+	case SOCKET_WATERMARK_CLOSE:
+		fprintf(stderr, "socket-server: write buffer of %d reach %d K, close it.\n", s->id, sz);
+		force_close(ss, s, result);
+		result->data = "write buffer overflow";
+		return SOCKET_ERROR;
+	case SOCKET_WATERMARK_DROP:
+		drop_low_list(ss, s);
+		break;
+	default:
+		enable_read(ss, s, false);
+		break;
+	}
+	s->wb_over = true;
+	result->opaque = s->opaque;
+	result->id = s->id;
+	result->ud = sz;
+	result->data = NULL;
+	return SOCKET_WARNING;
+}
+
+// wb_size falls to wb_low after wb_over, resume reading and report SOCKET_DRAIN
+static int
+report_drain(struct socket_server *ss, struct socket *s, struct socket_message *result) {
+	s->wb_over = false;
+	if (!s->reading) {
+		enable_read(ss, s, true);
+	}
+	result->opaque = s->opaque;
+	result->id = s->id;
+	result->ud = (int)(s->wb_size / 1024);
+	result->data = NULL;
+	return SOCKET_DRAIN;
+}
+
 /*
 	Each socket has two write buffer list, high priority and low priority.
 
@@ -940,7 +1440,7 @@ send_buffer(struct socket_server *ss, struct socket *s, struct socket_message *r
 			//ݷ
 			// step 4
 			//ٹעд¼עɶ¼
-			sp_write(ss->event_fd, s->fd, s, false);
+			enable_write(ss, s, false);
 
 			//֮ǰҪر׽֣׽ûзֻ꣬ǱҪرգ
 			//  ʱݷ  ֱǿƹر,׽
@@ -951,6 +1451,10 @@ send_buffer(struct socket_server *ss, struct socket *s, struct socket_message *r
 		}
 	}
 
+	if (s->wb_over && s->wb_size <= s->wb_low) {
+		return report_drain(ss, s, result);
+	}
+
 	return -1;
 }
 
@@ -970,6 +1474,10 @@ append_sendbuffer_(struct socket_server *ss, struct wb_list *s, struct request_s
 	buf->ptr = (char*)so.buffer+n;
 	buf->sz = so.sz - n;
 	buf->buffer = request->buffer;
+	buf->file = -1;
+	buf->offset = 0;
+	buf->multi = NULL;
+	buf->vector = NULL;
 	buf->next = NULL;
 
 	//ӽڵ뵽
@@ -1057,6 +1565,13 @@ send_socket(struct socket_server *ss, struct request_send * request, struct sock
 		return -1;
 	}
 
+	if (priority == PRIORITY_LOW && s->wb_over && s->wb_policy == SOCKET_WATERMARK_DROP) {
+		so.free_func(request->buffer);
+		return -1;
+	}
+	s->send_bytes += so.sz;
+	++s->send_count;
+
 	// Ӧò㻺 ûΪ     ֱӷ
 	if (send_buffer_empty(s) && s->type == SOCKET_TYPE_CONNECTED) {
 		if (s->protocol == PROTOCOL_TCP) {
@@ -1116,7 +1631,7 @@ send_socket(struct socket_server *ss, struct request_send * request, struct sock
 		}
 
 		//е˵ûз꣬Ҫעд¼
-		sp_write(ss->event_fd, s->fd, s, true);
+		enable_write(ss, s, true);
 
 		//Ӧò㻺ԭ,ֱӽҪ͵ӵ	
 	} else {
@@ -1131,9 +1646,225 @@ send_socket(struct socket_server *ss, struct request_send * request, struct sock
 			if (udp_address == NULL) {
 				udp_address = s->p.udp_address;
 			}
-			append_sendbuffer_udp(ss,s,priority,request,udp_address);
+			append_sendbuffer_udp(ss,s,priority,request,udp_address);
+		}
+	}
+	return check_watermark(ss, s, result);
+}
+
+/*
+	Send sz bytes of the file request->fd from request->offset, the socket thread owns the fd
+	and closes it after sending. It is queued in the high list like a package of send_socket.
+ */
+static int
+sendfile_socket(struct socket_server *ss, struct request_sendfile * request, struct socket_message *result) {
+	int id = request->id;
+	struct socket * s = &ss->slot[HASH_ID(id)];
+	if (s->type == SOCKET_TYPE_INVALID || s->id != id
+		|| s->type == SOCKET_TYPE_HALFCLOSE
+		|| s->type == SOCKET_TYPE_PACCEPT) {
+		close(request->fd);
+		return -1;
+	}
+	if (s->type == SOCKET_TYPE_PLISTEN || s->type == SOCKET_TYPE_LISTEN || s->protocol != PROTOCOL_TCP) {
+		fprintf(stderr, "socket-server: sendfile to non tcp stream %d.\n", id);
+		close(request->fd);
+		return -1;
+	}
+	s->send_bytes += request->sz;
+	++s->send_count;
+	int64_t offset = request->offset;
+	int n = 0;
+	if (send_buffer_empty(s) && s->type == SOCKET_TYPE_CONNECTED) {
+		n = send_file(ss, s->fd, request->fd, &offset, request->sz);
+		if (n < 0) {
+			switch(errno) {
+			case EINTR:
+			case AGAIN_WOULDBLOCK:
+				n = 0;
+				break;
+			default:
+				fprintf(stderr, "socket-server: sendfile to %d (fd=%d) error :%s.\n",id,s->fd,strerror(errno));
+				force_close(ss,s,result);
+				close(request->fd);
+				return SOCKET_CLOSE;
+			}
+		}
+		if (n == request->sz) {
+			close(request->fd);
+			return -1;
+		}
+		enable_write(ss, s, true);
+	}
+
+	struct write_buffer * buf = MALLOC(sizeof(*buf));
+	buf->next = NULL;
+	buf->buffer = NULL;
+	buf->ptr = NULL;
+	buf->sz = request->sz - n;
+	buf->userobject = false;
+	buf->file = request->fd;
+	buf->offset = offset;
+	buf->multi = NULL;
+	buf->vector = NULL;
+	struct wb_list *list = &s->high;
+	if (list->head == NULL) {
+		list->head = list->tail = buf;
+	} else {
+		list->tail->next = buf;
+		list->tail = buf;
+	}
+	s->wb_size += buf->sz;
+	return check_watermark(ss, s, result);
+}
+
+// queue the rest of a multi_buffer (from n) to the high list of s
+static void
+append_sendbuffer_multi(struct socket *s, struct multi_buffer *m, int n) {
+	struct write_buffer * buf = MALLOC(sizeof(*buf));
+	buf->next = NULL;
+	buf->buffer = NULL;
+	buf->ptr = (char *)m->buffer + n;
+	buf->sz = m->sz - n;
+	buf->userobject = false;
+	buf->file = -1;
+	buf->offset = 0;
+	buf->multi = m;
+	buf->vector = NULL;
+	++m->ref;
+	struct wb_list *list = &s->high;
+	if (list->head == NULL) {
+		list->head = list->tail = buf;
+	} else {
+		list->tail->next = buf;
+		list->tail = buf;
+	}
+	s->wb_size += buf->sz;
+}
+
+// send the shared buffer of m to the tcp socket id, like send_socket with PRIORITY_HIGH
+static int
+send_socket_multi(struct socket_server *ss, int id, struct multi_buffer *m, struct socket_message *result) {
+	struct socket * s = &ss->slot[HASH_ID(id)];
+	if (s->type == SOCKET_TYPE_INVALID || s->id != id
+		|| s->type == SOCKET_TYPE_HALFCLOSE
+		|| s->type == SOCKET_TYPE_PACCEPT
+		|| s->type == SOCKET_TYPE_PLISTEN
+		|| s->type == SOCKET_TYPE_LISTEN
+		|| s->protocol != PROTOCOL_TCP) {
+		return -1;
+	}
+	s->send_bytes += m->sz;
+	++s->send_count;
+	if (send_buffer_empty(s) && s->type == SOCKET_TYPE_CONNECTED) {
+		int n = write(s->fd, m->buffer, m->sz);
+		if (n<0) {
+			switch(errno) {
+			case EINTR:
+			case AGAIN_WOULDBLOCK:
+				n = 0;
+				break;
+			default:
+				fprintf(stderr, "socket-server: write to %d (fd=%d) error :%s.\n",id,s->fd,strerror(errno));
+				force_close(ss,s,result);
+				return SOCKET_CLOSE;
+			}
+		}
+		if (n == m->sz) {
+			return -1;
+		}
+		append_sendbuffer_multi(s, m, n);
+		enable_write(ss, s, true);
+	} else {
+		append_sendbuffer_multi(s, m, 0);
+	}
+	return check_watermark(ss, s, result);
+}
+
+// queue the rest of a send_vector (n bytes of sz are written) to the high list of s
+static void
+append_sendbuffer_vector(struct socket *s, struct send_vector *v, int sz, int n) {
+	struct write_buffer * buf = MALLOC(sizeof(*buf));
+	buf->next = NULL;
+	buf->buffer = NULL;
+	buf->ptr = NULL;
+	buf->sz = sz - n;
+	buf->userobject = false;
+	buf->file = -1;
+	buf->offset = 0;
+	buf->multi = NULL;
+	buf->vector = v;
+	struct wb_list *list = &s->high;
+	if (list->head == NULL) {
+		list->head = list->tail = buf;
+	} else {
+		list->tail->next = buf;
+		list->tail = buf;
+	}
+	s->wb_size += buf->sz;
+}
+
+// send the pieces of request->vector like one buffer of send_socket with PRIORITY_HIGH
+static int
+sendv_socket(struct socket_server *ss, struct request_sendv * request, struct socket_message *result) {
+	int id = request->id;
+	struct send_vector *v = request->vector;
+	struct socket * s = &ss->slot[HASH_ID(id)];
+	if (s->type == SOCKET_TYPE_INVALID || s->id != id
+		|| s->type == SOCKET_TYPE_HALFCLOSE
+		|| s->type == SOCKET_TYPE_PACCEPT) {
+		send_vector_free(v);
+		return -1;
+	}
+	if (s->type == SOCKET_TYPE_PLISTEN || s->type == SOCKET_TYPE_LISTEN || s->protocol != PROTOCOL_TCP) {
+		fprintf(stderr, "socket-server: sendv to non tcp stream %d.\n", id);
+		send_vector_free(v);
+		return -1;
+	}
+	s->send_bytes += request->sz;
+	++s->send_count;
+	if (send_buffer_empty(s) && s->type == SOCKET_TYPE_CONNECTED) {
+		int n = write_vector(s->fd, v);
+		if (n<0) {
+			switch(errno) {
+			case EINTR:
+			case AGAIN_WOULDBLOCK:
+				n = 0;
+				break;
+			default:
+				fprintf(stderr, "socket-server: writev to %d (fd=%d) error :%s.\n",id,s->fd,strerror(errno));
+				force_close(ss,s,result);
+				send_vector_free(v);
+				return SOCKET_CLOSE;
+			}
+		}
+		if (n == request->sz) {
+			send_vector_free(v);
+			return -1;
+		}
+		append_sendbuffer_vector(s, v, request->sz, n);
+		enable_write(ss, s, true);
+	} else {
+		append_sendbuffer_vector(s, v, request->sz, 0);
+	}
+	return check_watermark(ss, s, result);
+}
+
+/*
+	Send ss->multi to its sockets one by one. If a socket reports an event (close, warning ...),
+	return it and keep ss->multi, socket_server_poll calls it again before the next ctrl command.
+ */
+static int
+send_multi(struct socket_server *ss, struct socket_message *result) {
+	struct multi_buffer *m = ss->multi;
+	while (m->index < m->n) {
+		int type = send_socket_multi(ss, m->id[m->index++], m, result);
+		if (type != -1) {
+			return type;
 		}
 	}
+	ss->multi = NULL;
+	multi_buffer_release(m);
 	return -1;
 }
 
@@ -1187,7 +1918,7 @@ close_socket(struct socket_server *ss, struct request_close *request, struct soc
 
 		//Ӧò㻺
 		int type = send_buffer(ss,s,result);
-		if (type != -1)
+		if (type != -1 && type != SOCKET_DRAIN)
 			return type;
 	}
 
@@ -1294,6 +2025,43 @@ setopt_socket(struct socket_server *ss, struct request_setopt *request) {
 	setsockopt(s->fd, IPPROTO_TCP, request->what, &v, sizeof(v));
 }
 
+//÷ͻĸߵˮλ
+static int
+watermark_socket(struct socket_server *ss, struct request_watermark *request, struct socket_message *result) {
+	int id = request->id;
+	struct socket *s = &ss->slot[HASH_ID(id)];
+	if (s->type == SOCKET_TYPE_INVALID || s->id !=id) {
+		return -1;
+	}
+	s->wb_high = request->high;
+	s->wb_low = request->low;
+	s->wb_policy = request->policy;
+	if (s->wb_over) {
+		if (s->wb_high == 0 || s->wb_size <= s->wb_low) {
+			return report_drain(ss, s, result);
+		}
+		return -1;
+	}
+	return check_watermark(ss, s, result);
+}
+
+//÷ְİͷС󳤶, headerΪ0رշְ
+static void
+frame_socket(struct socket_server *ss, struct request_frame *request) {
+	int id = request->id;
+	struct socket *s = &ss->slot[HASH_ID(id)];
+	if (s->type == SOCKET_TYPE_INVALID || s->id !=id) {
+		return;
+	}
+	frame_reset(s);
+	s->frame_header = request->header;
+	s->frame_max = request->max;
+	// frame_need (header + size) can't overflow
+	if (s->frame_max > INT_MAX - s->frame_header) {
+		s->frame_max = INT_MAX - s->frame_header;
+	}
+}
+
 
 //ӹܵȡ,buffer
 static void
@@ -1471,6 +2239,18 @@ ctrl_cmd(struct socket_server *ss, struct socket_message *result) {
 		//udp͵  fd뵽socket_serversocket,뵽epollй
 		add_udp_socket(ss, (struct request_udp *)buffer);
 		return -1;
+	case 'W':
+		return watermark_socket(ss, (struct request_watermark *)buffer, result);
+	case 'F':
+		return sendfile_socket(ss, (struct request_sendfile *)buffer, result);
+	case 'H':
+		frame_socket(ss, (struct request_frame *)buffer);
+		return -1;
+	case 'M':
+		ss->multi = ((struct request_send_multi *)buffer)->multi;
+		return send_multi(ss, result);
+	case 'V':
+		return sendv_socket(ss, (struct request_sendv *)buffer, result);
 	default:
 		fprintf(stderr, "socket-server: Unknown ctrl %c.\n",type);
 		return -1;
@@ -1479,19 +2259,150 @@ ctrl_cmd(struct socket_server *ss, struct socket_message *result) {
 	return -1;
 }
 
+static int
+frame_size(const uint8_t *head, int header) {
+	uint32_t sz;
+	if (header == 2) {
+		sz = head[0] << 8 | head[1];
+	} else {
+		sz = (uint32_t)head[0] << 24 | head[1] << 16 | head[2] << 8 | head[3];
+	}
+	if (sz > INT32_MAX) {
+		return -1;
+	}
+	return (int)sz;
+}
+
+static int
+frame_error(struct socket_server *ss, struct socket *s, struct socket_message *result) {
+	force_close(ss, s, result);
+	result->data = "frame too large";
+	return SOCKET_ERROR;
+}
+
+/*
+	Split n bytes of buffer (allocated with sz bytes) into packets of the framing socket.
+	Only the complete packets are forwarded, in one SOCKET_FRAME message with the
+	same wire format (header + body), and the incomplete tail is kept in the socket.
+	If there is no incomplete packet before, the read buffer is forwarded directly.
+ */
+static int
+forward_frame(struct socket_server *ss, struct socket *s, char *buffer, int sz, int n, struct socket_message *result) {
+	int header = s->frame_header;
+	const uint8_t *p = (const uint8_t *)buffer;
+	int left = n;
+	char *packet = NULL;
+	int psz = 0;
+	int size;
+
+	// complete the pending packet first
+	if (s->frame_read > 0) {
+		if (s->frame_pending == NULL) {
+			int c = header - s->frame_read;
+			if (c > left)
+				c = left;
+			memcpy(s->frame_head + s->frame_read, p, c);
+			s->frame_read += c;
+			p += c;
+			left -= c;
+			if (s->frame_read < header) {
+				read_buffer_release(ss, buffer, sz);
+				return -1;
+			}
+			size = frame_size(s->frame_head, header);
+			if (size < 0 || size > s->frame_max) {
+				read_buffer_release(ss, buffer, sz);
+				return frame_error(ss, s, result);
+			}
+			s->frame_need = header + size;
+			s->frame_pending = MALLOC(s->frame_need);
+			memcpy(s->frame_pending, s->frame_head, header);
+		}
+		int c = s->frame_need - s->frame_read;
+		if (c > left)
+			c = left;
+		memcpy(s->frame_pending + s->frame_read, p, c);
+		s->frame_read += c;
+		p += c;
+		left -= c;
+		if (s->frame_read < s->frame_need) {
+			read_buffer_release(ss, buffer, sz);
+			return -1;
+		}
+		packet = s->frame_pending;
+		psz = s->frame_need;
+		s->frame_pending = NULL;
+		s->frame_read = 0;
+		s->frame_need = 0;
+	}
+
+	// scan the complete packets
+	int complete = 0;
+	while (left - complete >= header) {
+		size = frame_size(p + complete, header);
+		if (size < 0 || size > s->frame_max) {
+			read_buffer_release(ss, buffer, sz);
+			FREE(packet);
+			return frame_error(ss, s, result);
+		}
+		if (left - complete - header < size)
+			break;
+		complete += header + size;
+	}
+
+	// keep the incomplete tail
+	int tail = left - complete;
+	if (tail > 0) {
+		const uint8_t *t = p + complete;
+		if (tail < header) {
+			memcpy(s->frame_head, t, tail);
+		} else {
+			s->frame_need = header + frame_size(t, header);
+			s->frame_pending = MALLOC(s->frame_need);
+			memcpy(s->frame_pending, t, tail);
+		}
+		s->frame_read = tail;
+	}
+
+	if (packet == NULL) {
+		if (complete == 0) {
+			read_buffer_release(ss, buffer, sz);
+			return -1;
+		}
+		// p == buffer here, forward the read buffer without copy
+		packet = buffer;
+		psz = complete;
+	} else {
+		if (complete > 0) {
+			packet = REALLOC(packet, psz + complete);
+			memcpy(packet + psz, p, complete);
+			psz += complete;
+		}
+		read_buffer_release(ss, buffer, sz);
+	}
+
+	result->opaque = s->opaque;
+	result->id = s->id;
+	result->ud = psz;
+	result->data = packet;
+	return SOCKET_FRAME;
+}
+
+#ifndef SOCKET_EDGE_TRIGGER
+
 // return -1 (ignore) when error
 //tcp ɶ¼ִиú Ҫǵread(),ͨresultݣڶ 
 static int
 forward_message_tcp(struct socket_server *ss, struct socket *s, struct socket_message * result) {
 
 	int sz = s->p.size;
-	char * buffer = MALLOC(sz);
+	char * buffer = read_buffer_alloc(ss, sz);
 
 	//read()ȡ 
 	int n = (int)read(s->fd, buffer, sz);
 	
 	if (n<0) {
-		FREE(buffer);
+		read_buffer_release(ss, buffer, sz);
 		switch(errno) {
 		case EINTR:
 			break;
@@ -1510,7 +2421,7 @@ forward_message_tcp(struct socket_server *ss, struct socket *s, struct socket_me
 
 	//Էر
 	if (n==0) {
-		FREE(buffer);
+		read_buffer_release(ss, buffer, sz);
 		//ر׽
 		force_close(ss, s, result);
 		return SOCKET_CLOSE;
@@ -1519,17 +2430,21 @@ forward_message_tcp(struct socket_server *ss, struct socket *s, struct socket_me
 	// half close رնϢ,֮ǰҪرյ׽
 	if (s->type == SOCKET_TYPE_HALFCLOSE) {
 		// discard recv data
-		FREE(buffer);
+		read_buffer_release(ss, buffer, sz);
 		return -1;
 	}
 
 	//ȡݻĴС
-	if (n == sz) {
+	if (n == sz && sz < MAX_READ_BUFFER) {
 		s->p.size *= 2;
 	} else if (sz > MIN_READ_BUFFER && n*2 < sz) {
 		s->p.size /= 2;
 	}
 
+	if (s->frame_header) {
+		return forward_frame(ss, s, buffer, sz, n, result);
+	}
+
 	//handle
 	result->opaque = s->opaque;
 	
@@ -1542,6 +2457,95 @@ forward_message_tcp(struct socket_server *ss, struct socket *s, struct socket_me
 	return SOCKET_DATA;
 }
 
+#else
+
+/*
+	Edge trigger mode : the event of a socket is reported only once, so read it until
+	EAGAIN and forward all the bytes in one message. Don't stop at a short read, the FIN
+	may arrive with the data and it will not be reported again.
+	If the socket reads READ_BUDGET bytes and still has data, stop and call sp_enable to
+	re-arm it. The event will be reported again by the next sp_wait, so the other sockets
+	and the ctrl commands are not starved.
+ */
+static int
+forward_message_tcp(struct socket_server *ss, struct socket *s, struct socket_message * result) {
+	int sz = s->p.size;
+	char * buffer = read_buffer_alloc(ss, sz);
+	int n = 0;
+	bool closed = false;
+	for (;;) {
+		int r = (int)read(s->fd, buffer + n, sz - n);
+		if (r < 0) {
+			switch(errno) {
+			case EINTR:
+				continue;
+			case AGAIN_WOULDBLOCK:
+				break;
+			default:
+				// close when error
+				read_buffer_release(ss, buffer, sz);
+				force_close(ss, s, result);
+				result->data = strerror(errno);
+				return SOCKET_ERROR;
+			}
+			break;
+		}
+		if (r == 0) {
+			closed = true;
+			break;
+		}
+		n += r;
+		if (n < sz) {
+			continue;
+		}
+		if (n >= READ_BUDGET || sz >= MAX_READ_BUFFER) {
+			enable_write(ss, s, s->writing);
+			break;
+		}
+		sz *= 2;
+		buffer = REALLOC(buffer, sz);
+	}
+
+	if (n == 0) {
+		read_buffer_release(ss, buffer, sz);
+		if (closed) {
+			force_close(ss, s, result);
+			return SOCKET_CLOSE;
+		}
+		return -1;
+	}
+
+	if (closed) {
+		// forward the data first, the close event will be reported again.
+		enable_write(ss, s, s->writing);
+	}
+
+	if (s->type == SOCKET_TYPE_HALFCLOSE) {
+		// discard recv data
+		read_buffer_release(ss, buffer, sz);
+		return -1;
+	}
+
+	s->p.size = sz;
+	if (n == sz && sz < MAX_READ_BUFFER) {
+		s->p.size *= 2;
+	} else if (sz > MIN_READ_BUFFER && n*2 < sz) {
+		s->p.size /= 2;
+	}
+
+	if (s->frame_header) {
+		return forward_frame(ss, s, buffer, sz, n, result);
+	}
+
+	result->opaque = s->opaque;
+	result->id = s->id;
+	result->ud = n;
+	result->data = buffer;
+	return SOCKET_DATA;
+}
+
+#endif
+
 // union sockaddr_all *sa ȡudpַ  ͨudp_address
 static int
 gen_udp_address(int protocol, union sockaddr_all *sa, uint8_t * udp_address) {
@@ -1562,43 +2566,120 @@ gen_udp_address(int protocol, union sockaddr_all *sa, uint8_t * udp_address) {
 	return addrsz;
 }
 
+#ifdef UDP_BATCH
+
+// Read up to UDP_BATCH datagrams by one recvmmsg, and return them one by one.
+static int
+udp_recv(struct socket_server *ss, struct socket *s, uint8_t **data, union sockaddr_all **sa, socklen_t *slen) {
+	struct udp_batch *b = ss->udp;
+	if (b == NULL) {
+		b = MALLOC(sizeof(*b));
+		b->n = 0;
+		b->index = 0;
+		ss->udp = b;
+	}
+	if (b->index >= b->n || b->id != s->id) {
+		int i;
+		for (i=0;i<UDP_BATCH;i++) {
+			b->iov[i].iov_base = b->buffer[i];
+			b->iov[i].iov_len = MAX_UDP_PACKAGE;
+			memset(&b->msg[i].msg_hdr, 0, sizeof(b->msg[i].msg_hdr));
+			b->msg[i].msg_hdr.msg_name = &b->addr[i];
+			b->msg[i].msg_hdr.msg_namelen = sizeof(b->addr[i]);
+			b->msg[i].msg_hdr.msg_iov = &b->iov[i];
+			b->msg[i].msg_hdr.msg_iovlen = 1;
+		}
+		b->index = 0;
+		b->n = 0;
+		int n = recvmmsg(s->fd, b->msg, UDP_BATCH, 0, NULL);
+		if (n < 0) {
+			return -1;
+		}
+		b->id = s->id;
+		b->n = n;
+	}
+	int i = b->index++;
+	*data = b->buffer[i];
+	*sa = &b->addr[i];
+	*slen = b->msg[i].msg_hdr.msg_namelen;
+	return b->msg[i].msg_len;
+}
+
+// The batch is shared by all the udp sockets, the unread datagrams in it are returned before
+// another socket reads. They are dropped only when their socket is closed.
+static struct socket *
+udp_pending(struct socket_server *ss, struct socket *s) {
+	struct udp_batch *b = ss->udp;
+	if (b == NULL || b->index >= b->n || b->id == s->id) {
+		return s;
+	}
+	struct socket *p = &ss->slot[HASH_ID(b->id)];
+	if (p->id == b->id && p->type == SOCKET_TYPE_CONNECTED && p->protocol != PROTOCOL_TCP) {
+		return p;
+	}
+	b->n = 0;
+	return s;
+}
+
+#else
+
+static inline struct socket *
+udp_pending(struct socket_server *ss, struct socket *s) {
+	return s;
+}
+
+static int
+udp_recv(struct socket_server *ss, struct socket *s, uint8_t **data, union sockaddr_all **sa, socklen_t *slen) {
+	static union sockaddr_all addr;
+	*data = ss->udpbuffer;
+	*sa = &addr;
+	*slen = sizeof(addr);
+	return recvfrom(s->fd, ss->udpbuffer,MAX_UDP_PACKAGE,0,&addr.s,slen);
+}
+
+#endif
+
 //udpɶʱøú recvfrom() ,resultǴԽݴ
 static int
 forward_message_udp(struct socket_server *ss, struct socket *s, struct socket_message * result) {
-	union sockaddr_all sa;
-	socklen_t slen = sizeof(sa);
+	union sockaddr_all *sa;
+	socklen_t slen;
+	uint8_t *udpbuffer;
+	int n;
 
-	//,뵽udpbuffer 
-	int n = recvfrom(s->fd, ss->udpbuffer,MAX_UDP_PACKAGE,0,&sa.s,&slen);
-	if (n<0) {
-		switch(errno) {
-		case EINTR:
-		case AGAIN_WOULDBLOCK:
-			break;
-		default:
-			// close when error
-			force_close(ss, s, result);
-			result->data = strerror(errno);
-			return SOCKET_ERROR;
+	s = udp_pending(ss, s);
+	for (;;) {
+		//,뵽udpbuffer 
+		n = udp_recv(ss, s, &udpbuffer, &sa, &slen);
+		if (n<0) {
+			switch(errno) {
+			case EINTR:
+			case AGAIN_WOULDBLOCK:
+				break;
+			default:
+				// close when error
+				force_close(ss, s, result);
+				result->data = strerror(errno);
+				return SOCKET_ERROR;
+			}
+			return -1;
 		}
-		return -1;
+		// skip the datagram of the other protocol, and read the next one
+		if (slen == sizeof(sa->v4) ? s->protocol == PROTOCOL_UDP : s->protocol == PROTOCOL_UDPv6)
+			break;
 	}
 	uint8_t * data;
-	if (slen == sizeof(sa.v4)) {
-		if (s->protocol != PROTOCOL_UDP)
-			return -1;
+	if (slen == sizeof(sa->v4)) {
 		data = MALLOC(n + 1 + 2 + 4);
 		//ַϢ뵽dataĩβ
-		gen_udp_address(PROTOCOL_UDP, &sa, data + n);
+		gen_udp_address(PROTOCOL_UDP, sa, data + n);
 	} else {
-		if (s->protocol != PROTOCOL_UDPv6)
-			return -1;
 		data = MALLOC(n + 1 + 2 + 16);
-		gen_udp_address(PROTOCOL_UDPv6, &sa, data + n);
+		gen_udp_address(PROTOCOL_UDPv6, sa, data + n);
 	}
 
 	//յݸƵdata
-	memcpy(data, ss->udpbuffer, n);
+	memcpy(data, udpbuffer, n);
 
 	result->opaque = s->opaque;
 	result->id = s->id;
@@ -1635,7 +2716,7 @@ report_connect(struct socket_server *ss, struct socket *s, struct socket_message
 		//  Ϊ
 		if (send_buffer_empty(s)) {
 			//עɶ¼
-			sp_write(ss->event_fd, s->fd, s, false);
+			enable_write(ss, s, false);
 		}
 		union sockaddr_all u;
 		socklen_t slen = sizeof(u);
@@ -1671,8 +2752,15 @@ report_accept(struct socket_server *ss, struct socket *s, struct socket_message
 			result->id = s->id;
 			result->ud = 0;
 			result->data = strerror(errno);
+			accept_block(ss, s);
 			return -1;
 		} else {
+#ifdef SOCKET_EDGE_TRIGGER
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				// ECONNABORTED, EINTR ... accept stops before EAGAIN, re-arm for the pending connections
+				sp_enable(ss->event_fd, s->fd, s, s->reading, s->writing);
+			}
+#endif
 			return 0;
 		}
 	}
@@ -1688,6 +2776,7 @@ report_accept(struct socket_server *ss, struct socket *s, struct socket_message
 	//˵ӦòsocketѾ
 	if (id < 0) {
 		close(client_fd);
+		accept_block(ss, s);
 		return 0;
 	}
 
@@ -1711,6 +2800,14 @@ report_accept(struct socket_server *ss, struct socket *s, struct socket_message
 	//״̬Ѿӣδ뵽epollй
 	ns->type = SOCKET_TYPE_PACCEPT;
 
+	// inherit the watermarks of listen socket
+	ns->wb_policy = s->wb_policy;
+	ns->wb_high = s->wb_high;
+	ns->wb_low = s->wb_low;
+	// and the packet framing
+	ns->frame_header = s->frame_header;
+	ns->frame_max = s->frame_max;
+
 	//skynet_contextӦıhandle
 	result->opaque = s->opaque;
 
@@ -1781,6 +2878,14 @@ socket_server_poll(struct socket_server *ss, struct socket_message * result, int
 	for (;;) {
 
 		//
+		if (ss->multi) {
+			// continue the send_multi request which reported an event of one socket
+			int type = send_multi(ss, result);
+			if (type != -1) {
+				clear_closed_event(ss, result, type);
+				return type;
+			}
+		}
 		if (ss->checkctrl) {
 
 			// has_cmdڲselect жϹܵǷ  ʹselect ûʹepollʱΪļƵ
@@ -1863,6 +2968,10 @@ socket_server_poll(struct socket_server *ss, struct socket_message * result, int
 			//accept ,µ뵽socket_serversocketУûм뵽epoll
 			int ok = report_accept(ss, s, result);
 			if (ok > 0) {
+#ifdef SOCKET_EDGE_TRIGGER
+				// accept again until EAGAIN, the event will not be reported twice
+				--ss->event_index;
+#endif
 				return SOCKET_ACCEPT;
 			} if (ok < 0 ) {
 				return SOCKET_ERROR;
@@ -2018,6 +3127,10 @@ socket_server_send(struct socket_server *ss, int id, const void * buffer, int sz
 
 	//DӦĵ send_socket(),ʹõǸȼĻ
 	send_request(ss, &request, 'D', sizeof(request.u.send));
+	if (s->wb_high) {
+		// the socket thread reports SOCKET_WARNING itself
+		return 0;
+	}
 	return s->wb_size;
 }
 
@@ -2040,6 +3153,120 @@ socket_server_send_lowpriority(struct socket_server *ss, int id, const void * bu
 	send_request(ss, &request, 'P', sizeof(request.u.send));
 }
 
+// return -1 when error, the fd is closed by socket thread (or here when error)
+int64_t
+socket_server_sendfile(struct socket_server *ss, int id, int fd, int64_t offset, int sz) {
+	struct socket * s = &ss->slot[HASH_ID(id)];
+	if (s->id != id || s->type == SOCKET_TYPE_INVALID) {
+		close(fd);
+		return -1;
+	}
+
+	struct request_package request;
+	request.u.sendfile.id = id;
+	request.u.sendfile.fd = fd;
+	request.u.sendfile.offset = offset;
+	request.u.sendfile.sz = sz;
+
+	send_request(ss, &request, 'F', sizeof(request.u.sendfile));
+	if (s->wb_high) {
+		return 0;
+	}
+	return s->wb_size;
+}
+
+// buffer (malloc by skynet_malloc) is owned by socket_server and shared by the n sockets
+void
+socket_server_send_multi(struct socket_server *ss, const int *id, int n, const void * buffer, int sz) {
+	if (n <= 0) {
+		FREE((void *)buffer);
+		return;
+	}
+	struct multi_buffer *m = MALLOC(sizeof(*m) + (n - 1) * sizeof(int));
+	m->ref = 1;
+	m->sz = sz;
+	m->buffer = (void *)buffer;
+	m->n = n;
+	m->index = 0;
+	memcpy(m->id, id, n * sizeof(int));
+
+	struct request_package request;
+	request.u.send_multi.multi = m;
+	send_request(ss, &request, 'M', sizeof(request.u.send_multi));
+}
+
+static void
+free_pieces(const struct socket_sendpiece *piece, int n) {
+	int i;
+	for (i=0;i<n;i++) {
+		if (piece[i].own) {
+			FREE((void *)piece[i].buffer);
+		}
+	}
+}
+
+int64_t
+socket_server_sendv(struct socket_server *ss, int id, const struct socket_sendpiece *piece, int n) {
+	struct socket * s = &ss->slot[HASH_ID(id)];
+	int64_t sz = 0;
+	size_t copy = 0;
+	int i;
+	for (i=0;i<n;i++) {
+		sz += piece[i].sz;
+		if (!piece[i].own) {
+			copy += piece[i].sz;
+		}
+	}
+	if (s->id != id || s->type == SOCKET_TYPE_INVALID || sz > INT32_MAX) {
+		free_pieces(piece, n);
+		return -1;
+	}
+	if (sz == 0) {
+		free_pieces(piece, n);
+		return s->wb_size;
+	}
+	struct send_vector *v = MALLOC(sizeof(*v) + (n - 1) * sizeof(struct iovec) + n * sizeof(void *) + copy);
+	v->n = 0;
+	v->index = 0;
+	v->nown = 0;
+	v->own = (void **)&v->iov[n];
+	char * ptr = (char *)(v->own + n);
+	for (i=0;i<n;i++) {
+		const struct socket_sendpiece *p = &piece[i];
+		char * base;
+		if (p->own) {
+			v->own[v->nown++] = (void *)p->buffer;
+			base = (char *)p->buffer;
+		} else {
+			memcpy(ptr, p->buffer, p->sz);
+			base = ptr;
+			ptr += p->sz;
+		}
+		if (p->sz == 0) {
+			continue;
+		}
+		struct iovec *last = v->n > 0 ? &v->iov[v->n - 1] : NULL;
+		if (last && (char *)last->iov_base + last->iov_len == base) {
+			// join the adjacent pieces
+			last->iov_len += p->sz;
+		} else {
+			v->iov[v->n].iov_base = base;
+			v->iov[v->n].iov_len = p->sz;
+			++v->n;
+		}
+	}
+
+	struct request_package request;
+	request.u.sendv.id = id;
+	request.u.sendv.sz = (int)sz;
+	request.u.sendv.vector = v;
+	send_request(ss, &request, 'V', sizeof(request.u.sendv));
+	if (s->wb_high) {
+		return 0;
+	}
+	return s->wb_size;
+}
+
 //˳
 void
 socket_server_exit(struct socket_server *ss) {
@@ -2077,7 +3304,7 @@ socket_server_shutdown(struct socket_server *ss, uintptr_t opaque, int id) {
 // or return AF_INET or AF_INET6
 //socket׽֣ҵbind
 static int
-do_bind(const char *host, int port, int protocol, int *family) {
+do_bind(const char *host, int port, int protocol, int *family, bool reuseport) {
 
 	int fd;
 	int status;
@@ -2116,6 +3343,18 @@ do_bind(const char *host, int port, int protocol, int *family) {
 		goto _failed;
 	}
 
+	if (reuseport) {
+#ifdef SO_REUSEPORT
+		// each socket bound to the same address gets a share of the connections
+		if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, (void *)&reuse, sizeof(int))==-1) {
+			goto _failed;
+		}
+#else
+		fprintf(stderr, "socket-server: SO_REUSEPORT is not supported.\n");
+		goto _failed;
+#endif
+	}
+
 	//bind
 	status = bind(fd, (struct sockaddr *)ai_list->ai_addr, ai_list->ai_addrlen);
 	if (status != 0)
@@ -2132,10 +3371,10 @@ _failed_fd:
 
 //listen,ȵdo_bind() 
 static int
-do_listen(const char * host, int port, int backlog) {
+do_listen(const char * host, int port, int backlog, bool reuseport) {
 	int family = 0;
 					//socket()  bind()
-	int listen_fd = do_bind(host, port, IPPROTO_TCP, &family);
+	int listen_fd = do_bind(host, port, IPPROTO_TCP, &family, reuseport);
 
 	if (listen_fd < 0) {
 		return -1;
@@ -2146,6 +3385,8 @@ do_listen(const char * host, int port, int backlog) {
 		close(listen_fd);
 		return -1;
 	}
+	// accept may be called again after EAGAIN (edge trigger mode), never block in it
+	sp_nonblocking(listen_fd);
 	return listen_fd;
 }
 
@@ -2156,10 +3397,10 @@ do_listen(const char * host, int port, int backlog) {
 //൱
 //socket()  bind()  listen()  socket   ûм뵽epollй
 int 
-socket_server_listen(struct socket_server *ss, uintptr_t opaque, const char * addr, int port, int backlog) {
+socket_server_listen(struct socket_server *ss, uintptr_t opaque, const char * addr, int port, int backlog, int reuseport) {
 
 				//socket()  bind()  listen() 
-	int fd = do_listen(addr, port, backlog);
+	int fd = do_listen(addr, port, backlog, reuseport);
 	if (fd < 0) {
 		return -1;
 	}
@@ -2232,6 +3473,38 @@ socket_server_nodelay(struct socket_server *ss, int id) {
 	send_request(ss, &request, 'T', sizeof(request.u.setopt));
 }
 
+void
+socket_server_watermark(struct socket_server *ss, int id, int64_t high, int64_t low, int policy) {
+	struct request_package request;
+	request.u.watermark.id = id;
+	request.u.watermark.policy = policy;
+	request.u.watermark.high = high;
+	request.u.watermark.low = low;
+	send_request(ss, &request, 'W', sizeof(request.u.watermark));
+}
+
+void
+socket_server_frame(struct socket_server *ss, int id, int header, int max) {
+	struct request_package request;
+	request.u.frame.id = id;
+	request.u.frame.header = header;
+	request.u.frame.max = max;
+	send_request(ss, &request, 'H', sizeof(request.u.frame));
+}
+
+int
+socket_server_stat(struct socket_server *ss, int id, struct socket_stat *stat) {
+	struct socket * s = &ss->slot[HASH_ID(id)];
+	if (s->id != id || s->type == SOCKET_TYPE_INVALID) {
+		return -1;
+	}
+	stat->send_bytes = s->send_bytes;
+	stat->send_count = s->send_count;
+	stat->wb_size = s->wb_size;
+	stat->frame_read = s->frame_read;
+	return 0;
+}
+
 
 void 
 socket_server_userobject(struct socket_server *ss, struct socket_object_interface *soi) {
@@ -2248,7 +3521,7 @@ socket_server_udp(struct socket_server *ss, uintptr_t opaque, const char * addr,
 	int family;
 	if (port != 0 || addr != NULL) {
 		// bind
-		fd = do_bind(addr, port, IPPROTO_UDP, &family);
+		fd = do_bind(addr, port, IPPROTO_UDP, &family, false);
 		if (fd < 0) {
 			return -1;
 		}
@@ -2311,6 +3584,9 @@ socket_server_udp_send(struct socket_server *ss, int id, const struct socket_udp
 
 	//Ӧĵ send_socket()udp
 	send_request(ss, &request, 'A', sizeof(request.u.send_udp.send)+addrsz);
+	if (s->wb_high) {
+		return 0;
+	}
 	return s->wb_size;
 }
 
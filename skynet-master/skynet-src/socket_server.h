@@ -13,6 +13,14 @@
 #define SOCKET_ERROR 4			// 
 #define SOCKET_EXIT 5			// ˳¼
 #define SOCKET_UDP 6
+#define SOCKET_WARNING 7		// ͻˮλ udǻС(K)
+#define SOCKET_DRAIN 8			// ͻˮλ udǻС(K)
+#define SOCKET_FRAME 9			// İ(ͷ) udݵĴС
+
+// what to do when the write buffer of a socket reaches the high watermark
+#define SOCKET_WATERMARK_PAUSE 0	// stop reading the socket until it drains
+#define SOCKET_WATERMARK_DROP 1		// drop the low priority data (queued and new)
+#define SOCKET_WATERMARK_CLOSE 2	// close the socket, report SOCKET_ERROR
 
 struct socket_server;
 
@@ -61,9 +69,14 @@ int64_t socket_server_send(struct socket_server *, int id, const void * buffer,
 
 void socket_server_send_lowpriority(struct socket_server *, int id, const void * buffer, int sz);
 
+// send sz bytes of an opened file from offset (with sendfile on linux), socket_server closes fd later
+// return -1 when error
+int64_t socket_server_sendfile(struct socket_server *, int id, int fd, int64_t offset, int sz);
+
 // ctrl command below returns id
 // ,socket, bind, listen
-int socket_server_listen(struct socket_server *, uintptr_t opaque, const char * addr, int port, int backlog);
+// reuseport : set SO_REUSEPORT, so several services can listen the same address and share the connections
+int socket_server_listen(struct socket_server *, uintptr_t opaque, const char * addr, int port, int backlog, int reuseport);
 
 
 //ķʽ
@@ -76,6 +89,44 @@ int socket_server_bind(struct socket_server *, uintptr_t opaque, int fd);
 //͵ 
 void socket_server_nodelay(struct socket_server *, int id);
 
+// Set the write buffer watermarks (in bytes) of a socket, high == 0 turns it off.
+// SOCKET_WARNING is reported once wb_size > high, and SOCKET_DRAIN when it falls to low.
+// The sockets accepted by a listen socket inherit its watermarks.
+void socket_server_watermark(struct socket_server *, int id, int64_t high, int64_t low, int policy);
+
+// Split the stream of a socket into packets with a big-endian size header (2 or 4 bytes)
+// in the socket thread, header == 0 turns it off. The complete packets (header included)
+// are reported in one SOCKET_FRAME, the socket is closed if a packet is larger than max.
+// The sockets accepted by a listen socket inherit its framing.
+void socket_server_frame(struct socket_server *, int id, int header, int max);
+
+// Send one buffer to n tcp sockets, the buffer is shared (refcounted) by their write buffers.
+// The invalid ids are ignored.
+void socket_server_send_multi(struct socket_server *, const int *id, int n, const void * buffer, int sz);
+
+// A piece of socket_server_sendv. The buffer is copied when own is 0,
+// or it (malloc by skynet_malloc) is freed by socket_server after sending.
+struct socket_sendpiece {
+	const void * buffer;
+	int sz;
+	int own;
+};
+
+// Send the pieces as one buffer (by writev), the adjacent copied pieces are joined.
+// return -1 when error
+int64_t socket_server_sendv(struct socket_server *, int id, const struct socket_sendpiece *piece, int n);
+
+struct socket_stat {
+	uint64_t send_bytes;	// bytes accepted by send
+	uint64_t send_count;	// packages accepted by send
+	int64_t wb_size;	// bytes in the write buffer
+	int frame_read;		// bytes of the incomplete package (header included), see socket_server_frame
+};
+
+// Read the send counters of a socket without a ctrl command, the values may be a little stale.
+// return -1 when the id is invalid
+int socket_server_stat(struct socket_server *, int id, struct socket_stat *stat);
+
 struct socket_udp_address;
 
 // create an udp socket handle, attach opaque with it . udp socket don't need call socket_server_start to recv message
@@ -0,0 +1,54 @@
+local skynet = require "skynet"
+local socket = require "socket"
+
+-- TCP bulk transfer benchmark
+-- usage : testbulk [megabytes] [chunk size]
+
+local mb, chunk = ...
+mb = tonumber(mb) or 256
+chunk = tonumber(chunk) or 64 * 1024
+
+local PORT = 8767
+
+skynet.start(function()
+	local total = mb * 1024 * 1024
+	local done = false
+	local lid = socket.listen("127.0.0.1", PORT)
+	socket.start(lid, function(id, addr)
+		socket.start(id)
+		skynet.fork(function()
+			local start = skynet.now()
+			local bytes = 0
+			local reads = 0
+			while bytes < total do
+				local str = socket.read(id)
+				if not str then
+					break
+				end
+				bytes = bytes + #str
+				reads = reads + 1
+			end
+			local ti = (skynet.now() - start) / 100
+			print(string.format("bulk : %d bytes in %.2fs (%.1f MB/s), %d reads, %d bytes per read",
+				bytes, ti, bytes / 1024 / 1024 / ti, reads, bytes // reads))
+			socket.close(id)
+			done = true
+		end)
+	end)
+
+	local c = socket.open("127.0.0.1", PORT)
+	local block = string.rep("x", chunk)
+	local n = total // chunk
+	for i=1,n do
+		socket.write(c, block)
+		if i % 64 == 0 then
+			skynet.yield()
+		end
+	end
+	while not done do
+		skynet.sleep(10)
+	end
+	socket.close(c)
+	socket.close(lid)
+	skynet.exit()
+end)
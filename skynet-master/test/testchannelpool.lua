@@ -0,0 +1,167 @@
+local skynet = require "skynet"
+local redis = require "redis"
+
+-- socketchannel pool test, with a fake redis server (GET takes 10ms, and MULTI/EXEC are per connection)
+-- usage : testchannelpool [pool size] [coroutines] [requests]
+-- Each coroutine sends GET one by one, a pool of n connections serves n requests at the same time.
+-- Then the coroutines run transactions (MULTI/SET/GET/EXEC), each one owns a connection until EXEC.
+-- At last, the transactions break off (error before EXEC, dead coroutine, WATCH/UNWATCH), the connections are released.
+-- (pool size 1 is a single channel, it can't run the transactions of many coroutines at the same time)
+
+local size, nco, count = ...
+
+local PORT = 8777
+
+if size == "server" then
+	local socket = require "socket"
+	local store = {}
+	local function execute(args)
+		if args[1] == "GET" then
+			skynet.sleep(1)
+			local v = store[args[2]]
+			return v and "$" .. #v .. "\r\n" .. v .. "\r\n" or "$-1\r\n"
+		else
+			store[args[2]] = args[3]
+			return "+OK\r\n"
+		end
+	end
+	local function serve(id)
+		local multi
+		socket.start(id)
+		while true do
+			local line = socket.readline(id, "\r\n")
+			if not line then
+				break
+			end
+			local args = {}
+			for i=1,tonumber(line:sub(2)) do
+				local len = tonumber(socket.readline(id, "\r\n"):sub(2))
+				args[i] = socket.read(id, len + 2):sub(1, -3)
+			end
+			if args[1] == "MULTI" then
+				multi = {}
+				socket.write(id, "+OK\r\n")
+			elseif args[1] == "DISCARD" then
+				multi = nil
+				socket.write(id, "+OK\r\n")
+			elseif (args[1] == "WATCH" or args[1] == "UNWATCH") and not multi then
+				socket.write(id, "+OK\r\n")
+			elseif args[1] == "EXEC" then
+				if multi then
+					local r = { "*" .. #multi .. "\r\n" }
+					for i, cmd in ipairs(multi) do
+						r[i+1] = execute(cmd)
+					end
+					multi = nil
+					socket.write(id, r)
+				else
+					socket.write(id, "-ERR EXEC without MULTI\r\n")
+				end
+			elseif multi then
+				table.insert(multi, args)
+				socket.write(id, "+QUEUED\r\n")
+			else
+				socket.write(id, execute(args))
+			end
+		end
+		socket.close(id)
+	end
+	skynet.start(function()
+		local lid = socket.listen("127.0.0.1", PORT)
+		socket.start(lid, function(id)
+			skynet.fork(serve, id)
+		end)
+	end)
+	return
+end
+
+size = tonumber(size) or 8
+nco = tonumber(nco) or 32
+count = tonumber(count) or 20
+
+local function run(f)
+	local done = 0
+	local start = skynet.now()
+	for i=1,nco do
+		skynet.fork(function()
+			f(i)
+			done = done + 1
+		end)
+	end
+	while done < nco do
+		skynet.sleep(1)
+	end
+	return (skynet.now() - start) / 100
+end
+
+skynet.start(function()
+	skynet.newservice(SERVICE_NAME, "server")
+	local db = redis.connect {
+		host = "127.0.0.1",
+		port = PORT,
+		pool = size,
+	}
+	local ti = run(function(i)
+		local key = "testchannelpool" .. i
+		db:set(key, i)
+		for j=1,count do
+			assert(tonumber(db:get(key)) == i)
+		end
+	end)
+	print(string.format("channel pool (%d) : %d coroutines, %d requests in %.2fs",
+		size, nco, nco * count, ti))
+	if size < 2 then
+		db:disconnect()
+		skynet.exit()
+		return
+	end
+
+	ti = run(function(i)
+		local key = "testchannelpool" .. i
+		for j=1,count do
+			db:multi()
+			db:set(key, j)
+			db:get(key)
+			local r = db:exec()
+			assert(r[1] == "OK" and tonumber(r[2]) == j, "transaction mismatch")
+		end
+	end)
+	print(string.format("channel pool (%d) : %d coroutines, %d transactions in %.2fs",
+		size, nco, nco * count, ti))
+
+	-- more than the pool size : the connections must be released, and not in MULTI
+	local function check_get(i)
+		local key = "testchannelpool" .. i
+		db:set(key, i)
+		assert(tonumber(db:get(key)) == i, "connection in transaction")
+	end
+	run(function(i)
+		-- error before EXEC, the connection is reset
+		assert(not pcall(db.transaction, db, function()
+			db:multi()
+			db:set("testchannelpool" .. i, i)
+			error "break off"
+		end))
+		check_get(i)
+		-- WATCH ... UNWATCH
+		db:watch("testchannelpool" .. i)
+		db:unwatch()
+		check_get(i)
+	end)
+	-- all the connections are bound by the dead coroutines (error before EXEC)
+	local dead = 0
+	for i=1,size do
+		skynet.fork(function()
+			db:multi()
+			dead = dead + 1
+			error "dead"
+		end)
+	end
+	while dead < size do
+		skynet.sleep(1)
+	end
+	run(check_get)
+	print(string.format("channel pool (%d) : %d coroutines, broken transactions released", size, nco))
+	db:disconnect()
+	skynet.exit()
+end)
@@ -0,0 +1,92 @@
+local skynet = require "skynet"
+local cluster = require "cluster"
+require "skynet.manager"	-- import skynet.abort
+
+-- small requests mixed with large responses on the cluster link
+-- usage : run "testclusterchannels node" in one process (node db),
+-- and "testclusterchannels [small coroutines] [count] [large coroutines] [large size]" in another
+-- (the client calls itself if node db is not running)
+-- config : cluster = "./examples/clustername.lua" , cluster_channels = n , cluster_native = true (optional)
+-- With one channel, a small response waits for the multi part responses before it.
+
+local nco, count, nlarge, size = ...
+
+local function server()
+	local large
+	skynet.start(function()
+		skynet.dispatch("lua", function(_, _, cmd, sz)
+			if cmd == "small" then
+				skynet.ret(skynet.pack(string.rep("s", 100)))
+			else
+				if not large or #large ~= sz then
+					large = string.rep("L", sz)
+				end
+				skynet.ret(skynet.pack(large))
+			end
+		end)
+	end)
+end
+
+if nco == "server" then
+	server()
+	return
+end
+
+if nco == "node" then
+	skynet.start(function()
+		cluster.register("channels", skynet.newservice(SERVICE_NAME, "server"))
+		cluster.open "db"
+	end)
+	return
+end
+
+nco = tonumber(nco) or 16
+count = tonumber(count) or 500
+nlarge = tonumber(nlarge) or 4
+size = tonumber(size) or 1024 * 1024
+
+skynet.start(function()
+	local ok, addr = pcall(cluster.query, "db", "channels")
+	if not ok then
+		cluster.register("channels", skynet.newservice(SERVICE_NAME, "server"))
+		cluster.open "db"
+		addr = cluster.query("db", "channels")
+	end
+
+	local stop
+	local large = 0
+	for i=1,nlarge do
+		skynet.fork(function()
+			while not stop do
+				assert(#cluster.call("db", addr, "large", size) == size)
+				large = large + 1
+			end
+		end)
+	end
+
+	local done = 0
+	local max = 0
+	local start = skynet.now()
+	for i=1,nco do
+		skynet.fork(function()
+			for j=1,count do
+				local t = skynet.now()
+				assert(#cluster.call("db", addr, "small") == 100)
+				t = skynet.now() - t
+				if t > max then
+					max = t
+				end
+			end
+			done = done + 1
+		end)
+	end
+	while done < nco do
+		skynet.sleep(1)
+	end
+	local ti = (skynet.now() - start) / 100
+	stop = true
+	print(string.format("cluster channels (%s) : %d small calls in %.2fs, %d calls/s, max latency %d0 ms, %d large (%dK) responses",
+		skynet.getenv "cluster_channels" or 1, nco * count, ti, math.floor(nco * count / math.max(ti, 0.01)),
+		max, large, size // 1024))
+	skynet.abort()
+end)
@@ -0,0 +1,136 @@
+local skynet = require "skynet"
+local cluster = require "cluster.core"
+
+-- cluster link compression : bytes on the link and cpu time of pack + unpack (request and response)
+-- usage : testclustercompress [threshold] [count]
+
+local threshold, count = ...
+threshold = tonumber(threshold) or 4096
+count = tonumber(count) or 1000
+
+local payload = {}
+
+function payload.records()
+	local t = {}
+	for i=1,500 do
+		t[i] = { id = 10000 + i, name = "player" .. i, level = i % 100, guild = "guild" .. (i % 10),
+			items = { 1001, 1002, i % 7 }, online = i % 3 == 0 }
+	end
+	return t
+end
+
+function payload.text()
+	local t = {}
+	for i=1,1000 do
+		t[i] = string.format("%d : the quick brown fox jumps over the lazy dog %d times", i, i % 13)
+	end
+	return table.concat(t, "\n")
+end
+
+function payload.random()
+	local t = {}
+	for i=1,4096 do
+		t[i] = string.pack("<I4", math.random(0, 0xffffffff))
+	end
+	return table.concat(t)
+end
+
+-- half compressible, still larger than a multi part package (32K) after compression
+function payload.large()
+	local r = payload.random()
+	return { r, r:reverse(), r }
+end
+
+function payload.small()
+	return { id = 1, name = "small", level = 10 }
+end
+
+-- the parts of a package are unpacked as clusterd (the 2 bytes size header is removed)
+local function unpack_request(request, padding)
+	if not padding then
+		local data = request[1]:sub(3) .. skynet.tostring(request[2], request[3])
+		skynet.trash(request[2], request[3])
+		local _, _, msg = cluster.unpackrequest(data)
+		return msg, nil, #request[1] + request[3]
+	end
+	-- padding is { { parts, sz } }
+	local parts = skynet.tostring(padding[1][1], padding[1][2])
+	skynet.trash(padding[1][1], padding[1][2])
+	local bytes = #request + #parts
+	local large = {}
+	local _, _, msg, more, _, sz = cluster.unpackrequest(request:sub(3), large)
+	local pos = 1
+	while more do
+		local part
+		part, pos = string.unpack(">s2", parts, pos)
+		_, _, msg, more, _, sz = cluster.unpackrequest(part, large)
+	end
+	return msg, sz, bytes
+end
+
+local function unpack_response(response)
+	if type(response) == "string" then
+		local _, ok, msg = cluster.unpackresponse(response:sub(3))
+		assert(ok)
+		return msg, nil, #response
+	end
+	local bytes = 0
+	local req = {}
+	for _, part in ipairs(response) do
+		bytes = bytes + #part
+		local _, ok, msg = cluster.unpackresponse(part:sub(3))
+		assert(ok)
+		table.insert(req, msg)
+	end
+	local msg, sz = cluster.concat(req)
+	return msg, sz, bytes
+end
+
+local function check(value, m, s)
+	assert(skynet.tostring(skynet.pack(skynet.unpack(m, s))) == skynet.tostring(skynet.pack(value)), "mismatch")
+end
+
+local function test(name, value, th)
+	local origin, bytes, ti = 0, 0, 0
+	for i=1,count do
+		local msg, sz = skynet.pack(value)
+		origin = origin + sz
+		local clock = os.clock()
+		local request, _, padding = cluster.packrequest(1, 1, msg, sz, th)
+		local m, s, b = unpack_request(request, padding)
+		ti = ti + os.clock() - clock
+		bytes = bytes + b
+		if i == 1 then
+			check(value, m, s)
+		end
+		if s then
+			skynet.trash(m, s)
+		end
+
+		msg, sz = skynet.pack(value)
+		origin = origin + sz
+		clock = os.clock()
+		local response = cluster.packresponse(1, true, msg, sz, th)
+		m, s, b = unpack_response(response)
+		ti = ti + os.clock() - clock
+		bytes = bytes + b
+		skynet.trash(msg, sz)
+		if i == 1 then
+			check(value, m, s)
+		end
+		if s then
+			skynet.trash(m, s)
+		end
+	end
+	print(string.format("%-8s %-5s : %8d K -> %8d K (%5.1f%%), %6.2f us cpu per message",
+		name, th and "lz" or "plain", origin // 1024, bytes // 1024, bytes * 100 / origin, ti * 1000000 / (count * 2)))
+end
+
+skynet.start(function()
+	for _, name in ipairs { "records", "text", "random", "large", "small" } do
+		local value = payload[name]()
+		test(name, value)
+		test(name, value, threshold)
+	end
+	skynet.exit()
+end)
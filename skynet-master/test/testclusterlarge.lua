@@ -0,0 +1,96 @@
+local skynet = require "skynet"
+local cluster = require "cluster.core"
+
+-- multi part cluster request : cpu time of pack / reassemble, and the lua memory alive before the last part
+-- usage : testclusterlarge [size (MB)] [count]
+-- concat : the parts are kept in a table and concatenated at last (cluster.concat)
+-- buffer : the parts are copied into one buffer sized by the header (cluster.unpackrequest(msg, large))
+
+local size, count = ...
+size = (tonumber(size) or 10) * 1024 * 1024
+count = tonumber(count) or 10
+
+-- the packages on the link, as the gate delivers them (without the size header)
+local function packages(request, padding)
+	local pkgs = { request:sub(3) }
+	for _, part in ipairs(padding) do
+		if type(part) == "table" then
+			-- { msg, sz } : all the parts in one buffer
+			local data = skynet.tostring(part[1], part[2])
+			skynet.trash(part[1], part[2])
+			local pos = 1
+			while pos <= #data do
+				local pkg
+				pkg, pos = string.unpack(">s2", data, pos)
+				table.insert(pkgs, pkg)
+			end
+		else
+			table.insert(pkgs, part:sub(3))
+		end
+	end
+	return pkgs
+end
+
+local function concat(pkgs)
+	local _, _, sz = cluster.unpackrequest(pkgs[1])
+	local req = { sz }
+	for i=2,#pkgs do
+		local _, _, msg = cluster.unpackrequest(pkgs[i])
+		table.insert(req, msg)
+		if i == #pkgs - 1 then
+			collectgarbage()
+			req.memory = collectgarbage "count"
+		end
+	end
+	local msg, sz = cluster.concat(req)
+	return msg, sz, req.memory
+end
+
+local function buffer(pkgs)
+	local large = {}
+	local memory
+	local addr, session, msg, padding, push, sz
+	for i=1,#pkgs do
+		addr, session, msg, padding, push, sz = cluster.unpackrequest(pkgs[i], large)
+		if i == #pkgs - 1 then
+			collectgarbage()
+			memory = collectgarbage "count"
+		end
+	end
+	assert(not padding and next(large) == nil)
+	return msg, sz, memory
+end
+
+skynet.start(function()
+	local value = string.rep("0123456789abcdef", size // 16)
+	local reassemble = { concat = concat, buffer = buffer }
+	local pack_ti = 0
+	local ti = {}
+	local memory = {}
+	for i=1,count do
+		local msg, sz = skynet.pack(value)
+		local clock = os.clock()
+		local request, _, padding = cluster.packrequest(1, 1, msg, sz)
+		pack_ti = pack_ti + os.clock() - clock
+		local pkgs = packages(request, padding)
+		request, padding = nil, nil
+		for name, f in pairs(reassemble) do
+			collectgarbage()
+			local base = collectgarbage "count"
+			clock = os.clock()
+			local m, s, mem = f(pkgs)
+			ti[name] = (ti[name] or 0) + os.clock() - clock
+			memory[name] = math.max(memory[name] or 0, mem - base)
+			if i == 1 then
+				assert(skynet.unpack(m, s) == value)
+			end
+			skynet.trash(m, s)
+		end
+	end
+	print(string.format("pack    : %dM, %.2f ms cpu per request", size // (1024 * 1024), pack_ti * 1000 / count))
+	for name in pairs(reassemble) do
+		print(string.format("%-7s : %dM, %.2f ms cpu per request, %d K lua memory alive before the last part",
+			name, size // (1024 * 1024), ti[name] * 1000 / count, math.floor(memory[name])))
+	end
+	skynet.exit()
+end)
@@ -0,0 +1,93 @@
+local skynet = require "skynet"
+local cluster = require "cluster"
+require "skynet.manager"	-- import skynet.abort
+
+-- cluster.send (one-way push) vs cluster.call
+-- usage : run "testclusterpush node" in one process (node db), and "testclusterpush [count] [size]" in another
+-- (the client pushes to itself if node db is not running)
+-- config : cluster = "./examples/clustername.lua" , cluster_native = true (optional)
+-- The messages of one sender are in order, except cluster_channels > 1 (they may go by different connections).
+
+local mode, count, size = ...
+
+local function server()
+	local n, bytes = 0, 0
+	skynet.start(function()
+		skynet.dispatch("lua", function(_, _, cmd, v)
+			if cmd == "push" then
+				n = n + 1
+				bytes = bytes + #v
+			elseif cmd == "ping" then
+				skynet.ret(skynet.pack(v))
+			elseif cmd == "count" then
+				skynet.ret(skynet.pack(n, bytes))
+				n, bytes = 0, 0
+			end
+		end)
+	end)
+end
+
+if mode == "server" then
+	server()
+	return
+end
+
+if mode == "node" then
+	skynet.start(function()
+		cluster.register("push", skynet.newservice(SERVICE_NAME, "server"))
+		cluster.open "db"
+	end)
+	return
+end
+
+count = tonumber(mode) or 10000
+size = tonumber(size) or 100
+
+skynet.start(function()
+	local ok, addr = pcall(cluster.query, "db", "push")
+	if not ok then
+		cluster.register("push", skynet.newservice(SERVICE_NAME, "server"))
+		cluster.open "db"
+		addr = cluster.query("db", "push")
+	end
+	local payload = string.rep("x", size)
+
+	-- wait for n pushes (bytes) handled
+	local function wait(n, bytes)
+		local got_n, got_bytes = 0, 0
+		while got_n < n do
+			local a, b = cluster.call("db", addr, "count")
+			got_n = got_n + a
+			got_bytes = got_bytes + b
+			if got_n < n then
+				skynet.sleep(1)
+			end
+		end
+		assert(got_n == n and got_bytes == bytes)
+	end
+
+	local start = skynet.now()
+	for i=1,count do
+		assert(cluster.call("db", addr, "ping", payload) == payload)
+	end
+	local ti = (skynet.now() - start) / 100
+	print(string.format("cluster push (call) : %d calls in %.2fs, %d calls/s",
+		count, ti, math.floor(count / math.max(ti, 0.01))))
+
+	start = skynet.now()
+	for i=1,count do
+		cluster.send("db", addr, "push", payload)
+	end
+	wait(count, count * size)
+	ti = (skynet.now() - start) / 100
+	print(string.format("cluster push (send) : %d messages in %.2fs, %d messages/s",
+		count, ti, math.floor(count / math.max(ti, 0.01))))
+
+	-- multi part push
+	local large = string.rep("L", 100 * 1024)
+	cluster.send("db", addr, "push", large)
+	cluster.send("db", addr, "push", payload)
+	wait(2, #large + size)
+	print "cluster push (large) : ok"
+	skynet.abort()
+end)
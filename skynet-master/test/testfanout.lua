@@ -0,0 +1,89 @@
+local skynet = require "skynet"
+require "skynet.manager"	-- import skynet.abort
+local socket = require "socket"
+
+-- fan-out benchmark : send the same package to many connections
+-- usage : testfanout [multi|single] [clients] [seconds] [size]
+-- multi : socket.write_multi, one call (and one shared buffer) for all the connections
+-- single : socket.write for each connection
+
+local mode, nclient, seconds, size = ...
+
+local PORT = 8772
+local SERVICE = 4	-- client services
+local BURST = 1	-- packages per tick
+
+if mode == "client" then
+	local n = tonumber(nclient)
+	local recv = 0
+	skynet.start(function()
+		for i=1,n do
+			local fd = socket.open("127.0.0.1", PORT)
+			skynet.fork(function()
+				while true do
+					local str = socket.read(fd)
+					if not str then
+						break
+					end
+					recv = recv + #str
+				end
+			end)
+		end
+		skynet.dispatch("lua", function()
+			skynet.ret(skynet.pack(recv))
+		end)
+	end)
+	return
+end
+
+mode = mode or "multi"
+nclient = tonumber(nclient) or 5000
+seconds = tonumber(seconds) or 5
+size = tonumber(size) or 64
+
+skynet.start(function()
+	local ids = {}
+	local lid = socket.listen("127.0.0.1", PORT)
+	socket.start(lid, function(id)
+		socket.start(id)
+		table.insert(ids, id)
+	end)
+	local clients = {}
+	for i=1,SERVICE do
+		clients[i] = skynet.newservice(SERVICE_NAME, "client", nclient // SERVICE)
+	end
+	nclient = nclient // SERVICE * SERVICE
+	while #ids < nclient do
+		skynet.sleep(10)
+	end
+	print(string.format("fanout (%s) : %d clients, %d bytes package", mode, nclient, size))
+
+	local msg = string.rep("x", size)
+	local send = 0
+	local cpu = 0
+	local start = skynet.now()
+	for tick = 1, seconds * 100 do
+		local t = os.clock()
+		for i=1,BURST do
+			if mode == "multi" then
+				socket.write_multi(ids, msg)
+			else
+				for _, id in ipairs(ids) do
+					socket.write(id, msg)
+				end
+			end
+		end
+		cpu = cpu + os.clock() - t
+		send = send + BURST
+		skynet.sleep(1)
+	end
+	local ti = (skynet.now() - start) / 100
+	skynet.sleep(100)	-- wait for the clients
+	local recv = 0
+	for i=1,SERVICE do
+		recv = recv + skynet.call(clients[i], "lua")
+	end
+	print(string.format("fanout (%s) : %d broadcasts in %.2fs, %.1f us cpu per broadcast, recv %d / %d packages",
+		mode, send, ti, cpu * 1000000 / send, recv // size, send * nclient))
+	skynet.abort()
+end)
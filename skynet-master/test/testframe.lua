@@ -0,0 +1,153 @@
+local skynet = require "skynet"
+require "skynet.manager"	-- import skynet.launch
+local socket	-- require it after gateserver, they both register the socket protocol
+
+-- packet framing in the socket thread test
+-- usage : testframe [socket|netpack|gate] [count] [header] [noframe]
+-- The client writes 2 (or 4) bytes size header packages in random pieces, the receiver checks them.
+-- With header 4, some packages are larger than 64K. noframe turns off the framing in socket thread.
+-- socket : socket.frame + socket.read
+-- netpack : snax.gateserver (netpack.filter gets SKYNET_SOCKET_TYPE_FRAME)
+-- gate : the C gate service
+
+local mode, count, header, noframe = ...
+mode = mode or "socket"
+count = tonumber(count) or 10000
+header = tonumber(header) or 2
+noframe = noframe == "noframe"
+local format = header == 4 and ">s4" or ">s2"
+
+local PORT = 8770
+
+local function package(i)
+	local size = i % 100 == 0 and (header == 4 and 200000 or 60000) or (i * 37) % 3000
+	return string.rep(string.char(65 + i % 26), size)
+end
+
+local function checker()
+	local n = 0
+	local bytes = 0
+	return function(msg)
+		n = n + 1
+		assert(msg == package(n), "package " .. n .. " mismatch")
+		bytes = bytes + #msg
+		if n == count then
+			print(string.format("frame (%s, header %d%s) : %d packages (%d K) ok",
+				mode, header, noframe and ", noframe" or "", n, bytes // 1024))
+			return true
+		end
+	end
+end
+
+local function client()
+	local c = socket.open("127.0.0.1", PORT)
+	local buf = {}
+	for i=1,count do
+		local p = package(i)
+		table.insert(buf, string.pack(format, p))
+		if i % 50 == 0 or i == count then
+			local s = table.concat(buf)
+			buf = {}
+			local pos = 1
+			while pos <= #s do
+				-- split at random, a header may be cut too
+				local len = math.random(1, 8192)
+				socket.write(c, s:sub(pos, pos + len - 1))
+				pos = pos + len
+				if math.random(4) == 1 then
+					skynet.sleep(0)
+				end
+			end
+		end
+	end
+	return c
+end
+
+if mode == "netpack_server" then
+	local gateserver = require "snax.gateserver"
+	local netpack = require "netpack"
+	local check = checker()
+	mode = "netpack"
+	local handler = {}
+	function handler.connect(fd)
+		gateserver.openclient(fd)
+	end
+	function handler.message(fd, msg, sz)
+		if check(netpack.tostring(msg, sz)) then
+			gateserver.closeclient(fd)
+		end
+	end
+	function handler.error(fd, msg)
+		error(msg)
+	end
+	gateserver.start(handler)
+	return
+end
+
+socket = require "socket"
+
+skynet.start(function()
+	if mode == "socket" then
+		local check = checker()
+		local lid = socket.listen("127.0.0.1", PORT)
+		if not noframe then
+			socket.frame(lid, header)
+		end
+		socket.start(lid, function(id, addr)
+			socket.start(id)
+			skynet.fork(function()
+				while true do
+					local h = socket.read(id, header)
+					if not h then
+						break
+					end
+					local body = socket.read(id, string.unpack(header == 4 and ">I4" or ">I2", h))
+					if check(body) then
+						break
+					end
+				end
+				socket.close(id)
+				socket.close(lid)
+				skynet.exit()
+			end)
+		end)
+		client()
+	elseif mode == "netpack" then
+		local gate = skynet.newservice(SERVICE_NAME, "netpack_server", count, header, noframe and "noframe" or "frame")
+		skynet.call(gate, "lua", "open", {
+			address = "127.0.0.1",
+			port = PORT,
+			maxclient = 16,
+			header = header,
+			frame = not noframe,
+		})
+		local c = client()
+		socket.read(c)	-- wait for close
+		skynet.exit()
+	elseif mode == "gate" then
+		local check = checker()
+		local gate
+		local c
+		skynet.register_protocol {
+			name = "text",
+			id = skynet.PTYPE_TEXT,
+			pack = function(...) return table.concat({...}, " ") end,
+			unpack = skynet.tostring,
+			dispatch = function(_, _, msg)
+				local id, cmd, data = msg:match "^(%d+) (%a+) ?(.*)$"
+				if cmd == "open" then
+					skynet.send(gate, "text", "start", id)
+				elseif cmd == "data" then
+					if check(data) then
+						skynet.send(gate, "text", "kick", id)
+					end
+				elseif cmd == "close" then
+					socket.close(c)
+					skynet.exit()
+				end
+			end
+		}
+		gate = skynet.launch("gate", header == 4 and "L" or "S", skynet.address(skynet.self()), "127.0.0.1:" .. PORT, 0, 16)
+		c = client()
+	end
+end)
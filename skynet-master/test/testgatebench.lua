@@ -0,0 +1,90 @@
+local skynet = require "skynet"
+require "skynet.manager"	-- import skynet.abort
+
+-- gateserver benchmark
+-- usage : testgatebench [clients] [packages per second] [seconds] [burst]
+-- Each client sends small packages, burst packages in one write. The gate counts
+-- the packages it dispatches (netpack.popall when a read has more than one package).
+
+local mode = ...
+
+local PORT = 8771
+local SERVICE = 8	-- client services
+
+if mode == "gate" then
+	local gateserver = require "snax.gateserver"
+	local netpack = require "netpack"
+	local count = 0
+	local handler = {}
+	function handler.connect(fd)
+		gateserver.openclient(fd)
+	end
+	function handler.message(fd, msg, sz)
+		count = count + 1
+		netpack.tostring(msg, sz)
+	end
+	function handler.command(cmd)
+		return count
+	end
+	gateserver.start(handler)
+	return
+end
+
+local socket = require "socket"
+
+if mode == "client" then
+	local _, n, pps, burst = ...
+	n, pps, burst = tonumber(n), tonumber(pps), tonumber(burst)
+	skynet.start(function()
+		local fds = {}
+		for i=1,n do
+			fds[i] = socket.open("127.0.0.1", PORT)
+		end
+		local pack = string.rep(string.pack(">s2", string.rep("x", 16)), burst)
+		local interval = 100 * burst // pps	-- in 1/100 s
+		skynet.dispatch("lua", function()
+			-- spread the clients over one interval
+			local step = n // interval + 1
+			while true do
+				for i=1,n,step do
+					for j=i,math.min(i+step-1, n) do
+						socket.write(fds[j], pack)
+					end
+					skynet.sleep(1)
+				end
+			end
+		end)
+	end)
+	return
+end
+
+local nclient, pps, seconds, burst = ...
+nclient = tonumber(nclient) or 10000
+pps = tonumber(pps) or 50
+seconds = tonumber(seconds) or 10
+burst = tonumber(burst) or 5
+
+skynet.start(function()
+	local gate = skynet.newservice(SERVICE_NAME, "gate")
+	skynet.call(gate, "lua", "open", { address = "127.0.0.1", port = PORT, maxclient = nclient + 1 })
+	local clients = {}
+	for i=1,SERVICE do
+		clients[i] = skynet.newservice(SERVICE_NAME, "client", nclient // SERVICE, pps, burst)
+	end
+	print(string.format("gate bench : %d clients, %d packages/s each, burst %d", nclient // SERVICE * SERVICE, pps, burst))
+	for i=1,SERVICE do
+		skynet.send(clients[i], "lua")
+	end
+	local first = skynet.call(gate, "lua", "count")
+	local last = first
+	local start = skynet.now()
+	for i=1,seconds do
+		skynet.sleep(100)
+		local count = skynet.call(gate, "lua", "count")
+		print(string.format("gate bench : %d packages/s", count - last))
+		last = count
+	end
+	local ti = skynet.now() - start
+	print(string.format("gate bench : avg %d packages/s", (last - first) * 100 // ti))
+	skynet.abort()
+end)
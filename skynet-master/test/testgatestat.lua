@@ -0,0 +1,59 @@
+local skynet = require "skynet"
+require "skynet.manager"	-- import skynet.launch
+local socket = require "socket"
+
+-- connection metrics of the C gate service
+-- usage : testgatestat [clients] [metric]
+-- Client i sends i packages and the gate sends i * 100 bytes back, then "top" lists the connections.
+-- At last, client i sends the header and i * 5 bytes of a package, so the metric "buffer" of it is 2 + i * 5.
+
+local nclient, metric = ...
+nclient = tonumber(nclient) or 8
+metric = metric or "recv"
+
+local PORT = 8773
+
+skynet.start(function()
+	local gate
+	local opened = 0
+	skynet.register_protocol {
+		name = "text",
+		id = skynet.PTYPE_TEXT,
+		pack = function(...) return table.concat({...}, " ") end,
+		unpack = skynet.tostring,
+		dispatch = function(_, _, msg)
+			local id, cmd = msg:match "^(%d+) (%a+)"
+			if cmd == "open" then
+				skynet.send(gate, "text", "start", id)
+				opened = opened + 1
+			end
+		end
+	}
+	gate = skynet.launch("gate", "S", skynet.address(skynet.self()), "127.0.0.1:" .. PORT, 0, nclient)
+	local fds = {}
+	for i=1,nclient do
+		fds[i] = socket.open("127.0.0.1", PORT)
+	end
+	while opened < nclient do
+		skynet.sleep(1)
+	end
+	skynet.sleep(10)
+	local ids = {}
+	for line in skynet.call(gate, "text", "top", nclient):gmatch "[^\n]+" do
+		local id = line:match "^(%d+)"
+		if id then
+			table.insert(ids, tonumber(id))
+		end
+	end
+	table.sort(ids)
+	for i, fd in ipairs(fds) do
+		for j=1,i do
+			socket.write(fd, string.pack(">s2", string.rep("x", j)))
+		end
+		skynet.send(gate, "text", "broadcast", ids[i], string.rep("y", i * 100))
+		socket.write(fd, string.pack(">I2", i * 10) .. string.rep("z", i * 5))
+	end
+	skynet.sleep(50)
+	print(skynet.call(gate, "text", "top", 3, metric))
+	skynet.abort()
+end)
@@ -0,0 +1,48 @@
+local skynet = require "skynet"
+require "skynet.manager"	-- import skynet.name, skynet.abort
+
+-- the first call to global names on a new harbor
+-- usage : run "testharborname register [names]" in the master node (harbor 1, standalone),
+-- and "testharborname [names] [calls]" in another harbor after "registered"
+-- boot : the time from the harbor start to the start of this service (the slave handshakes with master before)
+
+local mode, count, calls = ...
+
+if mode == "register" then
+
+count = tonumber(count) or 50000
+skynet.start(function()
+	skynet.dispatch("lua", function(_,_, cmd)
+		assert(cmd == "ping")
+		skynet.ret(skynet.pack "pong")
+	end)
+	local self = skynet.self()
+	local start = skynet.now()
+	for i=1,count do
+		skynet.name("gname" .. i, self)
+	end
+	-- a call to the last name is after all the names registered in master
+	assert(skynet.call("gname" .. count, "lua", "ping") == "pong")
+	print(string.format("registered %d global names in %d0 ms", count, skynet.now() - start))
+end)
+
+return
+end
+
+count, calls = tonumber(mode) or 50000, tonumber(count)
+calls = calls or count
+
+skynet.start(function()
+	local boot = skynet.now()
+	local start = skynet.now()
+	local step = math.max(count // calls, 1)
+	local n = 0
+	for i=1,count,step do
+		assert(skynet.call("gname" .. i, "lua", "ping") == "pong")
+		n = n + 1
+	end
+	local ti = skynet.now() - start
+	print(string.format("harbor names : boot %d0 ms with %d global names, first call to %d names in %d0 ms (%.1f us per call)",
+		boot, count, n, ti, ti * 10000 / n))
+	skynet.abort()
+end)
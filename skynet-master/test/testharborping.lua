@@ -0,0 +1,73 @@
+local skynet = require "skynet"
+local harbor = require "skynet.harbor"
+require "skynet.manager"	-- import skynet.register
+
+-- cross node ping through the harbor link
+-- usage : run "testharborping pong" in one node and "testharborping ping [coroutines] [count] [size]" in another
+-- call : each coroutine calls the remote service count times (with size bytes payload)
+-- send : count * coroutines one-way messages, and a call at last to wait for all of them
+-- order : the messages are received in order, with a large one (1M) among them
+-- harbor_direct = true in the config of both nodes : the messages to handle bypass the harbor service
+
+local mode, nco, count, size = ...
+
+if mode == "pong" then
+	local n = 0
+	skynet.start(function()
+		skynet.dispatch("lua", function(session, _, cmd, v)
+			if cmd == "ping" then
+				skynet.ret(skynet.pack(v))
+			elseif cmd == "send" then
+				n = n + 1
+				assert(v == n, "out of order")
+			elseif cmd == "count" then
+				skynet.ret(skynet.pack(n))
+				n = 0
+			end
+		end)
+		skynet.register "PONG"
+	end)
+	return
+end
+
+nco = tonumber(nco) or 100
+count = tonumber(count) or 1000
+size = tonumber(size) or 0
+
+skynet.start(function()
+	local pong = harbor.queryname "PONG"
+	local payload = string.rep("x", size)
+	local done = 0
+	local start = skynet.now()
+	for i=1,nco do
+		skynet.fork(function()
+			for j=1,count do
+				assert(skynet.call(pong, "lua", "ping", payload .. j) == payload .. j)
+			end
+			done = done + 1
+		end)
+	end
+	while done < nco do
+		skynet.sleep(1)
+	end
+	local ti = (skynet.now() - start) / 100
+	print(string.format("harbor ping (call) : %d coroutines, %d calls in %.2fs, %d calls/s",
+		nco, nco * count, ti, math.floor(nco * count / math.max(ti, 0.01))))
+
+	start = skynet.now()
+	for i=1,nco * count do
+		skynet.send(pong, "lua", "send", i, payload)
+	end
+	assert(skynet.call(pong, "lua", "count") == nco * count)
+	ti = (skynet.now() - start) / 100
+	print(string.format("harbor ping (send) : %d messages in %.2fs, %d messages/s",
+		nco * count, ti, math.floor(nco * count / math.max(ti, 0.01))))
+
+	local large = string.rep("x", 0x100000)
+	for i=1,1000 do
+		skynet.send(pong, "lua", "send", i, i == 500 and large or payload)
+	end
+	assert(skynet.call(pong, "lua", "count") == 1000)
+	print "harbor ping (order) : ok"
+	skynet.abort()
+end)
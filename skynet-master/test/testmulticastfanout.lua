@@ -0,0 +1,98 @@
+local skynet = require "skynet"
+local mc = require "multicast"
+require "skynet.manager"	-- import skynet.abort
+
+-- multicast fan-out : one channel, many local subscribers
+-- usage : testmulticastfanout [subscribers] [messages per second] [seconds]
+-- multicastd cpu : the time spent in multicastd for each published message
+-- churn : each subscriber unsubscribes and subscribes again, multicastd cpu for each operation
+
+local mode = ...
+
+if mode == "sub" then
+
+local n = 0
+local c
+skynet.start(function()
+	skynet.dispatch("lua", function (_,_, cmd, channel)
+		if cmd == "init" then
+			c = mc.new {
+				channel = channel ,
+				dispatch = function ()
+					n = n + 1
+				end
+			}
+			c:subscribe()
+			skynet.ret(skynet.pack())
+		elseif cmd == "churn" then
+			c:unsubscribe()
+			c:subscribe()
+			skynet.ret(skynet.pack())
+		elseif cmd == "count" then
+			skynet.ret(skynet.pack(n))
+		end
+	end)
+end)
+
+return
+end
+
+local nsub, rate, seconds = ...
+nsub = tonumber(nsub) or 10000
+rate = tonumber(rate) or 1000
+seconds = tonumber(seconds) or 5
+
+skynet.start(function()
+	local channel = mc.new()
+	local sub = {}
+	for i=1,nsub do
+		sub[i] = skynet.newservice(SERVICE_NAME, "sub")
+		skynet.call(sub[i], "lua", "init", channel.channel)
+	end
+	local multicastd = skynet.uniqueservice "multicastd"
+	local cpu = skynet.call(multicastd, "debug", "STAT").cpu
+
+	local per_tick = math.max(rate // 100, 1)
+	local published = 0
+	local start = skynet.now()
+	for tick=1,seconds * 100 do
+		for i=1,per_tick do
+			channel:publish("Hello World", tick, i)
+			published = published + 1
+		end
+		local wait = start + tick - skynet.now()
+		if wait > 0 then
+			skynet.sleep(wait)
+		end
+	end
+	local publish_ti = (skynet.now() - start) / 100
+	cpu = skynet.call(multicastd, "debug", "STAT").cpu - cpu
+
+	local delivered = 0
+	for i=1,nsub do
+		-- the call is after the multicast messages in the queue of subscriber
+		delivered = delivered + skynet.call(sub[i], "lua", "count")
+	end
+	local ti = (skynet.now() - start) / 100
+	assert(delivered == published * nsub)
+	print(string.format("multicast fan-out : %d subscribers, %d messages in %.2fs (target %d/s, %.2fs), multicastd cpu %.2f us per message",
+		nsub, published, publish_ti, rate, seconds, cpu * 1000000 / published))
+	print(string.format("multicast fan-out : %d deliveries in %.2fs, %d deliveries/s",
+		delivered, ti, math.floor(delivered / ti)))
+
+	cpu = skynet.call(multicastd, "debug", "STAT").cpu
+	for i=1,nsub do
+		skynet.call(sub[i], "lua", "churn")
+	end
+	cpu = skynet.call(multicastd, "debug", "STAT").cpu - cpu
+	-- each subscriber is still in the channel once
+	channel:publish("Hello World")
+	delivered = 0
+	for i=1,nsub do
+		delivered = delivered + skynet.call(sub[i], "lua", "count")
+	end
+	assert(delivered == (published + 1) * nsub)
+	print(string.format("multicast churn : %d subscribers unsubscribe and subscribe, multicastd cpu %.2f us per operation",
+		nsub, cpu * 1000000 / (nsub * 2)))
+	skynet.abort()
+end)
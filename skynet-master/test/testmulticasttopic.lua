@@ -0,0 +1,137 @@
+local skynet = require "skynet"
+local mc = require "multicast"
+require "skynet.manager"	-- import skynet.abort
+
+-- multicast topics : named topics, subscribe by pattern ("*" one level, "#" the rest levels)
+-- usage : testmulticasttopic [subscribers] [messages]
+-- multicastd cpu : the time spent in multicastd for each published message, topic vs channel
+
+local mode = ...
+
+if mode == "sub" then
+
+local sub = {}
+local n = 0
+local received = {}
+skynet.start(function()
+	skynet.dispatch("lua", function (_,_, cmd, pattern)
+		if cmd == "sub" then
+			local c = mc.new {
+				topic = type(pattern) == "string" and pattern or nil,
+				channel = type(pattern) == "number" and pattern or nil,
+				dispatch = function (self, source, topic)
+					n = n + 1
+					local key = self.topic and (self.topic .. " " .. topic) or "channel"
+					received[key] = (received[key] or 0) + 1
+				end
+			}
+			c:subscribe()
+			sub[pattern] = c
+			skynet.ret(skynet.pack())
+		elseif cmd == "unsub" then
+			sub[pattern]:unsubscribe()
+			sub[pattern] = nil
+			skynet.ret(skynet.pack())
+		elseif cmd == "count" then
+			skynet.ret(skynet.pack(n, received))
+			n = 0
+			received = {}
+		end
+	end)
+end)
+
+return
+end
+
+local nsub, count = ...
+nsub = tonumber(nsub) or 1000
+count = tonumber(count) or 1000
+
+local topics = { "zone.1.guild.5", "zone.1.guild.6", "zone.1", "zone.2.guild.5", "world" }
+
+local patterns = {
+	["zone.1.guild.5"] = { "zone.1.guild.5" },
+	["zone.1.guild.*"] = { "zone.1.guild.5", "zone.1.guild.6" },
+	["zone.1.#"] = { "zone.1.guild.5", "zone.1.guild.6", "zone.1" },
+	["zone.*.guild.5"] = { "zone.1.guild.5", "zone.2.guild.5" },
+	["zone.*"] = { "zone.1" },
+	["zone.#"] = { "zone.1.guild.5", "zone.1.guild.6", "zone.1", "zone.2.guild.5" },
+	["#"] = topics,
+}
+
+local function publish_all()
+	for _, topic in ipairs(topics) do
+		mc.new { topic = topic }:publish "hello"
+	end
+end
+
+local function check(s, expect)
+	local n, received = skynet.call(s, "lua", "count")
+	local total = 0
+	for pattern, match in pairs(expect) do
+		for _, topic in ipairs(match) do
+			local key = pattern .. " " .. topic
+			assert(received[key] == 1, key)
+			total = total + 1
+		end
+	end
+	assert(n == total, n)
+end
+
+skynet.start(function()
+	-- each pattern
+	local sub = {}
+	for pattern in pairs(patterns) do
+		local s = skynet.newservice(SERVICE_NAME, "sub")
+		skynet.call(s, "lua", "sub", pattern)
+		sub[pattern] = s
+	end
+	-- two patterns in one service, the message is received once for each subscription
+	local both = skynet.newservice(SERVICE_NAME, "sub")
+	skynet.call(both, "lua", "sub", "zone.1.#")
+	skynet.call(both, "lua", "sub", "zone.*.guild.5")
+	publish_all()
+	for pattern, s in pairs(sub) do
+		check(s, { [pattern] = patterns[pattern] })
+	end
+	check(both, { ["zone.1.#"] = patterns["zone.1.#"], ["zone.*.guild.5"] = patterns["zone.*.guild.5"] })
+
+	skynet.call(both, "lua", "unsub", "zone.1.#")
+	skynet.call(sub["#"], "lua", "unsub", "#")
+	publish_all()
+	check(both, { ["zone.*.guild.5"] = patterns["zone.*.guild.5"] })
+	check(sub["#"], {})
+	check(sub["zone.#"], { ["zone.#"] = patterns["zone.#"] })
+
+	for _, topic in ipairs { "zone.*", "zone.#", "zone..1", "" } do
+		assert(not pcall(mc.new { topic = topic }.publish, mc.new { topic = topic }, "hello"), topic)
+	end
+	print "multicast topic : ok"
+
+	-- topic (two patterns) vs channel, the same subscribers
+	local channel = mc.new()
+	local pattern = { "zone.1.guild.*", "zone.#" }
+	local s = {}
+	for i=1,nsub do
+		s[i] = skynet.newservice(SERVICE_NAME, "sub")
+		skynet.call(s[i], "lua", "sub", pattern[i % 2 + 1])
+		skynet.call(s[i], "lua", "sub", channel.channel)
+	end
+	local topic = mc.new { topic = "zone.1.guild.5" }
+	local multicastd = skynet.uniqueservice "multicastd"
+	for _, c in ipairs { channel, topic } do
+		local cpu = skynet.call(multicastd, "debug", "STAT").cpu
+		for i=1,count do
+			c:publish("Hello World", i)
+		end
+		cpu = skynet.call(multicastd, "debug", "STAT").cpu - cpu
+		local delivered = 0
+		for i=1,nsub do
+			delivered = delivered + skynet.call(s[i], "lua", "count")
+		end
+		assert(delivered == count * nsub)
+		print(string.format("multicast %-7s : %d subscribers, %d messages, multicastd cpu %.2f us per message",
+			c.topic and "topic" or "channel", nsub, count, cpu * 1000000 / count))
+	end
+	skynet.abort()
+end)
@@ -112,6 +112,27 @@ skynet.start(function()
 	local res =  db:query("select * from notexisttable" )
 	print( "bad query test result=" ,dump(res) )
 
+	-- pool mode : each query may use a different connection, so the queries depend on the connection state
+	-- (BEGIN ... COMMIT, SET, USE, LAST_INSERT_ID() ...) must be in db:transaction(f)
+	local pooldb = mysql.connect({
+		host="127.0.0.1",
+		port=3306,
+		database="skynet",
+		user="root",
+		password="1",
+		pool = 4,
+	})
+	res = pooldb:transaction(function(db)
+		db:query("begin")
+		db:query("insert into cats (name) values (\'Tom\')")
+		local res = db:query("select last_insert_id() as id")
+		db:query("commit")
+		return res
+	end)
+	print ( "pool transaction test result=", dump( res ) )
+	print ( "pool begin out of transaction=", pcall(pooldb.query, pooldb, "begin") )
+	pooldb:disconnect()
+
     local i=1
     while true do
         local    res = db:query("select * from cats order by id asc")
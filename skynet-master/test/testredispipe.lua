@@ -0,0 +1,96 @@
+local skynet = require "skynet"
+local redis = require "redis"
+
+-- redis request batching (socketchannel cork mode) benchmark
+-- usage : testredispipe [cork|nocork] [coroutines] [requests] [fake]
+-- Each coroutine sends requests (set/get) one by one, with cork the requests of the woken
+-- coroutines in one dispatch are sent in one write.
+-- fake : use a fake redis server in this process instead of 127.0.0.1:6379 (as test/testredis.lua)
+
+local mode, nco, count, fake = ...
+
+local FAKE_PORT = 8776
+
+if mode == "server" then
+	local socket = require "socket"
+	-- SET and GET only, the replies of one dispatch are sent in one write
+	local store = {}
+	local function serve(id)
+		local out = {}
+		local function reply(str)
+			out[#out+1] = str
+			if #out == 1 then
+				skynet.fork(function()
+					socket.write(id, out)
+					out = {}
+				end)
+			end
+		end
+		socket.start(id)
+		while true do
+			local line = socket.readline(id, "\r\n")
+			if not line then
+				break
+			end
+			local args = {}
+			for i=1,tonumber(line:sub(2)) do
+				local len = tonumber(socket.readline(id, "\r\n"):sub(2))
+				args[i] = socket.read(id, len + 2):sub(1, -3)
+			end
+			if args[1] == "GET" then
+				local v = store[args[2]]
+				reply(v and "$" .. #v .. "\r\n" .. v .. "\r\n" or "$-1\r\n")
+			else
+				store[args[2]] = args[3]
+				reply "+OK\r\n"
+			end
+		end
+		socket.close(id)
+	end
+	skynet.start(function()
+		local lid = socket.listen("127.0.0.1", FAKE_PORT)
+		socket.start(lid, function(id)
+			skynet.fork(serve, id)
+		end)
+	end)
+	return
+end
+
+mode = mode or "cork"
+nco = tonumber(nco) or 100
+count = tonumber(count) or 1000
+
+skynet.start(function()
+	local conf = {
+		host = "127.0.0.1",
+		port = 6379,
+		db = 0,
+		cork = mode == "cork",
+	}
+	if fake == "fake" then
+		skynet.newservice(SERVICE_NAME, "server")
+		conf.port = FAKE_PORT
+		conf.db = nil
+	end
+	local db = redis.connect(conf)
+	local done = 0
+	local start = skynet.now()
+	for i=1,nco do
+		skynet.fork(function()
+			local key = "testredispipe" .. i
+			for j=1,count do
+				db:set(key, j)
+				assert(tonumber(db:get(key)) == j)
+			end
+			done = done + 1
+		end)
+	end
+	while done < nco do
+		skynet.sleep(1)
+	end
+	local ti = (skynet.now() - start) / 100
+	print(string.format("redis pipe (%s) : %d coroutines, %d requests in %.2fs, %d requests/s",
+		mode, nco, nco * count * 2, ti, math.floor(nco * count * 2 / math.max(ti, 0.01))))
+	db:disconnect()
+	skynet.exit()
+end)
@@ -0,0 +1,51 @@
+local skynet = require "skynet"
+local socket = require "socket"
+
+-- SO_REUSEPORT test : n listeners on the same port, count the connections each one accepts
+-- usage : testreuseport [listeners] [connections]
+
+local n, conn = ...
+local mode = n
+n = tonumber(n) or 4
+conn = tonumber(conn) or 1000
+
+local PORT = 8770
+
+if mode == "listener" then
+	local accepted = 0
+	skynet.start(function()
+		local id = socket.listen("127.0.0.1", PORT, nil, true)
+		socket.start(id, function(fd, addr)
+			accepted = accepted + 1
+			socket.close_fd(fd)
+		end)
+		skynet.dispatch("lua", function()
+			skynet.ret(skynet.pack(accepted))
+		end)
+	end)
+	return
+end
+
+skynet.start(function()
+	local listener = {}
+	for i=1,n do
+		listener[i] = skynet.newservice(SERVICE_NAME, "listener")
+	end
+	local start = skynet.now()
+	for i=1,conn do
+		local c = socket.open("127.0.0.1", PORT)
+		if c then
+			socket.close(c)
+		end
+	end
+	local ti = (skynet.now() - start) / 100
+	skynet.sleep(10)
+	local total = 0
+	for i=1,n do
+		local a = skynet.call(listener[i], "lua")
+		total = total + a
+		print(string.format("reuseport : listener %d accept %d", i, a))
+	end
+	print(string.format("reuseport : %d connections in %.2fs", total, ti))
+	skynet.exit()
+end)
@@ -0,0 +1,55 @@
+local skynet = require "skynet"
+local socket = require "socket"
+
+-- sendfile test
+-- usage : testsendfile [megabytes]
+
+local mb = tonumber((...)) or 16
+
+local PORT = 8769
+
+skynet.start(function()
+	local path = os.tmpname()
+	local f = assert(io.open(path, "wb"))
+	local block = {}
+	for i=0,1023 do
+		block[#block+1] = string.format("%04x", i % 0x10000)
+	end
+	block = table.concat(block)	-- 4K
+	for i=1, mb * 256 do
+		f:write(block)
+	end
+	f:close()
+	local size = mb * 1024 * 1024
+
+	local recv
+	local lid = socket.listen("127.0.0.1", PORT)
+	socket.start(lid, function(id, addr)
+		socket.start(id)
+		skynet.fork(function()
+			recv = socket.readall(id)
+			socket.close(id)
+		end)
+	end)
+
+	local c = socket.open("127.0.0.1", PORT)
+	local start = skynet.now()
+	assert(socket.sendfile(c, path))
+	assert(socket.sendfile(c, path, 4096 + 16, 32))
+	socket.write(c, "end")
+	print(socket.sendfile(c, path .. ".none"))
+	socket.close(c)
+	while not recv do
+		skynet.sleep(1)
+	end
+	local ti = (skynet.now() - start) / 100
+	os.remove(path)
+
+	assert(#recv == size + 32 + 3)
+	assert(recv:sub(1, 4096) == block)
+	assert(recv:sub(size + 1, size + 32) == block:sub(17, 48))
+	assert(recv:sub(-3) == "end")
+	print(string.format("sendfile : %d bytes in %.2fs", #recv, ti))
+	socket.close(lid)
+	skynet.exit()
+end)
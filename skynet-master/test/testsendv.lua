@@ -0,0 +1,76 @@
+local skynet = require "skynet"
+local socket = require "socket"
+
+-- vectored send test : socket.write a table of strings and messages { header, msg, sz, ... }
+-- usage : testsendv [vector|concat] [count] [size] [pieces]
+-- vector : the message (skynet.pack) is sent without copying
+-- concat : the message is copied into a string first (like cluster.packrequest did)
+-- pieces : the packages in one socket.write, more than 21 (MAX_SEND_IOV / 3) need more than one writev
+
+local mode, count, size, pieces = ...
+mode = mode or "vector"
+count = tonumber(count) or 100000
+size = tonumber(size) or 1024
+pieces = tonumber(pieces) or 1
+
+local PORT = 8775
+
+local function request(i)
+	local msg, sz = skynet.pack(i, string.rep("x", i % 100 == 0 and size * 64 or size))
+	local header = string.pack(">I4", sz)
+	if mode == "vector" then
+		return { header, msg, sz, "!" }, sz
+	else
+		local str = skynet.tostring(msg, sz)
+		skynet.trash(msg, sz)
+		return header .. str .. "!", sz
+	end
+end
+
+skynet.start(function()
+	local lid = socket.listen("127.0.0.1", PORT)
+	local id
+	socket.start(lid, function(newid)
+		id = newid
+	end)
+	local c = socket.open("127.0.0.1", PORT)
+	while not id do
+		skynet.sleep(1)
+	end
+	local start = skynet.now()
+	skynet.fork(function()
+		local req = {}
+		for i=1,count do
+			local r = request(i)
+			if pieces == 1 then
+				req = r
+			elseif type(r) == "table" then
+				table.move(r, 1, #r, #req + 1, req)
+			else
+				table.insert(req, r)
+			end
+			if i % pieces == 0 or i == count then
+				assert(socket.write(c, req))
+				req = {}
+			end
+			if i % 100 == 0 then
+				skynet.yield()
+			end
+		end
+	end)
+	socket.start(id)
+	local bytes = 0
+	for i=1,count do
+		local sz = string.unpack(">I4", socket.read(id, 4))
+		local n, str = skynet.unpack(socket.read(id, sz))
+		assert(n == i and #str == (i % 100 == 0 and size * 64 or size), "package " .. i .. " mismatch")
+		assert(socket.read(id, 1) == "!")
+		bytes = bytes + sz + 5
+	end
+	local ti = (skynet.now() - start) / 100
+	print(string.format("sendv (%s) : %d packages (%d K) in %.2fs", mode, count, bytes // 1024, ti))
+	socket.close(c)
+	socket.close(id)
+	socket.close(lid)
+	skynet.exit()
+end)
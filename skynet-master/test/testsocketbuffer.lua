@@ -0,0 +1,131 @@
+local skynet = require "skynet"
+local socket = require "socket"
+
+-- socket read buffer benchmark : parse redis / mysql replies with socket.readline and socket.read
+-- usage : testsocketbuffer [redis|mysql] [count]
+-- A writer service sends count replies in 4K pieces, the reader parses and checks them.
+
+local mode, count = ...
+
+local PORT = 8774
+
+local function bulk(i)
+	local size = i % 100 == 0 and 8000 or (i * 7) % 200
+	return string.rep(string.char(65 + i % 26), size)
+end
+
+local function redis_reply(i)
+	local t = i % 4
+	if t == 0 then
+		return "+OK\r\n"
+	elseif t == 1 then
+		return ":" .. i .. "\r\n"
+	elseif t == 2 then
+		local b = bulk(i)
+		return "$" .. #b .. "\r\n" .. b .. "\r\n"
+	else
+		local r = { "*3\r\n" }
+		for j=i,i+2 do
+			local b = bulk(j)
+			table.insert(r, "$" .. #b .. "\r\n" .. b .. "\r\n")
+		end
+		return table.concat(r)
+	end
+end
+
+local function mysql_reply(i)
+	local b = bulk(i)
+	return string.pack("<I3B", #b, i & 0xff) .. b
+end
+
+if mode == "writer" then
+	local _, m, n = ...
+	n = tonumber(n)
+	local reply = m == "redis" and redis_reply or mysql_reply
+	skynet.start(function()
+		local buf = {}
+		for i=1,n do
+			table.insert(buf, reply(i))
+		end
+		local s = table.concat(buf)
+		local c = socket.open("127.0.0.1", PORT)
+		for pos=1,#s,4096 do
+			socket.write(c, s:sub(pos, pos + 4095))
+		end
+		skynet.exit()
+	end)
+	return
+end
+
+mode = mode or "redis"
+count = tonumber(count) or 200000
+
+local function read_redis(id)
+	local line = socket.readline(id, "\r\n")
+	local t = line:byte(1)
+	if t == 43 then	-- '+'
+		return line:sub(2)
+	elseif t == 58 then	-- ':'
+		return tonumber(line:sub(2))
+	elseif t == 36 then	-- '$'
+		return socket.read(id, tonumber(line:sub(2)) + 2):sub(1, -3)
+	else	-- '*'
+		local r = {}
+		for i=1,tonumber(line:sub(2)) do
+			r[i] = read_redis(id)
+		end
+		return r
+	end
+end
+
+local function read_mysql(id)
+	local len, seq = string.unpack("<I3B", socket.read(id, 4))
+	return len == 0 and "" or socket.read(id, len), seq
+end
+
+local function check_redis(i, v)
+	local t = i % 4
+	if t == 0 then
+		return v == "OK"
+	elseif t == 1 then
+		return v == i
+	elseif t == 2 then
+		return v == bulk(i)
+	else
+		return v[1] == bulk(i) and v[3] == bulk(i + 2)
+	end
+end
+
+local function check_mysql(i, v, seq)
+	return v == bulk(i) and seq == i & 0xff
+end
+
+skynet.start(function()
+	local lid = socket.listen("127.0.0.1", PORT)
+	local id
+	socket.start(lid, function(newid)
+		id = newid
+	end)
+	skynet.newservice(SERVICE_NAME, "writer", mode, count)
+	while not id do
+		skynet.sleep(1)
+	end
+	socket.start(id)
+	local read = mode == "redis" and read_redis or read_mysql
+	local check = mode == "redis" and check_redis or check_mysql
+	local start = skynet.now()
+	local clock = os.clock()
+	for i=1,count do
+		local v, seq = read(id)
+		if i % 1000 == 0 then
+			assert(check(i, v, seq), "reply " .. i .. " mismatch")
+		end
+	end
+	local ti = (skynet.now() - start) / 100
+	local cpu = os.clock() - clock
+	print(string.format("socket buffer (%s) : %d replies in %.2fs, %.2fs cpu, %d replies/s",
+		mode, count, ti, cpu, math.floor(count / math.max(ti, 0.01))))
+	socket.close(id)
+	socket.close(lid)
+	skynet.exit()
+end)
@@ -0,0 +1,61 @@
+local skynet = require "skynet"
+local socket = require "socket"
+
+-- UDP echo benchmark
+-- usage : testudpecho [pps] [seconds] [clients]
+
+local pps, seconds, nclient = ...
+local mode = pps
+pps = tonumber(pps) or 500000
+seconds = tonumber(seconds) or 5
+nclient = tonumber(nclient) or 4
+
+local PORT = 8766
+
+local function server()
+	local host
+	host = socket.udp(function(str, from)
+		socket.sendto(host, from, str)
+	end , "127.0.0.1", PORT)
+end
+
+local send = 0
+local recv = 0
+
+local function client()
+	local c = socket.udp(function(str, from)
+		recv = recv + 1
+	end)
+	socket.udp_connect(c, "127.0.0.1", PORT)
+	local msg = string.rep("x", 32)
+	local n = pps // nclient // 100	-- send per tick
+	for tick = 1, seconds * 100 do
+		for i=1,n do
+			socket.write(c, msg)
+		end
+		send = send + n
+		skynet.sleep(1)
+	end
+end
+
+if mode == "server" then
+	skynet.start(server)
+	return
+end
+
+skynet.start(function()
+	skynet.newservice(SERVICE_NAME, "server")
+	for i=1,nclient do
+		skynet.fork(client)
+	end
+	local start = skynet.now()
+	local last = 0
+	for i=1,seconds+1 do
+		skynet.sleep(100)
+		print(string.format("udp echo : send %d recv %d, %d pps", send, recv, recv - last))
+		last = recv
+	end
+	local ti = skynet.now() - start
+	print(string.format("udp echo : total send %d recv %d in %.2fs, avg %d pps", send, recv, ti/100, recv * 100 // ti))
+	skynet.exit()
+end)
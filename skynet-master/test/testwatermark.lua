@@ -0,0 +1,72 @@
+local skynet = require "skynet"
+local socket = require "socket"
+
+-- write buffer watermark test
+-- usage : testwatermark [pause|drop|close]
+-- The accepted socket is not started for 1s, so the writer fills its write buffer.
+-- pause : the writer blocks in socket.drain, all bytes are received.
+-- drop : the writer uses socket.lwrite, the data over high watermark is dropped.
+-- close : the writer socket is closed when it reaches high watermark.
+
+local policy = ... or "pause"
+
+local PORT = 8768
+local HIGH = 1024 * 1024
+local LOW = 256 * 1024
+local CHUNK = 64 * 1024
+local TOTAL = 16 * 1024 * 1024
+
+skynet.start(function()
+	local accepted
+	local lid = socket.listen("127.0.0.1", PORT)
+	socket.start(lid, function(id, addr)
+		accepted = id
+	end)
+
+	local c = socket.open("127.0.0.1", PORT)
+	socket.watermark(c, HIGH, LOW, policy)
+	local warning = 0
+	socket.warning(c, function(id, size)
+		warning = warning + 1
+		print(string.format("watermark : warning %d K", size))
+	end)
+
+	local block = string.rep("x", CHUNK)
+	local sent = 0
+	skynet.fork(function()
+		for i=1, TOTAL // CHUNK do
+			if policy == "drop" then
+				socket.lwrite(c, block)
+			else
+				socket.write(c, block)
+			end
+			sent = sent + CHUNK
+			skynet.yield()
+			if policy ~= "drop" and not socket.drain(c) then
+				break
+			end
+		end
+		socket.close(c)
+	end)
+
+	while not accepted do
+		skynet.sleep(1)
+	end
+	skynet.sleep(100)
+	print(string.format("watermark : %d K written before start reading", sent // 1024))
+
+	socket.start(accepted)
+	local recv = 0
+	while true do
+		local str = socket.read(accepted)
+		if not str then
+			break
+		end
+		recv = recv + #str
+	end
+	print(string.format("watermark (%s) : write %d K, recv %d K, %d warning",
+		policy, sent // 1024, recv // 1024, warning))
+	socket.close(accepted)
+	socket.close(lid)
+	skynet.exit()
+end)